@@ -4,6 +4,15 @@
 #include <trap.h>
 #include <kmonitor.h>
 #include <kdebug.h>
+#include <ide.h>
+#include <bcache.h>
+#include <pcache.h>
+#include <pmm.h>
+#include <vmm.h>
+#include <slab.h>
+#include <swap.h>
+#include <zswap.h>
+#include <sched.h>
 
 /* *
  * Simple command-line kernel monitor useful for controlling the
@@ -21,6 +30,13 @@ static struct command commands[] = {
     {"help", "Display this list of commands.", mon_help},
     {"kerninfo", "Display information about the kernel.", mon_kerninfo},
     {"backtrace", "Print backtrace of stack frame.", mon_backtrace},
+    {"iostat", "Display block cache and disk i/o scheduler counters.", mon_iostat},
+    {"vmstat", "Display page fault, copy-on-write, swap and kswapd counters.", mon_vmstat},
+    {"meminfo", "Display free page blocks by order and fragmentation.", mon_meminfo},
+    {"slabinfo", "Display objects and slabs of the kernel object caches.", mon_slabinfo},
+    {"pgfault", "Display page faults by kind with latency histograms.", mon_pgfault},
+    {"zswap", "Display compressed swap pool counters, or turn it on|off.", mon_zswap},
+    {"sched", "Display the scheduling classes, or switch to another one.", mon_sched},
 };
 
 /* return if kernel is panic, in kern/debug/panic.c */
@@ -130,3 +146,123 @@ mon_backtrace(int argc, char **argv, struct trapframe *tf) {
     return 0;
 }
 
+/* *
+ * mon_iostat - print the counters of the block buffer cache and of the
+ * ide request queues (merges, average queue depth and service latency).
+ * */
+int
+mon_iostat(int argc, char **argv, struct trapframe *tf) {
+    bcache_print_stat();
+    ide_print_stat();
+    return 0;
+}
+
+/* *
+ * mon_vmstat - print the page fault counters, how many page copies
+ * copy-on-write fork has avoided so far, the swap counters, the swap device
+ * requests and the readahead hits, and how much kswapd has reclaimed.
+ * */
+int
+mon_vmstat(int argc, char **argv, struct trapframe *tf) {
+    unsigned int cow_copy_num = pgfault_stat[PGFAULT_COW_COPY].count;
+    cprintf("page faults: %u, %u read from file\n", pgfault_num, pgfault_stat[PGFAULT_FILE].count);
+    cprintf("cow: %u pages shared, %u copied, %u reused, %u copies avoided\n",
+            cow_share_num, cow_copy_num, pgfault_stat[PGFAULT_COW_REUSE].count,
+            cow_share_num - cow_copy_num);
+    cprintf("swap: %u pages in, %u out, %u written, %u slots used\n",
+            swap_in_num, swap_out_num, swap_write_num, swap_nr_used);
+    cprintf("swap io: %u reads, %u writes; readahead %u pages, %u hits, %u cached\n",
+            swap_read_io, swap_write_io, swap_ra_num, swap_ra_hit, swap_ra_nr);
+    zswap_print_stat();
+    cprintf("kswapd: %u wakeups, %u pages reclaimed, %u reclaimed by alloc_pages; "
+            "free %u, watermarks %u/%u\n", kswapd_wakeup_num, kswapd_reclaim_num, swap_direct_num,
+            nr_free_pages(), swap_low_watermark, swap_high_watermark);
+    pcache_print_stat();
+    return 0;
+}
+
+/* *
+ * mon_pgfault - print how many page faults of each kind (anonymous zero-fill,
+ * file-backed, swap-in, copy-on-write...) were taken and how long they took,
+ * in TSC cycles.
+ * */
+int
+mon_pgfault(int argc, char **argv, struct trapframe *tf) {
+    pgfault_print_stat();
+    return 0;
+}
+
+/* *
+ * mon_zswap - print the compressed swap pool counters; "zswap on" or
+ * "zswap off" first turns storing pages in the pool on or off, the pages
+ * already there stay until they are swapped in and freed.
+ * */
+int
+mon_zswap(int argc, char **argv, struct trapframe *tf) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "on") == 0) {
+            zswap_enabled = 1;
+        }
+        else if (strcmp(argv[1], "off") == 0) {
+            zswap_enabled = 0;
+        }
+        else {
+            cprintf("usage: zswap [on|off]\n");
+            return 0;
+        }
+    }
+    zswap_print_stat();
+    return 0;
+}
+
+/* *
+ * mon_sched - list the scheduling classes, the one in use marked with '*';
+ * "sched <name>" first moves the runnable processes over to that one.
+ * */
+int
+mon_sched(int argc, char **argv, struct trapframe *tf) {
+    const char *name;
+    int policy;
+    if (argc > 1) {
+        for (policy = 0; (name = sched_policy_name(policy)) != NULL; policy ++) {
+            if (strcmp(argv[1], name) == 0) {
+                sched_setpolicy(policy);
+                break;
+            }
+        }
+        if (name == NULL) {
+            cprintf("usage: sched [");
+            for (policy = 0; (name = sched_policy_name(policy)) != NULL; policy ++) {
+                cprintf("%s%s", (policy == 0) ? "" : "|", name);
+            }
+            cprintf("]\n");
+            return 0;
+        }
+    }
+    for (policy = 0; (name = sched_policy_name(policy)) != NULL; policy ++) {
+        cprintf("%c %d %s\n", (policy == sched_getpolicy()) ? '*' : ' ', policy, name);
+    }
+    return 0;
+}
+
+/* *
+ * mon_meminfo - print the free blocks of physical memory by order, failed
+ * allocations and how fragmented free memory is, the same text as meminfo:.
+ * */
+int
+mon_meminfo(int argc, char **argv, struct trapframe *tf) {
+    static char buf[PMM_STAT_BUFSIZE];
+    pmm_format_stat(buf, sizeof(buf));
+    cprintf("%s", buf);
+    return 0;
+}
+
+/* *
+ * mon_slabinfo - print the objects in use and the slabs of every kmem_cache.
+ * */
+int
+mon_slabinfo(int argc, char **argv, struct trapframe *tf) {
+    kmem_cache_print_stat();
+    return 0;
+}
+
@@ -8,6 +8,13 @@ void kmonitor(struct trapframe *tf);
 int mon_help(int argc, char **argv, struct trapframe *tf);
 int mon_kerninfo(int argc, char **argv, struct trapframe *tf);
 int mon_backtrace(int argc, char **argv, struct trapframe *tf);
+int mon_iostat(int argc, char **argv, struct trapframe *tf);
+int mon_vmstat(int argc, char **argv, struct trapframe *tf);
+int mon_meminfo(int argc, char **argv, struct trapframe *tf);
+int mon_slabinfo(int argc, char **argv, struct trapframe *tf);
+int mon_pgfault(int argc, char **argv, struct trapframe *tf);
+int mon_zswap(int argc, char **argv, struct trapframe *tf);
+int mon_sched(int argc, char **argv, struct trapframe *tf);
 int mon_continue(int argc, char **argv, struct trapframe *tf);
 int mon_step(int argc, char **argv, struct trapframe *tf);
 int mon_breakpoint(int argc, char **argv, struct trapframe *tf);
@@ -1,11 +1,19 @@
 #include <x86.h>
 #include <trap.h>
 #include <stdio.h>
+#include <assert.h>
 #include <picirq.h>
+#include <clock.h>
 
 /* *
  * Support for time-related hardware gadgets - the 8253 timer,
  * which generates interruptes on IRQ-0.
+ *
+ * The 8253 runs one-shot: the interrupt comes when the next timer is due,
+ * the next tick for the running process or a high resolution timer (see
+ * sched.c), or much later when the CPU is idle. Time is read from the TSC,
+ * calibrated against counter 2 of the 8253 at boot; ticks counts the
+ * TICK_US periods since clock_init.
  * */
 
 #define IO_TIMER1           0x040               // 8253 Timer #1
@@ -20,30 +28,101 @@
 
 #define TIMER_MODE      (IO_TIMER1 + 3)         // timer mode port
 #define TIMER_SEL0      0x00                    // select counter 0
+#define TIMER_SEL2      0x80                    // select counter 2
+#define TIMER_ONESHOT   0x00                    // mode 0, interrupt on terminal count
 #define TIMER_RATEGEN   0x04                    // mode 2, rate generator
 #define TIMER_16BIT     0x30                    // r/w counter 16 bits, LSB first
 
+#define IO_TIMER2       (IO_TIMER1 + 2)         // 8253 counter 2, gated by the speaker port
+#define IO_PPI          0x61                    // speaker port: bit 0 gate 2, bit 1 speaker, bit 5 out 2
+
+#define CALIBRATE_MS    10                      // time the TSC is counted for by clock_init
+
 volatile size_t ticks;
+// TSC cycles per millisecond, and the TSC at clock_init
+uint32_t tsc_khz;
+static uint64_t tsc_base;
+// the time the one-shot interrupt is due at, in microseconds
+uint64_t clock_event_us;
+// clock interrupts taken
+volatile size_t clock_irq_num;
 
 long SYSTEM_READ_TIMER( void ){
     return ticks;
 }
 
+// calibrate_tsc - count the TSC cycles while counter 2 counts down CALIBRATE_MS
+static uint32_t
+calibrate_tsc(void) {
+    uint32_t latch = TIMER_DIV(1000 / CALIBRATE_MS);
+    outb(IO_PPI, (inb(IO_PPI) & ~0x02) | 0x01);
+    outb(TIMER_MODE, TIMER_SEL2 | TIMER_ONESHOT | TIMER_16BIT);
+    outb(IO_TIMER2, latch % 256);
+    outb(IO_TIMER2, latch / 256);
+    uint64_t start = read_tsc();
+    while ((inb(IO_PPI) & 0x20) == 0)
+        /* nothing */ ;
+    uint64_t cycles = read_tsc() - start;
+    do_div(cycles, CALIBRATE_MS);
+    return cycles;
+}
+
+// clock_read_us - the microseconds since clock_init
+uint64_t
+clock_read_us(void) {
+    uint64_t us = (read_tsc() - tsc_base) * 1000;
+    do_div(us, tsc_khz);
+    return us;
+}
+
+// clock_update - called by the clock interrupt: bring ticks up to date, return how many have passed
+size_t
+clock_update(void) {
+    clock_irq_num ++;
+    uint64_t now = clock_read_us();
+    do_div(now, TICK_US);
+    size_t nr = (size_t)now - ticks;
+    ticks = now;
+    return nr;
+}
+
+/* *
+ * clock_set_event - make the clock interrupt come at time us, at most
+ * CLOCK_MAX_US from now as the 8253 counts 16 bits, and at least
+ * CLOCK_MIN_US, a past time included.
+ * */
+void
+clock_set_event(uint64_t us) {
+    uint64_t now = clock_read_us(), delta = (us > now) ? us - now : 0;
+    if (delta < CLOCK_MIN_US) {
+        delta = CLOCK_MIN_US;
+    }
+    else if (delta > CLOCK_MAX_US) {
+        delta = CLOCK_MAX_US;
+    }
+    clock_event_us = now + delta;
+    uint64_t count = delta * TIMER_FREQ;
+    do_div(count, 1000000);
+    outb(TIMER_MODE, TIMER_SEL0 | TIMER_ONESHOT | TIMER_16BIT);
+    outb(IO_TIMER1, count % 256);
+    outb(IO_TIMER1, count / 256);
+}
+
 /* *
- * clock_init - initialize 8253 clock to interrupt 100 times per second,
+ * clock_init - calibrate the TSC, make the 8253 interrupt at the first tick,
  * and then enable IRQ_TIMER.
  * */
 void
 clock_init(void) {
-    // set 8253 timer-chip
-    outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
-    outb(IO_TIMER1, TIMER_DIV(100) % 256);
-    outb(IO_TIMER1, TIMER_DIV(100) / 256);
+    tsc_khz = calibrate_tsc();
+    assert(tsc_khz != 0);
 
     // initialize time counter 'ticks' to zero
     ticks = 0;
+    tsc_base = read_tsc();
+    clock_set_event(TICK_US);
 
-    cprintf("++ setup timer interrupts\n");
+    cprintf("++ setup timer interrupts, tsc %u kHz, one-shot\n", tsc_khz);
     pic_enable(IRQ_TIMER);
 }
 
@@ -3,9 +3,20 @@
 
 #include <defs.h>
 
+#define CLOCK_HZ                100                     // ticks per second
+#define TICK_US                 (1000000 / CLOCK_HZ)
+#define CLOCK_MIN_US            20                      // the closest a clock interrupt can be set
+#define CLOCK_MAX_US            54000                   // the farthest, 0xffff counts of the 8253
+
 extern volatile size_t ticks;
+extern uint32_t tsc_khz;
+extern uint64_t clock_event_us;
+extern volatile size_t clock_irq_num;
 
 void clock_init(void);
+uint64_t clock_read_us(void);
+size_t clock_update(void);
+void clock_set_event(uint64_t us);
 
 long SYSTEM_READ_TIMER( void );
 
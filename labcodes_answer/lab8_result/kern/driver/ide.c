@@ -5,6 +5,14 @@
 #include <fs.h>
 #include <ide.h>
 #include <x86.h>
+#include <list.h>
+#include <sync.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <clock.h>
+#include <pmm.h>
+#include <pci.h>
 #include <assert.h>
 
 #define ISA_DATA                0x00
@@ -28,6 +36,8 @@
 #define IDE_CMD_READ            0x20
 #define IDE_CMD_WRITE           0x30
 #define IDE_CMD_IDENTIFY        0xEC
+#define IDE_CMD_READ_DMA        0xC8
+#define IDE_CMD_WRITE_DMA       0xCA
 
 #define IDE_IDENT_SECTORS       20
 #define IDE_IDENT_MODEL         54
@@ -41,6 +51,18 @@
 #define IO_CTRL0                0x3F4
 #define IO_CTRL1                0x374
 
+/* bus master registers of a channel, at BAR4 of the controller (+8 for the second channel) */
+#define BM_COMMAND              0x00
+#define BM_STATUS               0x02
+#define BM_PRDT                 0x04
+
+#define BM_CMD_START            0x01            // start/stop the transfer
+#define BM_CMD_READ             0x08            // bus master writes memory (ATA read)
+#define BM_STATUS_ERR           0x02            // write 1 to clear
+#define BM_STATUS_INTR          0x04            // write 1 to clear
+
+#define IDE_USE_DMA             1               // set to 0 to always use programmed i/o
+
 #define MAX_IDE                 4
 #define MAX_NSECS               128
 #define MAX_DISK_NSECS          0x10000000U
@@ -59,11 +81,84 @@ static const struct {
 
 static struct ide_device {
     unsigned char valid;        // 0 or 1 (If Device Really Exists)
+    unsigned char dma;          // 0 or 1 (If Device Supports DMA)
     unsigned int sets;          // Commend Sets Supported
     unsigned int size;          // Size in Sectors
     unsigned char model[41];    // Model in String
 } ide_devices[MAX_IDE];
 
+/* *
+ * struct ide_request - a read or write of nsecs sectors of one device.
+ * Requests are queued on their channel, sorted by sector, and dispatched by
+ * a C-LOOK elevator with a deadline: the head sweeps towards higher sectors
+ * and jumps back to the lowest pending request at the end, unless the
+ * oldest request has waited longer than IDE_DEADLINE ticks. Pending requests
+ * contiguous with the dispatched one are merged into the same ATA command.
+ * The data of every sector is moved when the device raises its interrupt
+ * (or, when the submitter can not sleep, when the submitter polls the
+ * channel), and the submitter sleeping on wait_queue is woken up once the
+ * command is done.
+ * */
+struct ide_request {
+    unsigned short ideno;       // device of the request
+    bool write;                 // BOOL: Read - 0 or Write - 1
+    uint32_t secno;             // first sector
+    size_t nsecs;               // number of sectors left
+    void *buf;                  // where the next sector is moved from/to
+    bool done;                  // BOOL: the request is finished
+    int error;                  // 0 or -1 if the device reported an error
+    size_t start_tick;          // ticks when submitted, for the deadline
+    uint64_t start_tsc;         // tsc when submitted, for the service latency
+    wait_queue_t wait_queue;    // the submitter waits here
+    list_entry_t queue_link;    // entry in the sorted queue, then in the running command
+    list_entry_t fifo_link;     // entry in the fifo queue
+};
+
+#define le2req(le, member)                      \
+    to_struct((le), struct ide_request, member)
+
+#define IDE_DEADLINE            50              // ticks a request may wait before served out of order
+#define IDE_MAX_CMD_NSECS       MAX_NSECS       // sectors a merged command may cover
+
+/* physical region descriptor, one contiguous piece of memory of a DMA transfer */
+struct ide_prd {
+    uint32_t addr;              // physical address
+    uint16_t count;             // bytes, 0 means 64K
+    uint16_t flags;             // PRD_EOT on the last entry
+};
+
+#define PRD_EOT                 0x8000
+#define PRD_BOUNDARY            0x10000         // an entry can not cross a 64K boundary
+#define IDE_MAX_PRD             (PGSIZE / sizeof(struct ide_prd))
+
+/* request queue of each channel, protected by disabling interrupts */
+static struct ide_queue {
+    list_entry_t queue;             // pending requests sorted by (ideno, secno)
+    list_entry_t fifo;              // pending requests in submission order
+    list_entry_t active;            // requests of the running command
+    struct ide_request *cur;        // request of the running command moving sectors now
+    unsigned short head_ideno;      // where the last command ended, for C-LOOK
+    uint32_t head_secno;
+    size_t depth;                   // number of pending and running requests
+    unsigned short bmbase;          // bus master registers, 0 if DMA is unavailable
+    struct ide_prd *prd;            // PRD table, one page from alloc_page
+    bool dma;                       // BOOL: the running command uses DMA
+} ide_queues[2];
+
+#define IDE_QUEUE(ideno)        (ide_queues + ((ideno) >> 1))
+
+/* counters of the i/o scheduler, shown by ide_print_stat */
+static struct {
+    size_t requests;            // requests submitted
+    size_t commands;            // ATA commands issued
+    size_t merges;              // requests merged into the command of another one
+    size_t expired;             // requests dispatched because of the deadline
+    size_t dma_commands;        // commands transferred by bus master DMA
+    uint64_t depth_sum;         // sum of the queue depth seen by each request
+    uint64_t latency_sum;       // sum of the service latency (tsc cycles)
+    uint64_t latency_max;
+} ide_stat;
+
 static int
 ide_wait_ready(unsigned short iobase, bool check_error) {
     int r;
@@ -75,9 +170,54 @@ ide_wait_ready(unsigned short iobase, bool check_error) {
     return 0;
 }
 
+/* *
+ * ide_dma_init - find the pci ide controller, and if it is a bus master, enable it and
+ * give every channel a PRD table. channels without a bus master keep using PIO.
+ * */
+static void
+ide_dma_init(void) {
+    if (!IDE_USE_DMA) {
+        return;
+    }
+    struct pci_func f;
+    if (!pci_find_class(0x01, 0x01, &f)) {
+        return;
+    }
+    uint32_t class = pci_conf_read(&f, PCI_CLASS_REG);
+    uint32_t bar4 = pci_conf_read(&f, PCI_BAR_REG(4));
+    if (!(PCI_INTERFACE(class) & 0x80) || !(bar4 & 1) || (bar4 & 0xFFFC) == 0) {
+        return;
+    }
+    uint32_t cmd = pci_conf_read(&f, PCI_COMMAND_REG);
+    pci_conf_write(&f, PCI_COMMAND_REG, cmd | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+    int i;
+    for (i = 0; i < 2; i ++) {
+        struct Page *page;
+        if ((page = alloc_page()) == NULL) {
+            break;
+        }
+        ide_queues[i].prd = page2kva(page);
+        ide_queues[i].bmbase = (bar4 & 0xFFFC) + i * 8;
+    }
+    cprintf("ide: bus master dma at 0x%04x (pci %d:%d.%d).\n", bar4 & 0xFFFC, f.bus, f.dev, f.func);
+}
+
 void
 ide_init(void) {
     static_assert((SECTSIZE % 4) == 0);
+    int i;
+    for (i = 0; i < 2; i ++) {
+        struct ide_queue *iq = ide_queues + i;
+        list_init(&(iq->queue));
+        list_init(&(iq->fifo));
+        list_init(&(iq->active));
+        iq->cur = NULL;
+        iq->head_ideno = iq->head_secno = 0;
+        iq->depth = 0;
+        iq->bmbase = 0, iq->prd = NULL, iq->dma = 0;
+    }
+
     unsigned short ideno, iobase;
     for (ideno = 0; ideno < MAX_IDE; ideno ++) {
         /* assume that no device here */
@@ -120,6 +260,7 @@ ide_init(void) {
         }
         ide_devices[ideno].sets = cmdsets;
         ide_devices[ideno].size = sectors;
+        ide_devices[ideno].dma = ((*(unsigned short *)(ident + IDE_IDENT_CAPABILITIES) & 0x100) != 0);
 
         /* check if supports LBA */
         assert((*(unsigned short *)(ident + IDE_IDENT_CAPABILITIES) & 0x200) != 0);
@@ -136,6 +277,8 @@ ide_init(void) {
         cprintf("ide %d: %10u(sectors), '%s'.\n", ideno, ide_devices[ideno].size, ide_devices[ideno].model);
     }
 
+    ide_dma_init();
+
     // enable ide interrupt
     pic_enable(IRQ_IDE1);
     pic_enable(IRQ_IDE2);
@@ -154,14 +297,169 @@ ide_device_size(unsigned short ideno) {
     return 0;
 }
 
-int
-ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
-    assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
-    assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
-    unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+// ide_req_before - if request a is before request b in the sector order
+static inline bool
+ide_req_before(struct ide_request *a, struct ide_request *b) {
+    return a->ideno < b->ideno || (a->ideno == b->ideno && a->secno < b->secno);
+}
+
+// ide_enqueue - add req into the sorted queue and the fifo queue of channel iq, intr must be disabled
+static void
+ide_enqueue(struct ide_queue *iq, struct ide_request *req) {
+    list_entry_t *le = &(iq->queue);
+    while ((le = list_next(le)) != &(iq->queue)) {
+        if (ide_req_before(req, le2req(le, queue_link))) {
+            break;
+        }
+    }
+    list_add_before(le, &(req->queue_link));
+    list_add_before(&(iq->fifo), &(req->fifo_link));
+
+    ide_stat.requests ++;
+    ide_stat.depth_sum += (++ iq->depth);
+}
+
+// ide_pick - choose the request to dispatch next by deadline or C-LOOK order
+static struct ide_request *
+ide_pick(struct ide_queue *iq) {
+    struct ide_request *req = le2req(list_next(&(iq->fifo)), fifo_link);
+    if (ticks - req->start_tick >= IDE_DEADLINE) {
+        ide_stat.expired ++;
+        return req;
+    }
+    list_entry_t *le = &(iq->queue);
+    while ((le = list_next(le)) != &(iq->queue)) {
+        req = le2req(le, queue_link);
+        if (req->ideno > iq->head_ideno ||
+            (req->ideno == iq->head_ideno && req->secno >= iq->head_secno)) {
+            return req;
+        }
+    }
+    // no request beyond the head, jump back to the lowest one
+    return le2req(list_next(&(iq->queue)), queue_link);
+}
+
+// ide_finish - finish all requests of the running command of channel iq and wake up their submitters
+static void
+ide_finish(struct ide_queue *iq, int error) {
+    uint64_t now = read_tsc();
+    list_entry_t *le;
+    while ((le = list_next(&(iq->active))) != &(iq->active)) {
+        list_del_init(le);
+        struct ide_request *req = le2req(le, queue_link);
+        req->error = error;
+        req->done = 1;
+        iq->depth --;
+
+        uint64_t latency = now - req->start_tsc;
+        ide_stat.latency_sum += latency;
+        if (ide_stat.latency_max < latency) {
+            ide_stat.latency_max = latency;
+        }
+        wakeup_queue(&(req->wait_queue), WT_IDE, 1);
+    }
+    iq->cur = NULL;
+    if (current == idleproc) {
+        current->need_resched = 1;
+    }
+}
+
+// ide_sector - return the buffer of the next sector of the running command, and step over it
+static void *
+ide_sector(struct ide_queue *iq) {
+    struct ide_request *req = iq->cur;
+    void *buf = req->buf;
+    req->buf += SECTSIZE;
+    if (-- req->nsecs == 0) {
+        list_entry_t *le = list_next(&(req->queue_link));
+        iq->cur = (le != &(iq->active)) ? le2req(le, queue_link) : NULL;
+    }
+    return buf;
+}
+
+/*
+ * ide_build_prd - describe the buffers of the running command of channel iq in its
+ *                 PRD table, return 0 if they can not be reached by DMA (not in the
+ *                 linear mapped kernel memory, or too many pieces).
+ */
+static bool
+ide_build_prd(struct ide_queue *iq) {
+    struct ide_prd *prd = iq->prd;
+    size_t n = 0;
+    list_entry_t *le = &(iq->active);
+    while ((le = list_next(le)) != &(iq->active)) {
+        struct ide_request *req = le2req(le, queue_link);
+        uintptr_t va = (uintptr_t)req->buf;
+        size_t len = req->nsecs * SECTSIZE;
+        if (va < KERNBASE || va + len > KERNTOP) {
+            return 0;
+        }
+        uintptr_t pa = va - KERNBASE;
+        while (len != 0) {
+            size_t alen = PRD_BOUNDARY - (pa % PRD_BOUNDARY);
+            if (alen > len) {
+                alen = len;
+            }
+            if (n == IDE_MAX_PRD) {
+                return 0;
+            }
+            prd[n].addr = pa, prd[n].count = alen % PRD_BOUNDARY, prd[n].flags = 0;
+            n ++, pa += alen, len -= alen;
+        }
+    }
+    assert(n != 0);
+    prd[n - 1].flags = PRD_EOT;
+    return 1;
+}
+
+// ide_start - dispatch pending requests of channel iq as one command if the channel is idle, intr must be disabled
+static void
+ide_start(struct ide_queue *iq) {
+again:
+    if (!list_empty(&(iq->active)) || list_empty(&(iq->queue))) {
+        return;
+    }
+
+    /* move the picked request and the ones following it on disk into the command */
+    struct ide_request *req = ide_pick(iq), *next;
+    unsigned short ideno = req->ideno;
+    uint32_t secno = req->secno;
+    size_t nsecs = 0;
+    bool write = req->write;
+    while (1) {
+        list_entry_t *le = list_next(&(req->queue_link));
+        list_del(&(req->queue_link));
+        list_del(&(req->fifo_link));
+        list_add_before(&(iq->active), &(req->queue_link));
+        nsecs += req->nsecs;
+        if (le == &(iq->queue)) {
+            break;
+        }
+        next = le2req(le, queue_link);
+        if (next->ideno != ideno || next->write != write || next->secno != secno + nsecs
+            || nsecs + next->nsecs > IDE_MAX_CMD_NSECS) {
+            break;
+        }
+        req = next;
+        ide_stat.merges ++;
+    }
+    ide_stat.commands ++;
+    iq->cur = le2req(list_next(&(iq->active)), queue_link);
+    iq->head_ideno = ideno, iq->head_secno = secno + nsecs;
+
+    unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno), bmbase = iq->bmbase;
 
     ide_wait_ready(iobase, 0);
 
+    uint8_t command = write ? IDE_CMD_WRITE : IDE_CMD_READ;
+    if ((iq->dma = (bmbase != 0 && ide_devices[ideno].dma && ide_build_prd(iq)))) {
+        outl(bmbase + BM_PRDT, PADDR(iq->prd));
+        outb(bmbase + BM_COMMAND, write ? 0 : BM_CMD_READ);
+        outb(bmbase + BM_STATUS, inb(bmbase + BM_STATUS) | BM_STATUS_ERR | BM_STATUS_INTR);
+        command = write ? IDE_CMD_WRITE_DMA : IDE_CMD_READ_DMA;
+        ide_stat.dma_commands ++;
+    }
+
     // generate interrupt
     outb(ioctrl + ISA_CTRL, 0);
     outb(iobase + ISA_SECCNT, nsecs);
@@ -169,46 +467,158 @@ ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
     outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
     outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
     outb(iobase + ISA_SDH, 0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-    outb(iobase + ISA_COMMAND, IDE_CMD_READ);
+    outb(iobase + ISA_COMMAND, command);
 
-    int ret = 0;
-    for (; nsecs > 0; nsecs --, dst += SECTSIZE) {
-        if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-            goto out;
+    if (iq->dma) {
+        /* the device moves all sectors by itself and interrupts once at the end */
+        outb(bmbase + BM_COMMAND, (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+    }
+    else if (write) {
+        /* the first sector is sent at once, then one per interrupt */
+        if (ide_wait_ready(iobase, 1) != 0) {
+            ide_finish(iq, -1);
+            goto again;
         }
-        insl(iobase, dst, SECTSIZE / sizeof(uint32_t));
+        outsl(iobase, ide_sector(iq), SECTSIZE / sizeof(uint32_t));
     }
+}
 
-out:
-    return ret;
+// ide_done - finish the running command of channel iq and start the next one
+static void
+ide_done(struct ide_queue *iq, int error) {
+    ide_finish(iq, error);
+    ide_start(iq);
 }
 
-int
-ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs) {
+/*
+ * ide_service - move the data of the running command of channel iq if the device is
+ *               ready, called by the interrupt handler or by a polling submitter
+ *               (intr must be disabled). reading the status acknowledges the interrupt.
+ */
+static void
+ide_service(struct ide_queue *iq) {
+    while (!list_empty(&(iq->active))) {
+        unsigned short iobase = IO_BASE(le2req(list_next(&(iq->active)), queue_link)->ideno);
+        if (iq->dma) {
+            unsigned short bmbase = iq->bmbase;
+            uint8_t bs = inb(bmbase + BM_STATUS);
+            if (!(bs & (BM_STATUS_INTR | BM_STATUS_ERR))) {
+                return;
+            }
+            outb(bmbase + BM_COMMAND, 0);
+            int r = inb(iobase + ISA_STATUS);
+            outb(bmbase + BM_STATUS, bs | BM_STATUS_ERR | BM_STATUS_INTR);
+            iq->dma = 0;
+            ide_done(iq, ((bs & BM_STATUS_ERR) || (r & (IDE_DF | IDE_ERR))) ? -1 : 0);
+            continue;
+        }
+        int r = inb(iobase + ISA_STATUS);
+        if (r & IDE_BSY) {
+            return;
+        }
+        if (r & (IDE_DF | IDE_ERR)) {
+            ide_done(iq, -1);
+            continue;
+        }
+        if (iq->cur == NULL) {
+            /* all sectors of a write command have been taken by the device */
+            ide_done(iq, 0);
+            continue;
+        }
+        if (!(r & IDE_DRQ)) {
+            return;
+        }
+        if (iq->cur->write) {
+            outsl(iobase, ide_sector(iq), SECTSIZE / sizeof(uint32_t));
+            return;
+        }
+        insl(iobase, ide_sector(iq), SECTSIZE / sizeof(uint32_t));
+        if (iq->cur == NULL) {
+            ide_done(iq, 0);
+            continue;
+        }
+        return;
+    }
+}
+
+/*
+ * ide_intr - the interrupt handler of IRQ_IDE1/IRQ_IDE2
+ */
+void
+ide_intr(int irq) {
+    assert(irq == IRQ_IDE1 || irq == IRQ_IDE2);
+    ide_service(ide_queues + ((irq == IRQ_IDE1) ? 0 : 1));
+}
+
+/*
+ * ide_rw_secs - queue a request and wait until it is done. the submitter sleeps
+ *               while the device works if it can, or polls the channel when it is
+ *               called with interrupts off or by idleproc (e.g. during kern_init).
+ */
+static int
+ide_rw_secs(unsigned short ideno, uint32_t secno, void *buf, size_t nsecs, bool write) {
     assert(nsecs <= MAX_NSECS && VALID_IDE(ideno));
     assert(secno < MAX_DISK_NSECS && secno + nsecs <= MAX_DISK_NSECS);
-    unsigned short iobase = IO_BASE(ideno), ioctrl = IO_CTRL(ideno);
+    if (nsecs == 0) {
+        return 0;
+    }
 
-    ide_wait_ready(iobase, 0);
+    struct ide_queue *iq = IDE_QUEUE(ideno);
+    struct ide_request __req, *req = &__req;
+    req->ideno = ideno, req->write = write;
+    req->secno = secno, req->nsecs = nsecs, req->buf = buf;
+    req->done = 0, req->error = 0;
+    wait_queue_init(&(req->wait_queue));
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        req->start_tick = ticks, req->start_tsc = read_tsc();
+        ide_enqueue(iq, req);
+        ide_start(iq);
+        if (!intr_flag || current == NULL || current == idleproc) {
+            while (!req->done) {
+                ide_service(iq);
+            }
+        }
+        else {
+            while (!req->done) {
+                wait_t __wait, *wait = &__wait;
+                wait_current_set(&(req->wait_queue), wait, WT_IDE);
+                local_intr_restore(intr_flag);
 
-    // generate interrupt
-    outb(ioctrl + ISA_CTRL, 0);
-    outb(iobase + ISA_SECCNT, nsecs);
-    outb(iobase + ISA_SECTOR, secno & 0xFF);
-    outb(iobase + ISA_CYL_LO, (secno >> 8) & 0xFF);
-    outb(iobase + ISA_CYL_HI, (secno >> 16) & 0xFF);
-    outb(iobase + ISA_SDH, 0xE0 | ((ideno & 1) << 4) | ((secno >> 24) & 0xF));
-    outb(iobase + ISA_COMMAND, IDE_CMD_WRITE);
+                schedule();
 
-    int ret = 0;
-    for (; nsecs > 0; nsecs --, src += SECTSIZE) {
-        if ((ret = ide_wait_ready(iobase, 1)) != 0) {
-            goto out;
+                local_intr_save(intr_flag);
+                wait_current_del(&(req->wait_queue), wait);
+            }
         }
-        outsl(iobase, src, SECTSIZE / sizeof(uint32_t));
     }
+    local_intr_restore(intr_flag);
+    return req->error;
+}
+
+int
+ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs) {
+    return ide_rw_secs(ideno, secno, dst, nsecs, 0);
+}
 
-out:
-    return ret;
+int
+ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs) {
+    return ide_rw_secs(ideno, secno, (void *)src, nsecs, 1);
+}
+
+void
+ide_print_stat(void) {
+    size_t requests = ide_stat.requests, done = requests - ide_queues[0].depth - ide_queues[1].depth;
+    cprintf("ide: %u requests, %u commands (%u dma), %u merged, %u expired.\n",
+            requests, ide_stat.commands, ide_stat.dma_commands, ide_stat.merges, ide_stat.expired);
+    if (requests != 0 && done != 0) {
+        uint64_t depth = ide_stat.depth_sum, latency = ide_stat.latency_sum;
+        do_div(depth, requests);
+        do_div(latency, done);
+        cprintf("ide: avg queue depth %u, latency avg %llu max %llu (tsc cycles).\n",
+                (size_t)depth, latency, ide_stat.latency_max);
+    }
 }
 
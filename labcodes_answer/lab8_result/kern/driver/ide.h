@@ -6,6 +6,8 @@
 void ide_init(void);
 bool ide_device_valid(unsigned short ideno);
 size_t ide_device_size(unsigned short ideno);
+void ide_intr(int irq);
+void ide_print_stat(void);
 
 int ide_read_secs(unsigned short ideno, uint32_t secno, void *dst, size_t nsecs);
 int ide_write_secs(unsigned short ideno, uint32_t secno, const void *src, size_t nsecs);
@@ -0,0 +1,54 @@
+#include <defs.h>
+#include <x86.h>
+#include <pci.h>
+
+/* *
+ * Minimal PCI configuration space access through configuration mechanism #1,
+ * enough to find a controller on bus 0 and read/write its registers.
+ * */
+
+#define PCI_CONF_ADDR           0xCF8
+#define PCI_CONF_DATA           0xCFC
+
+#define PCI_MAX_DEV             32
+#define PCI_MAX_FUNC            8
+
+static void
+pci_conf_select(struct pci_func *f, uint32_t off) {
+    uint32_t v = (1 << 31) | (f->bus << 16) | (f->dev << 11) | (f->func << 8) | (off & 0xFC);
+    outl(PCI_CONF_ADDR, v);
+}
+
+uint32_t
+pci_conf_read(struct pci_func *f, uint32_t off) {
+    pci_conf_select(f, off);
+    return inl(PCI_CONF_DATA);
+}
+
+void
+pci_conf_write(struct pci_func *f, uint32_t off, uint32_t v) {
+    pci_conf_select(f, off);
+    outl(PCI_CONF_DATA, v);
+}
+
+/* *
+ * pci_find_class - find the first function of the given class/subclass on bus 0
+ * @f:  store the function found
+ * */
+bool
+pci_find_class(uint8_t class, uint8_t subclass, struct pci_func *f) {
+    f->bus = 0;
+    for (f->dev = 0; f->dev < PCI_MAX_DEV; f->dev ++) {
+        for (f->func = 0; f->func < PCI_MAX_FUNC; f->func ++) {
+            if ((pci_conf_read(f, PCI_ID_REG) & 0xFFFF) == PCI_VENDOR_NONE) {
+                continue;
+            }
+            uint32_t c = pci_conf_read(f, PCI_CLASS_REG);
+            if (PCI_CLASS(c) == class && PCI_SUBCLASS(c) == subclass) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
@@ -0,0 +1,33 @@
+#ifndef __KERN_DRIVER_PCI_H__
+#define __KERN_DRIVER_PCI_H__
+
+#include <defs.h>
+
+/* configuration space registers */
+#define PCI_ID_REG              0x00            // device id << 16 | vendor id
+#define PCI_COMMAND_REG         0x04            // status << 16 | command
+#define PCI_CLASS_REG           0x08            // class << 24 | subclass << 16 | interface << 8 | revision
+#define PCI_BAR_REG(n)          (0x10 + (n) * 4)
+
+#define PCI_COMMAND_IO          0x0001          // respond to i/o space accesses
+#define PCI_COMMAND_MASTER      0x0004          // enable bus mastering
+
+#define PCI_CLASS(x)            (((x) >> 24) & 0xFF)
+#define PCI_SUBCLASS(x)         (((x) >> 16) & 0xFF)
+#define PCI_INTERFACE(x)        (((x) >> 8) & 0xFF)
+
+#define PCI_VENDOR_NONE         0xFFFF
+
+/* a function on the pci bus */
+struct pci_func {
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+};
+
+uint32_t pci_conf_read(struct pci_func *f, uint32_t off);
+void pci_conf_write(struct pci_func *f, uint32_t off, uint32_t v);
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_func *f);
+
+#endif /* !__KERN_DRIVER_PCI_H__ */
+
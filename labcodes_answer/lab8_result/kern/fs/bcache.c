@@ -0,0 +1,319 @@
+#include <defs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <list.h>
+#include <sync.h>
+#include <sem.h>
+#include <pmm.h>
+#include <kmalloc.h>
+#include <dev.h>
+#include <iobuf.h>
+#include <clock.h>
+#include <proc.h>
+#include <bcache.h>
+#include <assert.h>
+
+/* *
+ * Block buffer cache
+ *
+ * All block I/O of SFS goes through a fixed pool of BCACHE_NBUF buffers, so
+ * hot blocks (inodes, directory entries, indirect blocks, freemap) stay in
+ * memory. The pool is allocated once in bcache_init and never grows, so the
+ * number of free pages does not depend on how much of the cache is in use.
+ *
+ * Writes are delayed: bdwrite only marks a buffer dirty, and the kernel
+ * thread bflushd writes dirty buffers back once they are older than
+ * BFLUSH_AGE, or all of them once more than BFLUSH_DIRTY_HIGH are dirty.
+ * bcache_sync forces dirty buffers to disk (used by fsync and sync).
+ *
+ * The hash table, the lru list and nr_dirty are protected by disabling
+ * interrupts, the content of a buffer by its b_sem.
+ * */
+
+static struct buf *buf_array;
+static list_entry_t hash_list[BCACHE_HASH_SIZE];
+static list_entry_t lru_list;
+
+static size_t nr_dirty;
+static size_t bcache_hits, bcache_misses, bcache_writes;
+
+static struct proc_struct *bflushd_proc;
+static timer_t bflushd_timer;
+
+#define buf_hashfn(dev, blkno)      (hash32((uintptr_t)(dev) ^ (blkno), BCACHE_HASH_SHIFT))
+
+// bcache_lookup - find the buffer of (dev, blkno) in hash table, intr must be disabled
+static struct buf *
+bcache_lookup(struct device *dev, uint32_t blkno) {
+    list_entry_t *list = hash_list + buf_hashfn(dev, blkno), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct buf *bp = le2buf(le, hash_link);
+        if (bp->b_dev == dev && bp->b_blkno == blkno) {
+            return bp;
+        }
+    }
+    return NULL;
+}
+
+// bcache_victim - find the least recently used buffer nobody holds, intr must be disabled
+static struct buf *
+bcache_victim(void) {
+    list_entry_t *le = &lru_list;
+    while ((le = list_next(le)) != &lru_list) {
+        struct buf *bp = le2buf(le, lru_link);
+        if (bp->b_ref == 0) {
+            return bp;
+        }
+    }
+    return NULL;
+}
+
+// buf_rw - read/write the content of bp from/to its device, b_sem must be held
+static int
+buf_rw(struct buf *bp, bool write) {
+    struct iobuf __iob, *iob = iobuf_init(&__iob, bp->b_data, BCACHE_BLKSIZE, bp->b_blkno * BCACHE_BLKSIZE);
+    return dop_io(bp->b_dev, iob, write);
+}
+
+/*
+ * bget - get the locked buffer of block (dev, blkno) with a reference on it.
+ *        the content is not read in, check B_VALID or use bread instead.
+ *        used directly when the whole block is going to be overwritten.
+ */
+struct buf *
+bget(struct device *dev, uint32_t blkno) {
+    assert(dev->d_blocksize == BCACHE_BLKSIZE);
+    struct buf *bp;
+    bool intr_flag;
+
+again:
+    local_intr_save(intr_flag);
+    {
+        if ((bp = bcache_lookup(dev, blkno)) != NULL) {
+            bp->b_ref ++;
+            bcache_hits ++;
+            goto out;
+        }
+        if ((bp = bcache_victim()) == NULL) {
+            panic("bcache: no buffers.\n");
+        }
+        bp->b_ref ++;
+        if (bp->b_flags & B_DIRTY) {
+            /* write back the old content before reusing the buffer */
+            local_intr_restore(intr_flag);
+            down(&(bp->b_sem));
+            if (bp->b_flags & B_DIRTY) {
+                bwrite(bp);
+            }
+            brelse(bp);
+            goto again;
+        }
+        list_del(&(bp->hash_link));
+        bp->b_dev = dev, bp->b_blkno = blkno, bp->b_flags = 0;
+        list_add(hash_list + buf_hashfn(dev, blkno), &(bp->hash_link));
+        bcache_misses ++;
+    }
+out:
+    local_intr_restore(intr_flag);
+    down(&(bp->b_sem));
+    return bp;
+}
+
+/*
+ * bread - get the locked buffer of block (dev, blkno) holding the content of the block
+ * @bp_store: store the buffer, release it by brelse
+ */
+int
+bread(struct device *dev, uint32_t blkno, struct buf **bp_store) {
+    int ret;
+    struct buf *bp = bget(dev, blkno);
+    if (!(bp->b_flags & B_VALID)) {
+        if ((ret = buf_rw(bp, 0)) != 0) {
+            brelse(bp);
+            return ret;
+        }
+        bp->b_flags |= B_VALID;
+    }
+    *bp_store = bp;
+    return 0;
+}
+
+/*
+ * bwrite - write the content of a locked buffer to disk
+ */
+int
+bwrite(struct buf *bp) {
+    assert(bp->b_ref > 0);
+    int ret;
+    if ((ret = buf_rw(bp, 1)) == 0) {
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        {
+            if (bp->b_flags & B_DIRTY) {
+                nr_dirty --;
+            }
+            bp->b_flags = (bp->b_flags | B_VALID) & ~B_DIRTY;
+            bcache_writes ++;
+        }
+        local_intr_restore(intr_flag);
+    }
+    return ret;
+}
+
+// bflushd_wakeup - wake up bflushd before its timer expires, intr must be disabled
+static void
+bflushd_wakeup(void) {
+    struct proc_struct *proc = bflushd_proc;
+    if (proc != NULL && proc->state == PROC_SLEEPING && proc->wait_state == WT_TIMER) {
+        del_timer(&bflushd_timer);
+        wakeup_proc(proc);
+    }
+}
+
+/*
+ * bdwrite - delayed write, mark the content of a locked buffer as modified,
+ *           it will be written back by bflushd or bcache_sync
+ */
+void
+bdwrite(struct buf *bp) {
+    assert(bp->b_ref > 0);
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (!(bp->b_flags & B_DIRTY)) {
+            bp->b_flags |= B_DIRTY;
+            bp->b_dirty_time = ticks;
+            if (++ nr_dirty >= BFLUSH_DIRTY_HIGH) {
+                bflushd_wakeup();
+            }
+        }
+        bp->b_flags |= B_VALID;
+    }
+    local_intr_restore(intr_flag);
+}
+
+/*
+ * brelse - unlock the buffer and drop the reference got by bread/bget
+ */
+void
+brelse(struct buf *bp) {
+    assert(bp->b_ref > 0);
+    up(&(bp->b_sem));
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (-- bp->b_ref == 0) {
+            list_del(&(bp->lru_link));
+            list_add_before(&lru_list, &(bp->lru_link));
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+/*
+ * bcache_writeback - write dirty buffers of dev (or all devices if dev == NULL)
+ *                    which have been dirty for at least age ticks to disk
+ */
+static int
+bcache_writeback(struct device *dev, size_t age) {
+    int i, ret = 0;
+    for (i = 0; i < BCACHE_NBUF; i ++) {
+        struct buf *bp = buf_array + i;
+        if (!(bp->b_flags & B_DIRTY) || (dev != NULL && bp->b_dev != dev)
+            || ticks - bp->b_dirty_time < age) {
+            continue;
+        }
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        bp->b_ref ++;
+        local_intr_restore(intr_flag);
+
+        down(&(bp->b_sem));
+        /* the buffer may be reused by another block while we were waiting */
+        if ((bp->b_flags & B_DIRTY) && (dev == NULL || bp->b_dev == dev)) {
+            int err;
+            if ((err = bwrite(bp)) != 0) {
+                ret = err;
+            }
+        }
+        brelse(bp);
+    }
+    return ret;
+}
+
+/*
+ * bcache_sync - write all dirty buffers of dev (or all devices if dev == NULL) to disk
+ */
+int
+bcache_sync(struct device *dev) {
+    return bcache_writeback(dev, 0);
+}
+
+/*
+ * bflushd - the kernel thread writing dirty buffers back periodically,
+ *           or at once when too many buffers are dirty
+ */
+static int
+bflushd(void *arg) {
+    while (1) {
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        {
+            timer_init(&bflushd_timer, current, BFLUSH_INTERVAL);
+            current->state = PROC_SLEEPING;
+            current->wait_state = WT_TIMER;
+            add_timer(&bflushd_timer);
+        }
+        local_intr_restore(intr_flag);
+
+        schedule();
+        del_timer(&bflushd_timer);
+
+        int ret;
+        size_t age = (nr_dirty >= BFLUSH_DIRTY_HIGH) ? 0 : BFLUSH_AGE;
+        if ((ret = bcache_writeback(NULL, age)) != 0) {
+            warn("bflushd: write back failed: %e.\n", ret);
+        }
+    }
+    return 0;
+}
+
+void
+bcache_print_stat(void) {
+    cprintf("bcache: %d buffers, hit %d, miss %d, write %d, dirty %d.\n",
+            BCACHE_NBUF, bcache_hits, bcache_misses, bcache_writes, nr_dirty);
+}
+
+void
+bcache_init(void) {
+    static_assert(BCACHE_BLKSIZE == PGSIZE);
+    int i;
+    for (i = 0; i < BCACHE_HASH_SIZE; i ++) {
+        list_init(hash_list + i);
+    }
+    list_init(&lru_list);
+    if ((buf_array = kmalloc(sizeof(struct buf) * BCACHE_NBUF)) == NULL) {
+        panic("bcache: alloc buf_array failed.\n");
+    }
+    for (i = 0; i < BCACHE_NBUF; i ++) {
+        struct buf *bp = buf_array + i;
+        struct Page *page;
+        if ((page = alloc_page()) == NULL) {
+            panic("bcache: alloc buffer page failed.\n");
+        }
+        bp->b_dev = NULL, bp->b_blkno = 0, bp->b_flags = 0, bp->b_ref = 0, bp->b_dirty_time = 0;
+        bp->b_data = page2kva(page);
+        sem_init(&(bp->b_sem), 1);
+        list_init(&(bp->hash_link));
+        list_add_before(&lru_list, &(bp->lru_link));
+    }
+
+    int pid;
+    if ((pid = kernel_daemon(bflushd, NULL, "bflushd")) <= 0) {
+        panic("bcache: create bflushd failed.\n");
+    }
+    bflushd_proc = find_proc(pid);
+    cprintf("bcache_init() succeeded, %d buffers.\n", BCACHE_NBUF);
+}
+
@@ -0,0 +1,56 @@
+#ifndef __KERN_FS_BCACHE_H__
+#define __KERN_FS_BCACHE_H__
+
+#include <defs.h>
+#include <mmu.h>
+#include <list.h>
+#include <sem.h>
+
+struct device;
+
+#define BCACHE_BLKSIZE              PGSIZE          // size of a cached block
+#define BCACHE_NBUF                 128             // number of buffers in the cache
+#define BCACHE_HASH_SHIFT           6
+#define BCACHE_HASH_SIZE            (1 << BCACHE_HASH_SHIFT)
+
+/* write-back policy of bflushd, in timer ticks (100 per second) */
+#define BFLUSH_INTERVAL             100             // bflushd wakes up once per interval
+#define BFLUSH_AGE                  300             // dirty buffers older than this are written back
+#define BFLUSH_DIRTY_HIGH           (BCACHE_NBUF / 4) // beyond this many dirty buffers, flush all at once
+
+/* *
+ * struct buf - buffer head, describes one cached block of a block device.
+ * A buffer is indexed by (b_dev, b_blkno) in the hash table and sits on the
+ * lru list all the time; buffers nobody holds (b_ref == 0) are recycled
+ * starting from the least recently released one. b_sem protects b_data and
+ * b_flags and is held between bread/bget and brelse.
+ * */
+struct buf {
+    struct device *b_dev;           // device the block belongs to
+    uint32_t b_blkno;               // the NO. of the block on b_dev
+    uint32_t b_flags;               // B_VALID, B_DIRTY
+    int b_ref;                      // number of holders, protected by intr off
+    size_t b_dirty_time;            // ticks when the buffer became dirty
+    void *b_data;                   // block content, BCACHE_BLKSIZE bytes
+    semaphore_t b_sem;              // sleep lock for b_data
+    list_entry_t hash_link;         // entry in bcache hash list
+    list_entry_t lru_link;          // entry in bcache lru list
+};
+
+#define B_VALID                     0x1             // b_data holds the content of the block
+#define B_DIRTY                     0x2             // b_data is newer than the block on disk
+
+#define le2buf(le, member)                          \
+    to_struct((le), struct buf, member)
+
+void bcache_init(void);
+int bread(struct device *dev, uint32_t blkno, struct buf **bp_store);
+struct buf *bget(struct device *dev, uint32_t blkno);
+int bwrite(struct buf *bp);
+void bdwrite(struct buf *bp);
+void brelse(struct buf *bp);
+int bcache_sync(struct device *dev);
+void bcache_print_stat(void);
+
+#endif /* !__KERN_FS_BCACHE_H__ */
+
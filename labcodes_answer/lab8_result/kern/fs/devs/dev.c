@@ -153,6 +153,7 @@ dev_init(void) {
    // init_device(null);
     init_device(stdin);
     init_device(stdout);
+    init_device(meminfo);
     init_device(disk0);
 }
 /* dev_create_inode - Create inode for a vfs-level device. */
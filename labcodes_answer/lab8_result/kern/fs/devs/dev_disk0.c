@@ -11,22 +11,9 @@
 #include <assert.h>
 
 #define DISK0_BLKSIZE                   PGSIZE
-#define DISK0_BUFSIZE                   (4 * DISK0_BLKSIZE)
+#define DISK0_MAX_NBLKS                 4       // blocks per ide request
 #define DISK0_BLK_NSECT                 (DISK0_BLKSIZE / SECTSIZE)
 
-static char *disk0_buffer;
-static semaphore_t disk0_sem;
-
-static void
-lock_disk0(void) {
-    down(&(disk0_sem));
-}
-
-static void
-unlock_disk0(void) {
-    up(&(disk0_sem));
-}
-
 static int
 disk0_open(struct device *dev, uint32_t open_flags) {
     return 0;
@@ -38,20 +25,20 @@ disk0_close(struct device *dev) {
 }
 
 static void
-disk0_read_blks_nolock(uint32_t blkno, uint32_t nblks) {
+disk0_read_blks_nolock(uint32_t blkno, uint32_t nblks, void *buf) {
     int ret;
     uint32_t sectno = blkno * DISK0_BLK_NSECT, nsecs = nblks * DISK0_BLK_NSECT;
-    if ((ret = ide_read_secs(DISK0_DEV_NO, sectno, disk0_buffer, nsecs)) != 0) {
+    if ((ret = ide_read_secs(DISK0_DEV_NO, sectno, buf, nsecs)) != 0) {
         panic("disk0: read blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
                 blkno, sectno, nblks, nsecs, ret);
     }
 }
 
 static void
-disk0_write_blks_nolock(uint32_t blkno, uint32_t nblks) {
+disk0_write_blks_nolock(uint32_t blkno, uint32_t nblks, void *buf) {
     int ret;
     uint32_t sectno = blkno * DISK0_BLK_NSECT, nsecs = nblks * DISK0_BLK_NSECT;
-    if ((ret = ide_write_secs(DISK0_DEV_NO, sectno, disk0_buffer, nsecs)) != 0) {
+    if ((ret = ide_write_secs(DISK0_DEV_NO, sectno, buf, nsecs)) != 0) {
         panic("disk0: write blkno = %d (sectno = %d), nblks = %d (nsecs = %d): 0x%08x.\n",
                 blkno, sectno, nblks, nsecs, ret);
     }
@@ -79,27 +66,26 @@ disk0_io(struct device *dev, struct iobuf *iob, bool write) {
         return 0;
     }
 
-    lock_disk0();
+    /* *
+     * the buffer of iob is always in kernel memory (the block cache or a kmalloc'ed
+     * buffer of sysfile), so the ide requests move data into it directly, and the
+     * requests of concurrent callers are merged and sorted by the ide queue.
+     * */
     while (resid != 0) {
-        size_t copied, alen = DISK0_BUFSIZE;
+        size_t alen = DISK0_MAX_NBLKS * DISK0_BLKSIZE;
+        if (alen > resid) {
+            alen = resid;
+        }
+        nblks = alen / DISK0_BLKSIZE;
         if (write) {
-            iobuf_move(iob, disk0_buffer, alen, 0, &copied);
-            assert(copied != 0 && copied <= resid && copied % DISK0_BLKSIZE == 0);
-            nblks = copied / DISK0_BLKSIZE;
-            disk0_write_blks_nolock(blkno, nblks);
+            disk0_write_blks_nolock(blkno, nblks, iob->io_base);
         }
         else {
-            if (alen > resid) {
-                alen = resid;
-            }
-            nblks = alen / DISK0_BLKSIZE;
-            disk0_read_blks_nolock(blkno, nblks);
-            iobuf_move(iob, disk0_buffer, alen, 1, &copied);
-            assert(copied == alen && copied % DISK0_BLKSIZE == 0);
+            disk0_read_blks_nolock(blkno, nblks, iob->io_base);
         }
-        resid -= copied, blkno += nblks;
+        iobuf_skip(iob, alen);
+        resid -= alen, blkno += nblks;
     }
-    unlock_disk0();
     return 0;
 }
 
@@ -120,12 +106,6 @@ disk0_device_init(struct device *dev) {
     dev->d_close = disk0_close;
     dev->d_io = disk0_io;
     dev->d_ioctl = disk0_ioctl;
-    sem_init(&(disk0_sem), 1);
-
-    static_assert(DISK0_BUFSIZE % DISK0_BLKSIZE == 0);
-    if ((disk0_buffer = kmalloc(DISK0_BUFSIZE)) == NULL) {
-        panic("disk0 alloc buffer failed.\n");
-    }
 }
 
 void
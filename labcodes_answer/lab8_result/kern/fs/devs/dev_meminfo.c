@@ -0,0 +1,78 @@
+#include <defs.h>
+#include <stdio.h>
+#include <pmm.h>
+#include <kmalloc.h>
+#include <dev.h>
+#include <vfs.h>
+#include <iobuf.h>
+#include <inode.h>
+#include <unistd.h>
+#include <error.h>
+#include <assert.h>
+
+/*
+ * meminfo: - a read-only device holding the text of pmm_format_stat, the free
+ * block histogram and fragmentation of physical memory. The text is made again
+ * on every read, so reading it from the start gives the state at that time.
+ */
+
+static int
+meminfo_open(struct device *dev, uint32_t open_flags) {
+    if (open_flags != O_RDONLY) {
+        return -E_INVAL;
+    }
+    return 0;
+}
+
+static int
+meminfo_close(struct device *dev) {
+    return 0;
+}
+
+static int
+meminfo_io(struct device *dev, struct iobuf *iob, bool write) {
+    if (write) {
+        return -E_INVAL;
+    }
+    char *buf;
+    if ((buf = kmalloc(PMM_STAT_BUFSIZE)) == NULL) {
+        return -E_NO_MEM;
+    }
+    size_t len = pmm_format_stat(buf, PMM_STAT_BUFSIZE);
+    if (iob->io_offset < len) {
+        /* a short read is not an error, the rest is read from the next offset */
+        iobuf_move(iob, buf + iob->io_offset, len - iob->io_offset, 1, NULL);
+    }
+    kfree(buf);
+    return 0;
+}
+
+static int
+meminfo_ioctl(struct device *dev, int op, void *data) {
+    return -E_INVAL;
+}
+
+static void
+meminfo_device_init(struct device *dev) {
+    dev->d_blocks = 0;
+    dev->d_blocksize = 1;
+    dev->d_open = meminfo_open;
+    dev->d_close = meminfo_close;
+    dev->d_io = meminfo_io;
+    dev->d_ioctl = meminfo_ioctl;
+}
+
+void
+dev_init_meminfo(void) {
+    struct inode *node;
+    if ((node = dev_create_inode()) == NULL) {
+        panic("meminfo: dev_create_node.\n");
+    }
+    meminfo_device_init(vop_info(node, device));
+
+    int ret;
+    if ((ret = vfs_add_dev("meminfo", node, 0)) != 0) {
+        panic("meminfo: vfs_add_dev: %e.\n", ret);
+    }
+}
+
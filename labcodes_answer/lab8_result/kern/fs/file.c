@@ -9,6 +9,7 @@
 #include <stat.h>
 #include <dirent.h>
 #include <error.h>
+#include <pcache.h>
 #include <assert.h>
 
 #define testfd(fd)                          ((fd) >= 0 && (fd) < FILES_STRUCT_NENTRY)
@@ -188,6 +189,9 @@ file_open(char *path, uint32_t open_flags) {
         }
         file->pos = stat->st_size;
     }
+    if (open_flags & O_TRUNC) {
+        pcache_invalidate(node, 0, (size_t)-1);
+    }
 
     file->node = node;
     file->readable = readable;
@@ -252,6 +256,7 @@ file_write(int fd, void *base, size_t len, size_t *copied_store) {
     ret = vop_write(file->node, iob);
 
     size_t copied = iobuf_used(iob);
+    pcache_invalidate(file->node, file->pos, copied);
     if (file->status == FD_OPENED) {
         file->pos += copied;
     }
@@ -306,6 +311,18 @@ file_fstat(int fd, struct stat *stat) {
     return ret;
 }
 
+// get the inode of file, valid as long as fd is open
+int
+file_node(int fd, struct inode **node_store) {
+    int ret;
+    struct file *file;
+    if ((ret = fd2file(fd, &file)) != 0) {
+        return ret;
+    }
+    *node_store = file->node;
+    return 0;
+}
+
 // sync file
 int
 file_fsync(int fd) {
@@ -1,17 +1,22 @@
 #include <defs.h>
 #include <kmalloc.h>
+#include <slab.h>
 #include <sem.h>
 #include <vfs.h>
 #include <dev.h>
 #include <file.h>
 #include <sfs.h>
 #include <inode.h>
+#include <bcache.h>
+#include <pcache.h>
 #include <assert.h>
 //called when init_main proc start
 void
 fs_init(void) {
     vfs_init();
     dev_init();
+    bcache_init();
+    pcache_init();
     sfs_init();
 }
 
@@ -29,18 +34,35 @@ void
 unlock_files(struct files_struct *filesp) {
     up(&(filesp->files_sem));
 }
+static kmem_cache_t *files_cachep;
+
+// files_ctor - constructor of files_cachep, files_destroy leaves all struct file as FD_NONE again
+static void
+files_ctor(void *objp) {
+    struct files_struct *filesp = objp;
+    filesp->fd_array = (void *)(filesp + 1);
+    sem_init(&(filesp->files_sem), 1);
+    fd_array_init(filesp->fd_array);
+}
+
+//Called before the first files_create (idleproc is created before fs_init)
+void
+files_init(void) {
+    static_assert((int)FILES_STRUCT_NENTRY > 128);
+    if ((files_cachep = kmem_cache_create("files_struct", sizeof(struct files_struct) + FILES_STRUCT_BUFSIZE,
+                                          files_ctor)) == NULL) {
+        panic("fs: create files_struct cache failed.\n");
+    }
+}
+
 //Called when a new proc init
 struct files_struct *
 files_create(void) {
     //cprintf("[files_create]\n");
-    static_assert((int)FILES_STRUCT_NENTRY > 128);
     struct files_struct *filesp;
-    if ((filesp = kmalloc(sizeof(struct files_struct) + FILES_STRUCT_BUFSIZE)) != NULL) {
+    if ((filesp = kmem_cache_alloc(files_cachep)) != NULL) {
         filesp->pwd = NULL;
-        filesp->fd_array = (void *)(filesp + 1);
         filesp->files_count = 0;
-        sem_init(&(filesp->files_sem), 1);
-        fd_array_init(filesp->fd_array);
     }
     return filesp;
 }
@@ -60,18 +82,24 @@ files_destroy(struct files_struct *filesp) {
         }
         assert(file->status == FD_NONE);
     }
-    kfree(filesp);
+    kmem_cache_free(files_cachep, filesp);
 }
 
 void
 files_closeall(struct files_struct *filesp) {
+    files_closeall_except(filesp, NO_FD);
+}
+
+// files_closeall_except - close all files but stdin, stdout and the file of fd
+void
+files_closeall_except(struct files_struct *filesp, int fd) {
 //    cprintf("[files_closeall]\n");
     assert(filesp != NULL && files_count(filesp) > 0);
     int i;
     struct file *file = filesp->fd_array;
     //skip the stdin & stdout
     for (i = 2, file += 2; i < FILES_STRUCT_NENTRY; i ++, file ++) {
-        if (file->status == FD_OPENED) {
+        if (file->status == FD_OPENED && i != fd) {
             fd_array_close(file);
         }
     }
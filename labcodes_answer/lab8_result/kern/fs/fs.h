@@ -35,9 +35,11 @@ struct files_struct {
 void lock_files(struct files_struct *filesp);
 void unlock_files(struct files_struct *filesp);
 
+void files_init(void);
 struct files_struct *files_create(void);
 void files_destroy(struct files_struct *filesp);
 void files_closeall(struct files_struct *filesp);
+void files_closeall_except(struct files_struct *filesp, int fd);
 int dup_files(struct files_struct *to, struct files_struct *from);
 
 static inline int
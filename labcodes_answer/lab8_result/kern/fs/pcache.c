@@ -0,0 +1,357 @@
+#include <defs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <list.h>
+#include <sync.h>
+#include <pmm.h>
+#include <kmalloc.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <pcache.h>
+#include <wait.h>
+#include <proc.h>
+#include <sched.h>
+#include <error.h>
+#include <assert.h>
+
+/* *
+ * Page cache for mapped files
+ *
+ * Read-only file-backed vmas (the text of user programs, see load_icode and
+ * do_pgfault) map the pages of this cache instead of reading a private copy,
+ * so every process running the same program shares one copy of its text,
+ * and a program launched again finds its text already in memory.
+ *
+ * Pages are indexed by (inode, page number in the file). Like the buffer
+ * cache, the cache is a fixed pool of PCACHE_NPAGES pages allocated once in
+ * pcache_init; a slot is recycled only when no address space maps its page
+ * any more (page_ref == 1). When no slot can be recycled, pcache_get fails
+ * and the caller falls back to a private copy.
+ *
+ * A slot holds a reference on its inode, so the pages stay cached after the
+ * last process running the program exits and its file is closed: the inode
+ * is released when the slot is recycled for another page, or by
+ * pcache_shrink, which vfs_unmount calls so the inodes of the file system
+ * can go. Writes through the file interface refresh cached pages by
+ * pcache_invalidate.
+ *
+ * The hash table and the lru list are protected by disabling interrupts.
+ * */
+
+static struct pcache_entry *pce_array;
+static list_entry_t hash_list[PCACHE_HASH_SIZE];
+static list_entry_t lru_list;
+
+static size_t pcache_hits, pcache_misses, pcache_bypass;
+
+// the processes waiting for a page being read in
+static wait_queue_t pcache_wait_queue;
+
+#define pce_hashfn(node, index)     (hash32((uintptr_t)(node) ^ (index), PCACHE_HASH_SHIFT))
+
+// pcache_lookup - find the slot of (node, index) in hash table, intr must be disabled
+static struct pcache_entry *
+pcache_lookup(struct inode *node, uint32_t index) {
+    list_entry_t *list = hash_list + pce_hashfn(node, index), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct pcache_entry *pce = le2pce(le, hash_link);
+        if (pce->pc_node == node && pce->pc_index == index) {
+            return pce;
+        }
+    }
+    return NULL;
+}
+
+// pcache_victim - find the least recently used slot nobody maps, intr must be disabled
+static struct pcache_entry *
+pcache_victim(void) {
+    list_entry_t *le = &lru_list;
+    while ((le = list_next(le)) != &lru_list) {
+        struct pcache_entry *pce = le2pce(le, lru_link);
+        if (!pce->pc_busy && page_ref(pce->pc_page) == 1) {
+            return pce;
+        }
+    }
+    return NULL;
+}
+
+// pcache_touch - move pce to the tail of lru list, intr must be disabled
+static void
+pcache_touch(struct pcache_entry *pce) {
+    list_del(&(pce->lru_link));
+    list_add_before(&lru_list, &(pce->lru_link));
+}
+
+// pcache_drop - remove pce from hash table, intr must be disabled.
+//             - return its inode, the caller releases it by vop_ref_dec with intr enabled
+static struct inode *
+pcache_drop(struct pcache_entry *pce) {
+    struct inode *node = pce->pc_node;
+    list_del_init(&(pce->hash_link));
+    pce->pc_node = NULL;
+    return node;
+}
+
+// pcache_unbusy - the content of pce is there, wake up those waiting for it, intr must be disabled
+static void
+pcache_unbusy(struct pcache_entry *pce) {
+    pce->pc_busy = 0;
+    if (!wait_queue_empty(&pcache_wait_queue)) {
+        wakeup_queue(&pcache_wait_queue, WT_PCACHE, 1);
+    }
+}
+
+// pcache_read - read page number index of node into page, the part beyond EOF is zeroed
+static int
+pcache_read(struct inode *node, uint32_t index, struct Page *page) {
+    void *kva = page2kva(page);
+    memset(kva, 0, PGSIZE);
+    struct iobuf __iob, *iob = iobuf_init(&__iob, kva, PGSIZE, index * PGSIZE);
+    return vop_read(node, iob);
+}
+
+/*
+ * pcache_find - get the cached page of (node, index) without reading it in,
+ *               return NULL if it is not in the cache.
+ *               the caller must map the page before it may sleep.
+ */
+struct Page *
+pcache_find(struct inode *node, uint32_t index) {
+    struct pcache_entry *pce;
+    struct Page *page = NULL;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if ((pce = pcache_lookup(node, index)) != NULL && !pce->pc_busy) {
+            page = pce->pc_page;
+            pcache_touch(pce);
+            pcache_hits ++;
+        }
+    }
+    local_intr_restore(intr_flag);
+    return page;
+}
+
+// __pcache_get - get the cached page of (node, index) in *page_store, read it in on a miss.
+//              - if the page is being read by another process, wait for it if wait is
+//              - set, else return -E_BUSY. return -E_NO_MEM if no slot can be recycled,
+//              - or the error of reading the file.
+static int
+__pcache_get(struct inode *node, uint32_t index, bool wait, struct Page **page_store) {
+    struct pcache_entry *pce;
+    struct inode *old_node = NULL;
+    int ret;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    while ((pce = pcache_lookup(node, index)) != NULL && pce->pc_busy) {
+        if (!wait) {
+            pcache_bypass ++;
+            ret = -E_BUSY;
+            goto out;
+        }
+        wait_t __wait, *w = &__wait;
+        wait_current_set(&pcache_wait_queue, w, WT_PCACHE);
+        local_intr_restore(intr_flag);
+
+        schedule();
+
+        local_intr_save(intr_flag);
+        wait_current_del(&pcache_wait_queue, w);
+    }
+    if (pce != NULL) {
+        *page_store = pce->pc_page;
+        pcache_touch(pce);
+        pcache_hits ++;
+        ret = 0;
+        goto out;
+    }
+    if ((pce = pcache_victim()) == NULL) {
+        pcache_bypass ++;
+        ret = -E_NO_MEM;
+        goto out;
+    }
+    pcache_misses ++;
+    old_node = pcache_drop(pce);
+    vop_ref_inc(node);
+    pce->pc_node = node, pce->pc_index = index, pce->pc_busy = 1;
+    list_add(hash_list + pce_hashfn(node, index), &(pce->hash_link));
+    local_intr_restore(intr_flag);
+
+    if (old_node != NULL) {
+        vop_ref_dec(old_node);
+    }
+
+    ret = pcache_read(node, index, pce->pc_page);
+
+    old_node = NULL;
+    local_intr_save(intr_flag);
+    {
+        pcache_unbusy(pce);
+        if (ret != 0) {
+            old_node = pcache_drop(pce);
+        }
+        else {
+            *page_store = pce->pc_page;
+            pcache_touch(pce);
+        }
+    }
+    local_intr_restore(intr_flag);
+
+    if (old_node != NULL) {
+        vop_ref_dec(old_node);
+    }
+    return ret;
+
+out:
+    local_intr_restore(intr_flag);
+    return ret;
+}
+
+/*
+ * pcache_get - get the cached page of (node, index), read it in on a miss.
+ *              return NULL if the page can not be cached now (no free slot,
+ *              being read by another process, or an I/O error), the caller
+ *              should read a private copy of the page instead.
+ *              the caller must map the page before it may sleep.
+ */
+struct Page *
+pcache_get(struct inode *node, uint32_t index) {
+    struct Page *page;
+    if (__pcache_get(node, index, 0, &page) != 0) {
+        return NULL;
+    }
+    return page;
+}
+
+/*
+ * pcache_get_wait - get the cached page of (node, index) in *page_store like
+ *                   pcache_get, but wait while another process reads it in.
+ *                   return -E_NO_MEM if every slot is mapped, or the error of
+ *                   reading the file. a shared mapping uses it, it must map the
+ *                   one copy of the page and can not fall back to a private one.
+ *                   the caller must map the page before it may sleep.
+ */
+int
+pcache_get_wait(struct inode *node, uint32_t index, struct Page **page_store) {
+    return __pcache_get(node, index, 1, page_store);
+}
+
+/*
+ * pcache_invalidate - the content of [offset, offset + len) of node has been changed,
+ *                     drop the cached pages in the range, or read them again if they
+ *                     are still mapped somewhere.
+ */
+void
+pcache_invalidate(struct inode *node, off_t offset, size_t len) {
+    if (len == 0) {
+        return ;
+    }
+    uint32_t first = offset / PGSIZE, last = (len > 0xFFFFFFFF - offset) ?
+        0xFFFFFFFF / PGSIZE : (offset + len - 1) / PGSIZE;
+    int i;
+    for (i = 0; i < PCACHE_NPAGES; i ++) {
+        struct pcache_entry *pce = pce_array + i;
+        struct inode *old_node = NULL;
+        bool intr_flag, refresh = 0;
+        local_intr_save(intr_flag);
+        {
+            if (pce->pc_node == node && !pce->pc_busy
+                && pce->pc_index >= first && pce->pc_index <= last) {
+                if (page_ref(pce->pc_page) == 1) {
+                    old_node = pcache_drop(pce);
+                }
+                else {
+                    pce->pc_busy = refresh = 1;
+                }
+            }
+        }
+        local_intr_restore(intr_flag);
+
+        if (old_node != NULL) {
+            vop_ref_dec(old_node);
+        }
+        if (refresh) {
+            int ret = pcache_read(node, pce->pc_index, pce->pc_page);
+            local_intr_save(intr_flag);
+            {
+                pcache_unbusy(pce);
+                if (ret != 0) {
+                    /* still mapped, the slot is recycled once the page is unmapped */
+                    old_node = pcache_drop(pce);
+                }
+            }
+            local_intr_restore(intr_flag);
+            if (old_node != NULL) {
+                vop_ref_dec(old_node);
+            }
+        }
+    }
+}
+
+/*
+ * pcache_shrink - drop the cached pages nobody maps and release their inodes,
+ *                 return the number of pages dropped
+ */
+int
+pcache_shrink(void) {
+    int i, nr = 0;
+    for (i = 0; i < PCACHE_NPAGES; i ++) {
+        struct pcache_entry *pce = pce_array + i;
+        struct inode *old_node = NULL;
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        {
+            if (pce->pc_node != NULL && !pce->pc_busy && page_ref(pce->pc_page) == 1) {
+                old_node = pcache_drop(pce);
+            }
+        }
+        local_intr_restore(intr_flag);
+        if (old_node != NULL) {
+            vop_ref_dec(old_node);
+            nr ++;
+        }
+    }
+    return nr;
+}
+
+void
+pcache_print_stat(void) {
+    int i, used = 0, mapped = 0;
+    for (i = 0; i < PCACHE_NPAGES; i ++) {
+        struct pcache_entry *pce = pce_array + i;
+        if (pce->pc_node != NULL) {
+            used ++;
+        }
+        if (page_ref(pce->pc_page) > 1) {
+            mapped ++;
+        }
+    }
+    cprintf("pcache: %d pages, %d used, %d mapped, hit %d, miss %d, bypass %d.\n",
+            PCACHE_NPAGES, used, mapped, pcache_hits, pcache_misses, pcache_bypass);
+}
+
+void
+pcache_init(void) {
+    int i;
+    for (i = 0; i < PCACHE_HASH_SIZE; i ++) {
+        list_init(hash_list + i);
+    }
+    list_init(&lru_list);
+    wait_queue_init(&pcache_wait_queue);
+    if ((pce_array = kmalloc(sizeof(struct pcache_entry) * PCACHE_NPAGES)) == NULL) {
+        panic("pcache: alloc pce_array failed.\n");
+    }
+    for (i = 0; i < PCACHE_NPAGES; i ++) {
+        struct pcache_entry *pce = pce_array + i;
+        if ((pce->pc_page = alloc_page()) == NULL) {
+            panic("pcache: alloc page failed.\n");
+        }
+        set_page_ref(pce->pc_page, 1);
+        pce->pc_node = NULL, pce->pc_index = 0, pce->pc_busy = 0;
+        list_init(&(pce->hash_link));
+        list_add_before(&lru_list, &(pce->lru_link));
+    }
+    cprintf("pcache_init() succeeded, %d pages.\n", PCACHE_NPAGES);
+}
+
@@ -0,0 +1,42 @@
+#ifndef __KERN_FS_PCACHE_H__
+#define __KERN_FS_PCACHE_H__
+
+#include <defs.h>
+#include <list.h>
+
+struct inode;
+struct Page;
+
+#define PCACHE_NPAGES               64              // number of pages in the cache
+#define PCACHE_HASH_SHIFT           5
+#define PCACHE_HASH_SIZE            (1 << PCACHE_HASH_SHIFT)
+
+/* *
+ * struct pcache_entry - one slot of the page cache, holding page number
+ * pc_index of the file pc_node (pc_node == NULL if the slot is free). The
+ * cache owns one reference of pc_page, every mapping of the page in an
+ * address space owns another, so a slot whose page_ref is 1 is unused and
+ * may be recycled. pc_busy is set while the page is being read in.
+ * */
+struct pcache_entry {
+    struct inode *pc_node;          // the file, referenced by the cache
+    uint32_t pc_index;              // page number in the file
+    struct Page *pc_page;           // the content of the page
+    bool pc_busy;                   // the content is being read from the file
+    list_entry_t hash_link;         // entry in pcache hash list
+    list_entry_t lru_link;          // entry in pcache lru list
+};
+
+#define le2pce(le, member)                          \
+    to_struct((le), struct pcache_entry, member)
+
+void pcache_init(void);
+struct Page *pcache_find(struct inode *node, uint32_t index);
+struct Page *pcache_get(struct inode *node, uint32_t index);
+int pcache_get_wait(struct inode *node, uint32_t index, struct Page **page_store);
+void pcache_invalidate(struct inode *node, off_t offset, size_t len);
+int pcache_shrink(void);
+void pcache_print_stat(void);
+
+#endif /* !__KERN_FS_PCACHE_H__ */
+
@@ -85,9 +85,7 @@ struct sfs_fs {
     struct device *dev;                             /* device mounted on */
     struct bitmap *freemap;                         /* blocks in use are mared 0 */
     bool super_dirty;                               /* true if super/freemap modified */
-    void *sfs_buffer;                               /* buffer for non-block aligned io */
     semaphore_t fs_sem;                             /* semaphore for fs */
-    semaphore_t io_sem;                             /* semaphore for io */
     semaphore_t mutex_sem;                          /* semaphore for link/unlink and rename */
     list_entry_t inode_list;                        /* inode linked-list */
     list_entry_t *hash_list;                        /* inode hash linked-list */
@@ -111,9 +109,7 @@ void sfs_init(void);
 int sfs_mount(const char *devname);
 
 void lock_sfs_fs(struct sfs_fs *sfs);
-void lock_sfs_io(struct sfs_fs *sfs);
 void unlock_sfs_fs(struct sfs_fs *sfs);
-void unlock_sfs_io(struct sfs_fs *sfs);
 
 int sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
 int sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks);
@@ -124,6 +120,7 @@ int sfs_sync_freemap(struct sfs_fs *sfs);
 int sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks);
 
 int sfs_load_inode(struct sfs_fs *sfs, struct inode **node_store, uint32_t ino);
+int sfs_sync_inode(struct sfs_fs *sfs, struct sfs_inode *sin);
 
 #endif /* !__KERN_FS_SFS_SFS_H__ */
 
@@ -10,11 +10,12 @@
 #include <inode.h>
 #include <iobuf.h>
 #include <bitmap.h>
+#include <bcache.h>
 #include <error.h>
 #include <assert.h>
 
 /*
- * sfs_sync - sync sfs's superblock and freemap in memroy into disk
+ * sfs_sync - sync sfs's inodes, superblock and freemap in memroy into disk
  */
 static int
 sfs_sync(struct fs *fs) {
@@ -24,7 +25,7 @@ sfs_sync(struct fs *fs) {
         list_entry_t *list = &(sfs->inode_list), *le = list;
         while ((le = list_next(le)) != list) {
             struct sfs_inode *sin = le2sin(le, inode_link);
-            vop_fsync(info2node(sin, sfs_inode));
+            sfs_sync_inode(sfs, sin);
         }
     }
     unlock_sfs_fs(sfs);
@@ -41,7 +42,7 @@ sfs_sync(struct fs *fs) {
             return ret;
         }
     }
-    return 0;
+    return bcache_sync(sfs->dev);
 }
 
 /*
@@ -58,7 +59,7 @@ sfs_get_root(struct fs *fs) {
 }
 
 /*
- * sfs_unmount - unmount sfs, and free the memorys contain sfs->freemap/sfs_buffer/hash_liskt and sfs itself.
+ * sfs_unmount - unmount sfs, and free the memorys contain sfs->freemap/hash_liskt and sfs itself.
  */
 static int
 sfs_unmount(struct fs *fs) {
@@ -68,7 +69,6 @@ sfs_unmount(struct fs *fs) {
     }
     assert(!sfs->super_dirty);
     bitmap_destroy(sfs->freemap);
-    kfree(sfs->sfs_buffer);
     kfree(sfs->hash_list);
     kfree(sfs);
     return 0;
@@ -94,6 +94,7 @@ sfs_cleanup(struct fs *fs) {
     if (ret != 0) {
         warn("sfs: sync error: '%s': %e.\n", sfs->super.info, ret);
     }
+    bcache_print_stat();
 }
 
 /*
@@ -119,13 +120,12 @@ sfs_init_read(struct device *dev, uint32_t blkno, void *blk_buffer) {
  * @bitmap:     the bitmap in memroy
  * @blkno:      the NO. of disk block
  * @nblks:      Rd number of disk block
- * @blk_buffer: the buffer used for read
  *
  *      (1) get data addr in bitmap
  *      (2) read dev into iobuf
  */
 static int
-sfs_init_freemap(struct device *dev, struct bitmap *freemap, uint32_t blkno, uint32_t nblks, void *blk_buffer) {
+sfs_init_freemap(struct device *dev, struct bitmap *freemap, uint32_t blkno, uint32_t nblks) {
     size_t len;
     void *data = bitmap_getdata(freemap, &len);
     assert(data != NULL && len == nblks * SFS_BLKSIZE);
@@ -163,33 +163,30 @@ sfs_do_mount(struct device *dev, struct fs **fs_store) {
     struct sfs_fs *sfs = fsop_info(fs, sfs);
     sfs->dev = dev;
 
-    int ret = -E_NO_MEM;
+    int ret;
 
-    void *sfs_buffer;
-    if ((sfs->sfs_buffer = sfs_buffer = kmalloc(SFS_BLKSIZE)) == NULL) {
+    /* load and check superblock through the buffer cache */
+    struct buf *bp;
+    if ((ret = bread(dev, SFS_BLKN_SUPER, &bp)) != 0) {
         goto failed_cleanup_fs;
     }
 
-    /* load and check superblock */
-    if ((ret = sfs_init_read(dev, SFS_BLKN_SUPER, sfs_buffer)) != 0) {
-        goto failed_cleanup_sfs_buffer;
-    }
-
     ret = -E_INVAL;
 
-    struct sfs_super *super = sfs_buffer;
+    struct sfs_super *super = &(sfs->super);
+    *super = *(struct sfs_super *)(bp->b_data);
+    brelse(bp);
     if (super->magic != SFS_MAGIC) {
         cprintf("sfs: wrong magic in superblock. (%08x should be %08x).\n",
                 super->magic, SFS_MAGIC);
-        goto failed_cleanup_sfs_buffer;
+        goto failed_cleanup_fs;
     }
     if (super->blocks > dev->d_blocks) {
         cprintf("sfs: fs has %u blocks, device has %u blocks.\n",
                 super->blocks, dev->d_blocks);
-        goto failed_cleanup_sfs_buffer;
+        goto failed_cleanup_fs;
     }
     super->info[SFS_MAX_INFO_LEN] = '\0';
-    sfs->super = *super;
 
     ret = -E_NO_MEM;
 
@@ -198,7 +195,7 @@ sfs_do_mount(struct device *dev, struct fs **fs_store) {
     /* alloc and initialize hash list */
     list_entry_t *hash_list;
     if ((sfs->hash_list = hash_list = kmalloc(sizeof(list_entry_t) * SFS_HLIST_SIZE)) == NULL) {
-        goto failed_cleanup_sfs_buffer;
+        goto failed_cleanup_fs;
     }
     for (i = 0; i < SFS_HLIST_SIZE; i ++) {
         list_init(hash_list + i);
@@ -211,7 +208,7 @@ sfs_do_mount(struct device *dev, struct fs **fs_store) {
         goto failed_cleanup_hash_list;
     }
     uint32_t freemap_size_nblks = sfs_freemap_blocks(super);
-    if ((ret = sfs_init_freemap(dev, freemap, SFS_BLKN_FREEMAP, freemap_size_nblks, sfs_buffer)) != 0) {
+    if ((ret = sfs_init_freemap(dev, freemap, SFS_BLKN_FREEMAP, freemap_size_nblks)) != 0) {
         goto failed_cleanup_freemap;
     }
 
@@ -226,7 +223,6 @@ sfs_do_mount(struct device *dev, struct fs **fs_store) {
     /* and other fields */
     sfs->super_dirty = 0;
     sem_init(&(sfs->fs_sem), 1);
-    sem_init(&(sfs->io_sem), 1);
     sem_init(&(sfs->mutex_sem), 1);
     list_init(&(sfs->inode_list));
     cprintf("sfs: mount: '%s' (%d/%d/%d)\n", sfs->super.info,
@@ -244,8 +240,6 @@ failed_cleanup_freemap:
     bitmap_destroy(freemap);
 failed_cleanup_hash_list:
     kfree(hash_list);
-failed_cleanup_sfs_buffer:
-    kfree(sfs_buffer);
 failed_cleanup_fs:
     kfree(fs);
     return ret;
@@ -10,6 +10,7 @@
 #include <inode.h>
 #include <iobuf.h>
 #include <bitmap.h>
+#include <bcache.h>
 #include <error.h>
 #include <assert.h>
 
@@ -203,7 +204,7 @@ sfs_bmap_get_sub_nolock(struct sfs_fs *sfs, uint32_t *entp, uint32_t index, bool
     int ret;
     uint32_t ent, ino = 0;
     off_t offset = index * sizeof(uint32_t);  // the offset of entry in entry block
-	// if entry block is existd, read the content of entry block into  sfs->sfs_buffer
+	// if entry block is existd, read the content of entry block through the buffer cache
     if ((ent = *entp) != 0) {
         if ((ret = sfs_rbuf(sfs, &ino, sizeof(uint32_t), ent, offset)) != 0) {
             return ret;
@@ -534,10 +535,10 @@ sfs_openfile(struct inode *node, uint32_t open_flags) {
     return 0;
 }
 
-// sfs_close - close file
+// sfs_close - close file, the dirty inode info goes to the buffer cache only
 static int
 sfs_close(struct inode *node) {
-    return vop_fsync(node);
+    return sfs_sync_inode(fsop_info(vop_fs(node), sfs), vop_info(node, sfs_inode));
 }
 
 /*  
@@ -694,12 +695,10 @@ sfs_fstat(struct inode *node, struct stat *stat) {
 }
 
 /*
- * sfs_fsync - Force any dirty inode info associated with this file to stable storage.
+ * sfs_sync_inode - write the dirty inode info of sin into the buffer cache.
  */
-static int
-sfs_fsync(struct inode *node) {
-    struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
-    struct sfs_inode *sin = vop_info(node, sfs_inode);
+int
+sfs_sync_inode(struct sfs_fs *sfs, struct sfs_inode *sin) {
     int ret = 0;
     if (sin->dirty) {
         lock_sin(sin);
@@ -716,6 +715,21 @@ sfs_fsync(struct inode *node) {
     return ret;
 }
 
+/*
+ * sfs_fsync - Force any dirty inode info associated with this file to stable storage.
+ *             the dirty blocks of the file live in the buffer cache along with the
+ *             other blocks of the device, so all of them are written back.
+ */
+static int
+sfs_fsync(struct inode *node) {
+    struct sfs_fs *sfs = fsop_info(vop_fs(node), sfs);
+    int ret;
+    if ((ret = sfs_sync_inode(sfs, vop_info(node, sfs_inode))) != 0) {
+        return ret;
+    }
+    return bcache_sync(sfs->dev);
+}
+
 /*
  *sfs_namefile -Compute pathname relative to filesystem root of the file and copy to the specified io buffer.
  *  
@@ -859,7 +873,7 @@ sfs_reclaim(struct inode *node) {
         }
     }
     if (sin->dirty) {
-        if ((ret = vop_fsync(node)) != 0) {
+        if ((ret = sfs_sync_inode(sfs, sin)) != 0) {
             goto failed_unlock;
         }
     }
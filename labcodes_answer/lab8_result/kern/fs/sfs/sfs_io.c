@@ -4,76 +4,80 @@
 #include <sfs.h>
 #include <iobuf.h>
 #include <bitmap.h>
+#include <bcache.h>
 #include <assert.h>
 
-//Basic block-level I/O routines
+//Basic block-level I/O routines, all of them go through the block buffer cache.
+//Writes only dirty the cached blocks, bflushd or sfs_sync/sfs_fsync write them back.
 
-/* sfs_rwblock_nolock - Basic block-level I/O routine for Rd/Wr one disk block,
- *                      without lock protect for mutex process on Rd/Wr disk block
+/* sfs_bread - get the locked cache buffer of one disk block, with its content read in
  * @sfs:   sfs_fs which will be process
- * @buf:   the buffer uesed for Rd/Wr
  * @blkno: the NO. of disk block
- * @write: BOOL: Read or Write
  * @check: BOOL: if check (blono < sfs super.blocks)
+ * @bp_store: store the buffer, release it by brelse
  */
 static int
-sfs_rwblock_nolock(struct sfs_fs *sfs, void *buf, uint32_t blkno, bool write, bool check) {
+sfs_bread(struct sfs_fs *sfs, uint32_t blkno, bool check, struct buf **bp_store) {
     assert((blkno != 0 || !check) && blkno < sfs->super.blocks);
-    struct iobuf __iob, *iob = iobuf_init(&__iob, buf, SFS_BLKSIZE, blkno * SFS_BLKSIZE);
-    return dop_io(sfs->dev, iob, write);
+    return bread(sfs->dev, blkno, bp_store);
 }
 
-/* sfs_rwblock - Basic block-level I/O routine for Rd/Wr N disk blocks ,
- *               with lock protect for mutex process on Rd/Wr disk block
+/* sfs_bget - get the locked cache buffer of one disk block which will be overwritten completely
  * @sfs:   sfs_fs which will be process
- * @buf:   the buffer uesed for Rd/Wr
  * @blkno: the NO. of disk block
- * @nblks: Rd/Wr number of disk block
- * @write: BOOL: Read - 0 or Write - 1
+ * @check: BOOL: if check (blono < sfs super.blocks)
  */
-static int
-sfs_rwblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks, bool write) {
-    int ret = 0;
-    lock_sfs_io(sfs);
-    {
-        while (nblks != 0) {
-            if ((ret = sfs_rwblock_nolock(sfs, buf, blkno, write, 1)) != 0) {
-                break;
-            }
-            blkno ++, nblks --;
-            buf += SFS_BLKSIZE;
-        }
-    }
-    unlock_sfs_io(sfs);
-    return ret;
+static struct buf *
+sfs_bget(struct sfs_fs *sfs, uint32_t blkno, bool check) {
+    assert((blkno != 0 || !check) && blkno < sfs->super.blocks);
+    return bget(sfs->dev, blkno);
 }
 
-/* sfs_rblock - The Wrap of sfs_rwblock function for Rd N disk blocks ,
+/* sfs_rblock - Rd N disk blocks through the buffer cache
  *
  * @sfs:   sfs_fs which will be process
- * @buf:   the buffer uesed for Rd/Wr
+ * @buf:   the buffer uesed for Rd
  * @blkno: the NO. of disk block
- * @nblks: Rd/Wr number of disk block
+ * @nblks: Rd number of disk block
  */
 int
 sfs_rblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks) {
-    return sfs_rwblock(sfs, buf, blkno, nblks, 0);
+    int ret;
+    struct buf *bp;
+    while (nblks != 0) {
+        if ((ret = sfs_bread(sfs, blkno, 1, &bp)) != 0) {
+            return ret;
+        }
+        memcpy(buf, bp->b_data, SFS_BLKSIZE);
+        brelse(bp);
+        blkno ++, nblks --;
+        buf += SFS_BLKSIZE;
+    }
+    return 0;
 }
 
-/* sfs_wblock - The Wrap of sfs_rwblock function for Wr N disk blocks ,
+/* sfs_wblock - Wr N disk blocks through the buffer cache
  *
  * @sfs:   sfs_fs which will be process
- * @buf:   the buffer uesed for Rd/Wr
+ * @buf:   the buffer uesed for Wr
  * @blkno: the NO. of disk block
- * @nblks: Rd/Wr number of disk block
+ * @nblks: Wr number of disk block
  */
 int
 sfs_wblock(struct sfs_fs *sfs, void *buf, uint32_t blkno, uint32_t nblks) {
-    return sfs_rwblock(sfs, buf, blkno, nblks, 1);
+    struct buf *bp;
+    while (nblks != 0) {
+        bp = sfs_bget(sfs, blkno, 1);
+        memcpy(bp->b_data, buf, SFS_BLKSIZE);
+        bdwrite(bp);
+        brelse(bp);
+        blkno ++, nblks --;
+        buf += SFS_BLKSIZE;
+    }
+    return 0;
 }
 
-/* sfs_rbuf - The Basic block-level I/O routine for  Rd( non-block & non-aligned io) one disk block(using sfs->sfs_buffer)
- *            with lock protect for mutex process on Rd/Wr disk block
+/* sfs_rbuf - The Basic block-level I/O routine for  Rd( non-block & non-aligned io) one disk block(using the buffer cache)
  * @sfs:    sfs_fs which will be process
  * @buf:    the buffer uesed for Rd
  * @len:    the length need to Rd
@@ -84,18 +88,15 @@ int
 sfs_rbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset) {
     assert(offset >= 0 && offset < SFS_BLKSIZE && offset + len <= SFS_BLKSIZE);
     int ret;
-    lock_sfs_io(sfs);
-    {
-        if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0, 1)) == 0) {
-            memcpy(buf, sfs->sfs_buffer + offset, len);
-        }
+    struct buf *bp;
+    if ((ret = sfs_bread(sfs, blkno, 1, &bp)) == 0) {
+        memcpy(buf, bp->b_data + offset, len);
+        brelse(bp);
     }
-    unlock_sfs_io(sfs);
     return ret;
 }
 
-/* sfs_wbuf - The Basic block-level I/O routine for  Wr( non-block & non-aligned io) one disk block(using sfs->sfs_buffer)
- *            with lock protect for mutex process on Rd/Wr disk block
+/* sfs_wbuf - The Basic block-level I/O routine for  Wr( non-block & non-aligned io) one disk block(using the buffer cache)
  * @sfs:    sfs_fs which will be process
  * @buf:    the buffer uesed for Wr
  * @len:    the length need to Wr
@@ -106,35 +107,30 @@ int
 sfs_wbuf(struct sfs_fs *sfs, void *buf, size_t len, uint32_t blkno, off_t offset) {
     assert(offset >= 0 && offset < SFS_BLKSIZE && offset + len <= SFS_BLKSIZE);
     int ret;
-    lock_sfs_io(sfs);
-    {
-        if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 0, 1)) == 0) {
-            memcpy(sfs->sfs_buffer + offset, buf, len);
-            ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1, 1);
-        }
+    struct buf *bp;
+    if ((ret = sfs_bread(sfs, blkno, 1, &bp)) == 0) {
+        memcpy(bp->b_data + offset, buf, len);
+        bdwrite(bp);
+        brelse(bp);
     }
-    unlock_sfs_io(sfs);
     return ret;
 }
 
 /*
- * sfs_sync_super - write sfs->super (in memory) into disk (SFS_BLKN_SUPER, 1) with lock protect.
+ * sfs_sync_super - write sfs->super (in memory) into the cached block (SFS_BLKN_SUPER, 1).
  */
 int
 sfs_sync_super(struct sfs_fs *sfs) {
-    int ret;
-    lock_sfs_io(sfs);
-    {
-        memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
-        memcpy(sfs->sfs_buffer, &(sfs->super), sizeof(sfs->super));
-        ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, SFS_BLKN_SUPER, 1, 0);
-    }
-    unlock_sfs_io(sfs);
-    return ret;
+    struct buf *bp = sfs_bget(sfs, SFS_BLKN_SUPER, 0);
+    memset(bp->b_data, 0, SFS_BLKSIZE);
+    memcpy(bp->b_data, &(sfs->super), sizeof(sfs->super));
+    bdwrite(bp);
+    brelse(bp);
+    return 0;
 }
 
 /*
- * sfs_sync_freemap - write sfs bitmap into disk (SFS_BLKN_FREEMAP, nblks)  without lock protect.
+ * sfs_sync_freemap - write sfs bitmap into disk (SFS_BLKN_FREEMAP, nblks).
  */
 int
 sfs_sync_freemap(struct sfs_fs *sfs) {
@@ -143,25 +139,20 @@ sfs_sync_freemap(struct sfs_fs *sfs) {
 }
 
 /*
- * sfs_clear_block - write zero info into disk (blkno, nblks)  with lock protect.
+ * sfs_clear_block - write zero info into disk (blkno, nblks).
  * @sfs:   sfs_fs which will be process
  * @blkno: the NO. of disk block
  * @nblks: Rd/Wr number of disk block
  */
 int
 sfs_clear_block(struct sfs_fs *sfs, uint32_t blkno, uint32_t nblks) {
-    int ret;
-    lock_sfs_io(sfs);
-    {
-        memset(sfs->sfs_buffer, 0, SFS_BLKSIZE);
-        while (nblks != 0) {
-            if ((ret = sfs_rwblock_nolock(sfs, sfs->sfs_buffer, blkno, 1, 1)) != 0) {
-                break;
-            }
-            blkno ++, nblks --;
-        }
+    struct buf *bp;
+    while (nblks != 0) {
+        bp = sfs_bget(sfs, blkno, 1);
+        memset(bp->b_data, 0, SFS_BLKSIZE);
+        bdwrite(bp);
+        brelse(bp);
+        blkno ++, nblks --;
     }
-    unlock_sfs_io(sfs);
-    return ret;
+    return 0;
 }
-
@@ -13,16 +13,6 @@ lock_sfs_fs(struct sfs_fs *sfs) {
     down(&(sfs->fs_sem));
 }
 
-/*
- * lock_sfs_io - lock the process of SFS File Rd/Wr Disk Block
- *
- * called by: sfs_rwblock, sfs_clear_block, sfs_sync_super
- */
-void
-lock_sfs_io(struct sfs_fs *sfs) {
-    down(&(sfs->io_sem));
-}
-
 /*
  * unlock_sfs_fs - unlock the process of  SFS Filesystem Rd/Wr Disk Block
  *
@@ -32,13 +22,3 @@ void
 unlock_sfs_fs(struct sfs_fs *sfs) {
     up(&(sfs->fs_sem));
 }
-
-/*
- * unlock_sfs_io - unlock the process of sfs Rd/Wr Disk Block
- *
- * called by: sfs_rwblock sfs_clear_block sfs_sync_super
- */
-void
-unlock_sfs_io(struct sfs_fs *sfs) {
-    up(&(sfs->io_sem));
-}
@@ -25,3 +25,15 @@ swapfs_write(swap_entry_t entry, struct Page *page) {
     return ide_write_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, page2kva(page), PAGE_NSECT);
 }
 
+// swapfs_read_cluster - read the n pages at the consecutive slots from entry into buf, in one request
+int
+swapfs_read_cluster(swap_entry_t entry, void *buf, size_t n) {
+    return ide_read_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, buf, n * PAGE_NSECT);
+}
+
+// swapfs_write_cluster - write the n pages in buf to the consecutive slots from entry, in one request
+int
+swapfs_write_cluster(swap_entry_t entry, void *buf, size_t n) {
+    return ide_write_secs(SWAP_DEV_NO, swap_offset(entry) * PAGE_NSECT, buf, n * PAGE_NSECT);
+}
+
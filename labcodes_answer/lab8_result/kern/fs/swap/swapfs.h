@@ -7,6 +7,8 @@
 void swapfs_init(void);
 int swapfs_read(swap_entry_t entry, struct Page *page);
 int swapfs_write(swap_entry_t entry, struct Page *page);
+int swapfs_read_cluster(swap_entry_t entry, void *buf, size_t n);
+int swapfs_write_cluster(swap_entry_t entry, void *buf, size_t n);
 
 #endif /* !__KERN_FS_SWAP_SWAPFS_H__ */
 
@@ -7,6 +7,20 @@
 #include <error.h>
 #include <assert.h>
 #include <kmalloc.h>
+#include <slab.h>
+
+static kmem_cache_t *inode_cachep;
+
+/* *
+ * inode_cache_init - create the cache of inode structures (sfs_inode and device
+ * are both kept in the inode)
+ * */
+void
+inode_cache_init(void) {
+    if ((inode_cachep = kmem_cache_create("inode", sizeof(struct inode), NULL)) == NULL) {
+        panic("vfs: create inode cache failed.\n");
+    }
+}
 
 /* *
  * __alloc_inode - alloc a inode structure and initialize in_type
@@ -14,7 +28,7 @@
 struct inode *
 __alloc_inode(int type) {
     struct inode *node;
-    if ((node = kmalloc(sizeof(struct inode))) != NULL) {
+    if ((node = kmem_cache_alloc(inode_cachep)) != NULL) {
         node->in_type = type;
     }
     return node;
@@ -40,7 +54,7 @@ void
 inode_kill(struct inode *node) {
     assert(inode_ref_count(node) == 0);
     assert(inode_open_count(node) == 0);
-    kfree(node);
+    kmem_cache_free(inode_cachep, node);
 }
 
 /* *
@@ -10,6 +10,7 @@
 #include <unistd.h>
 #include <error.h>
 #include <assert.h>
+#include <pcache.h>
 
 // device info entry in vdev_list 
 typedef struct {
@@ -263,6 +264,8 @@ vfs_unmount(const char *devname) {
     }
     assert(vdev->devname != NULL && vdev->mountable);
 
+    // the page cache holds inodes of the programs run from it
+    pcache_shrink();
     if ((ret = fsop_sync(vdev->fs)) != 0) {
         goto out;
     }
@@ -289,6 +292,7 @@ vfs_unmount_all(void) {
                 vfs_dev_t *vdev = le2vdev(le, vdev_link);
                 if (vdev->mountable && vdev->fs != NULL) {
                     int ret;
+                    pcache_shrink();
                     if ((ret = fsop_sync(vdev->fs)) != 0) {
                         cprintf("vfs: warning: sync failed for %s: %e.\n", vdev->devname, ret);
                         continue ;
@@ -0,0 +1,116 @@
+#include <defs.h>
+#include <string.h>
+#include <error.h>
+#include <assert.h>
+#include <lz.h>
+
+/* *
+ * The compressed stream is a sequence of groups of up to 8 items, each group
+ * led by a flag byte whose bit i tells whether item i is a match (1) or a
+ * literal byte (0). A match copies len bytes from off bytes back in the
+ * output, maybe overlapping it, and takes 2 or 3 bytes:
+ *     byte 0   the low 8 bits of off (1 <= off < LZ_MAX_LEN)
+ *     byte 1   the high 4 bits of off, then len - LZ_MIN_MATCH in the low
+ *              4 bits, or 15 if byte 2 follows with len - LZ_MIN_MATCH - 15
+ * Matches are found through a hash table of the last position each 3-byte
+ * prefix was seen at, as in LZRW1 and LZ4.
+ * */
+#define LZ_MIN_MATCH            3
+#define LZ_MAX_MATCH            (LZ_MIN_MATCH + 15 + 255)
+#define LZ_HASH_BITS            10
+#define LZ_HASH(p)              ((((p)[0] << 8) ^ ((p)[1] << 4) ^ (p)[2]) & ((1 << LZ_HASH_BITS) - 1))
+
+// position + 1 each prefix was last seen at, 0 if none; callers do not sleep in lz_compress
+static uint16_t lz_hash_table[1 << LZ_HASH_BITS];
+
+// lz_compress - compress len bytes at src to dst, return the compressed size, or 0 if it exceeds dst_len
+size_t
+lz_compress(const void *src, size_t len, void *dst, size_t dst_len) {
+    const uint8_t *in = src;
+    uint8_t *out = dst, *flag = NULL;
+    size_t ip = 0, op = 0;
+    int nitem = 8;
+    assert(len <= LZ_MAX_LEN);
+    memset(lz_hash_table, 0, sizeof(lz_hash_table));
+    while (ip < len) {
+        // a new group, and the largest item
+        if (op + (nitem == 8) + 3 > dst_len) {
+            return 0;
+        }
+        if (nitem == 8) {
+            flag = out + op ++, *flag = 0, nitem = 0;
+        }
+        size_t mlen = 0, ref = 0;
+        if (ip + LZ_MIN_MATCH <= len) {
+            int h = LZ_HASH(in + ip);
+            if (lz_hash_table[h] != 0) {
+                ref = lz_hash_table[h] - 1;
+                while (ip + mlen < len && mlen < LZ_MAX_MATCH && in[ref + mlen] == in[ip + mlen]) {
+                    mlen ++;
+                }
+            }
+            lz_hash_table[h] = ip + 1;
+        }
+        if (mlen >= LZ_MIN_MATCH) {
+            size_t off = ip - ref, code = mlen - LZ_MIN_MATCH;
+            out[op ++] = off & 0xff;
+            out[op ++] = ((off >> 8) << 4) | (code < 15 ? code : 15);
+            if (code >= 15) {
+                out[op ++] = code - 15;
+            }
+            *flag |= 1 << nitem;
+            ip += mlen;
+        }
+        else {
+            out[op ++] = in[ip ++];
+        }
+        nitem ++;
+    }
+    return op;
+}
+
+// lz_decompress - decompress src_len bytes at src to exactly len bytes at dst
+int
+lz_decompress(const void *src, size_t src_len, void *dst, size_t len) {
+    const uint8_t *in = src;
+    uint8_t *out = dst;
+    size_t ip = 0, op = 0;
+    int nitem = 8;
+    uint8_t flag = 0;
+    while (op < len) {
+        if (nitem == 8) {
+            if (ip >= src_len) {
+                return -E_INVAL;
+            }
+            flag = in[ip ++], nitem = 0;
+        }
+        if (flag & (1 << nitem ++)) {
+            if (ip + 2 > src_len) {
+                return -E_INVAL;
+            }
+            size_t off = in[ip] | ((in[ip + 1] >> 4) << 8), mlen = in[ip + 1] & 15;
+            ip += 2;
+            if (mlen == 15) {
+                if (ip >= src_len) {
+                    return -E_INVAL;
+                }
+                mlen += in[ip ++];
+            }
+            mlen += LZ_MIN_MATCH;
+            if (off == 0 || off > op || op + mlen > len) {
+                return -E_INVAL;
+            }
+            for (; mlen > 0; mlen --, op ++) {
+                out[op] = out[op - off];
+            }
+        }
+        else {
+            if (ip >= src_len) {
+                return -E_INVAL;
+            }
+            out[op ++] = in[ip ++];
+        }
+    }
+    return (ip == src_len) ? 0 : -E_INVAL;
+}
+
@@ -0,0 +1,18 @@
+#ifndef __KERN_LIBS_LZ_H__
+#define __KERN_LIBS_LZ_H__
+
+#include <defs.h>
+
+/* *
+ * A small LZ77 compressor for the compressed swap pool: fast, needs no
+ * memory besides a static hash table, and finds the long runs of equal
+ * bytes (zero fill above all) swapped out pages are full of. Inputs are at
+ * most LZ_MAX_LEN bytes.
+ * */
+#define LZ_MAX_LEN              4096
+
+size_t lz_compress(const void *src, size_t len, void *dst, size_t dst_len);
+int lz_decompress(const void *src, size_t src_len, void *dst, size_t len);
+
+#endif /* !__KERN_LIBS_LZ_H__ */
+
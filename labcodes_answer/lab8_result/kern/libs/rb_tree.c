@@ -0,0 +1,266 @@
+#include <defs.h>
+#include <rb_tree.h>
+
+/* *
+ * Red-black tree (Cormen et al., Introduction to Algorithms, chapter 13)
+ * with NULL leaves. Every node is red or black, the root is black, a red
+ * node has no red child, and all paths from a node down to a leaf have the
+ * same number of black nodes, so the height is at most 2*log2(n+1).
+ *
+ * Augmented trees: a rotation only changes the subtrees of the two nodes
+ * rotated, so only those are recomputed; linking or unlinking a node changes
+ * the subtrees of all its ancestors, which are recomputed up to the root.
+ * */
+
+void
+rb_tree_init(rb_tree_t *tree, void (*augment)(rb_node_t *node)) {
+    tree->root = NULL;
+    tree->augment = augment;
+}
+
+// rb_augment_path - recompute the augmented data from node up to the root
+void
+rb_augment_path(rb_tree_t *tree, rb_node_t *node) {
+    if (tree->augment != NULL) {
+        for (; node != NULL; node = node->parent) {
+            tree->augment(node);
+        }
+    }
+}
+
+// rb_replace_child - make child take the place of node under parent
+static inline void
+rb_replace_child(rb_tree_t *tree, rb_node_t *node, rb_node_t *child, rb_node_t *parent) {
+    if (parent == NULL) {
+        tree->root = child;
+    }
+    else if (parent->left == node) {
+        parent->left = child;
+    }
+    else {
+        parent->right = child;
+    }
+}
+
+static void
+rb_rotate_left(rb_tree_t *tree, rb_node_t *x) {
+    rb_node_t *y = x->right;
+    if ((x->right = y->left) != NULL) {
+        y->left->parent = x;
+    }
+    y->parent = x->parent;
+    rb_replace_child(tree, x, y, x->parent);
+    y->left = x, x->parent = y;
+    if (tree->augment != NULL) {
+        tree->augment(x);
+        tree->augment(y);
+    }
+}
+
+static void
+rb_rotate_right(rb_tree_t *tree, rb_node_t *x) {
+    rb_node_t *y = x->left;
+    if ((x->left = y->right) != NULL) {
+        y->right->parent = x;
+    }
+    y->parent = x->parent;
+    rb_replace_child(tree, x, y, x->parent);
+    y->right = x, x->parent = y;
+    if (tree->augment != NULL) {
+        tree->augment(x);
+        tree->augment(y);
+    }
+}
+
+/*
+ * rb_insert - link node at *link, a NULL child of parent (or the root if
+ *             parent is NULL) found by the caller, then rebalance
+ */
+void
+rb_insert(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent, rb_node_t **link) {
+    node->parent = parent;
+    node->left = node->right = NULL;
+    node->red = 1;
+    *link = node;
+    rb_augment_path(tree, node);
+
+    rb_node_t *p, *g, *u;
+    while ((p = node->parent) != NULL && p->red) {
+        g = p->parent;
+        if (p == g->left) {
+            u = g->right;
+            if (u != NULL && u->red) {
+                p->red = u->red = 0, g->red = 1;
+                node = g;
+                continue;
+            }
+            if (node == p->right) {
+                rb_rotate_left(tree, p);
+                node = p, p = node->parent;
+            }
+            p->red = 0, g->red = 1;
+            rb_rotate_right(tree, g);
+        }
+        else {
+            u = g->left;
+            if (u != NULL && u->red) {
+                p->red = u->red = 0, g->red = 1;
+                node = g;
+                continue;
+            }
+            if (node == p->left) {
+                rb_rotate_right(tree, p);
+                node = p, p = node->parent;
+            }
+            p->red = 0, g->red = 1;
+            rb_rotate_left(tree, g);
+        }
+    }
+    tree->root->red = 0;
+}
+
+// rb_erase_fixup - restore the black height after a black node was removed above x
+static void
+rb_erase_fixup(rb_tree_t *tree, rb_node_t *x, rb_node_t *parent) {
+    rb_node_t *w;
+    while (x != tree->root && (x == NULL || !x->red)) {
+        if (x == parent->left) {
+            w = parent->right;
+            if (w->red) {
+                w->red = 0, parent->red = 1;
+                rb_rotate_left(tree, parent);
+                w = parent->right;
+            }
+            if ((w->left == NULL || !w->left->red) && (w->right == NULL || !w->right->red)) {
+                w->red = 1;
+                x = parent, parent = x->parent;
+                continue;
+            }
+            if (w->right == NULL || !w->right->red) {
+                w->left->red = 0, w->red = 1;
+                rb_rotate_right(tree, w);
+                w = parent->right;
+            }
+            w->red = parent->red, parent->red = 0, w->right->red = 0;
+            rb_rotate_left(tree, parent);
+        }
+        else {
+            w = parent->left;
+            if (w->red) {
+                w->red = 0, parent->red = 1;
+                rb_rotate_right(tree, parent);
+                w = parent->left;
+            }
+            if ((w->left == NULL || !w->left->red) && (w->right == NULL || !w->right->red)) {
+                w->red = 1;
+                x = parent, parent = x->parent;
+                continue;
+            }
+            if (w->left == NULL || !w->left->red) {
+                w->right->red = 0, w->red = 1;
+                rb_rotate_left(tree, w);
+                w = parent->left;
+            }
+            w->red = parent->red, parent->red = 0, w->left->red = 0;
+            rb_rotate_right(tree, parent);
+        }
+        x = tree->root;
+        break;
+    }
+    if (x != NULL) {
+        x->red = 0;
+    }
+}
+
+// rb_erase - unlink node from tree, then rebalance
+void
+rb_erase(rb_tree_t *tree, rb_node_t *node) {
+    rb_node_t *child, *parent;
+    bool red;
+    if (node->left == NULL || node->right == NULL) {
+        child = (node->left != NULL) ? node->left : node->right;
+        parent = node->parent, red = node->red;
+        if (child != NULL) {
+            child->parent = parent;
+        }
+        rb_replace_child(tree, node, child, parent);
+    }
+    else {
+        /* the successor y takes the place and the color of node */
+        rb_node_t *y = node->right;
+        while (y->left != NULL) {
+            y = y->left;
+        }
+        child = y->right, parent = y->parent, red = y->red;
+        if (parent == node) {
+            parent = y;
+        }
+        else {
+            if (child != NULL) {
+                child->parent = parent;
+            }
+            parent->left = child;
+            y->right = node->right, node->right->parent = y;
+        }
+        y->left = node->left, node->left->parent = y;
+        y->parent = node->parent, y->red = node->red;
+        rb_replace_child(tree, node, y, node->parent);
+    }
+    rb_augment_path(tree, parent);
+    if (!red) {
+        rb_erase_fixup(tree, child, parent);
+    }
+}
+
+rb_node_t *
+rb_first(rb_tree_t *tree) {
+    rb_node_t *node = tree->root;
+    if (node != NULL) {
+        while (node->left != NULL) {
+            node = node->left;
+        }
+    }
+    return node;
+}
+
+rb_node_t *
+rb_last(rb_tree_t *tree) {
+    rb_node_t *node = tree->root;
+    if (node != NULL) {
+        while (node->right != NULL) {
+            node = node->right;
+        }
+    }
+    return node;
+}
+
+rb_node_t *
+rb_next(rb_node_t *node) {
+    if (node->right != NULL) {
+        node = node->right;
+        while (node->left != NULL) {
+            node = node->left;
+        }
+        return node;
+    }
+    while (node->parent != NULL && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+rb_node_t *
+rb_prev(rb_node_t *node) {
+    if (node->left != NULL) {
+        node = node->left;
+        while (node->right != NULL) {
+            node = node->right;
+        }
+        return node;
+    }
+    while (node->parent != NULL && node == node->parent->left) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
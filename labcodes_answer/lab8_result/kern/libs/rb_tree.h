@@ -0,0 +1,41 @@
+#ifndef __KERN_LIBS_RB_TREE_H__
+#define __KERN_LIBS_RB_TREE_H__
+
+#include <defs.h>
+
+/* *
+ * rb_node_t - a node of a red-black tree, embedded in the structure it indexes,
+ * like list_entry_t. Users find the place of a new node by walking down from
+ * the root themselves and pass it to rb_insert.
+ * */
+typedef struct rb_node {
+    struct rb_node *parent, *left, *right;
+    bool red;
+} rb_node_t;
+
+/* *
+ * rb_tree_t - the root of a red-black tree.
+ * @augment: recompute the data a node keeps about its subtree from the node
+ *           and its children, called bottom-up whenever a subtree changes;
+ *           NULL if the nodes keep no such data.
+ * */
+typedef struct rb_tree {
+    rb_node_t *root;
+    void (*augment)(rb_node_t *node);
+} rb_tree_t;
+
+#define rbn2struct(node, type, member)              \
+    to_struct((node), type, member)
+
+void rb_tree_init(rb_tree_t *tree, void (*augment)(rb_node_t *node));
+void rb_insert(rb_tree_t *tree, rb_node_t *node, rb_node_t *parent, rb_node_t **link);
+void rb_erase(rb_tree_t *tree, rb_node_t *node);
+void rb_augment_path(rb_tree_t *tree, rb_node_t *node);
+
+rb_node_t *rb_first(rb_tree_t *tree);
+rb_node_t *rb_last(rb_tree_t *tree);
+rb_node_t *rb_next(rb_node_t *node);
+rb_node_t *rb_prev(rb_node_t *node);
+
+#endif /* !__KERN_LIBS_RB_TREE_H__ */
+
@@ -0,0 +1,241 @@
+#include <pmm.h>
+#include <list.h>
+#include <string.h>
+#include <buddy_pmm.h>
+
+/*  In the buddy system, free memory is kept as blocks of 2^order pages,
+ * each block aligned to its size (by page number), with one free list per
+ * order. Two free blocks of the same order which together form an aligned
+ * block of the next order are "buddies": the page number of the buddy of a
+ * block is its own page number with bit order flipped.
+ *
+ * alloc_pages(n) takes a block from the smallest non-empty order >= the
+ * order of n, splits it down to the order of n, and gives the pages beyond n
+ * back, so exactly n pages are allocated. free_pages(base, n) cuts the range
+ * into aligned blocks and merges each block with its buddy as long as the
+ * buddy is free. Both take O(log n) steps instead of a walk of all free
+ * blocks as first fit does.
+ *
+ * The head page of a free block has PG_property set and its order in
+ * property; the other pages of a free block and all allocated pages have
+ * PG_property cleared. nr_free of buddy_area[order] counts the free blocks
+ * of that order.
+ */
+static free_area_t buddy_area[BUDDY_MAX_ORDER + 1];
+static size_t buddy_nr_free;
+
+#define buddy_list(order)           (buddy_area[order].free_list)
+
+// buddy_order - the smallest order whose block holds n pages
+static inline int
+buddy_order(size_t n) {
+    int order = 0;
+    while (((size_t)1 << order) < n) {
+        order ++;
+    }
+    return order;
+}
+
+// buddy_push - put the free block at page into the list of order
+static inline void
+buddy_push(struct Page *page, int order) {
+    page->property = order;
+    SetPageProperty(page);
+    list_add(&buddy_list(order), &(page->page_link));
+    buddy_area[order].nr_free ++;
+}
+
+// buddy_pop - take the free block at page out of its list
+static inline void
+buddy_pop(struct Page *page) {
+    list_del(&(page->page_link));
+    ClearPageProperty(page);
+    buddy_area[page->property].nr_free --;
+}
+
+// buddy_free_block - free the aligned block of 2^order pages at page, merging it with its buddies
+static void
+buddy_free_block(struct Page *page, int order) {
+    size_t ppn = page2ppn(page);
+    while (order < BUDDY_MAX_ORDER) {
+        size_t buddy_ppn = ppn ^ ((size_t)1 << order);
+        if (buddy_ppn >= npage) {
+            break;
+        }
+        struct Page *buddy = pages + buddy_ppn;
+        if (!PageProperty(buddy) || buddy->property != order) {
+            break;
+        }
+        buddy_pop(buddy);
+        ppn &= ~((size_t)1 << order);
+        order ++;
+    }
+    buddy_push(pages + ppn, order);
+}
+
+// buddy_free_range - free the n pages at base as the largest aligned blocks they contain
+static void
+buddy_free_range(struct Page *base, size_t n) {
+    size_t ppn = page2ppn(base), end = ppn + n;
+    while (ppn < end) {
+        int order = 0;
+        while (order < BUDDY_MAX_ORDER && !(ppn & ((size_t)1 << order))
+               && ppn + ((size_t)2 << order) <= end) {
+            order ++;
+        }
+        buddy_free_block(pages + ppn, order);
+        ppn += (size_t)1 << order;
+    }
+}
+
+static void
+buddy_init(void) {
+    int order;
+    for (order = 0; order <= BUDDY_MAX_ORDER; order ++) {
+        list_init(&buddy_list(order));
+        buddy_area[order].nr_free = 0;
+    }
+    buddy_nr_free = 0;
+}
+
+static void
+buddy_init_memmap(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(PageReserved(p));
+        p->flags = p->property = 0;
+        set_page_ref(p, 0);
+    }
+    buddy_free_range(base, n);
+    buddy_nr_free += n;
+}
+
+static struct Page *
+buddy_alloc_pages(size_t n) {
+    assert(n > 0);
+    if (n > buddy_nr_free || n > ((size_t)1 << BUDDY_MAX_ORDER)) {
+        return NULL;
+    }
+    int order = buddy_order(n), k = order;
+    while (k <= BUDDY_MAX_ORDER && list_empty(&buddy_list(k))) {
+        k ++;
+    }
+    if (k > BUDDY_MAX_ORDER) {
+        return NULL;
+    }
+    struct Page *page = le2page(list_next(&buddy_list(k)), page_link);
+    buddy_pop(page);
+    while (k > order) {
+        k --;
+        buddy_push(page + ((size_t)1 << k), k);
+    }
+    if (((size_t)1 << order) > n) {
+        buddy_free_range(page + n, ((size_t)1 << order) - n);
+    }
+    buddy_nr_free -= n;
+    return page;
+}
+
+static void
+buddy_free_pages(struct Page *base, size_t n) {
+    assert(n > 0);
+    struct Page *p = base;
+    for (; p != base + n; p ++) {
+        assert(!PageReserved(p) && !PageProperty(p));
+        p->flags = 0;
+        set_page_ref(p, 0);
+    }
+    buddy_free_range(base, n);
+    buddy_nr_free += n;
+}
+
+static size_t
+buddy_nr_free_pages(void) {
+    return buddy_nr_free;
+}
+
+static void
+buddy_free_stat(struct free_stat *stat) {
+    int order;
+    for (order = 0; order <= BUDDY_MAX_ORDER; order ++) {
+        stat->nr_blocks[order] = buddy_area[order].nr_free;
+        stat->nr_pages[order] = buddy_area[order].nr_free << order;
+    }
+}
+
+static void
+buddy_check(void) {
+    int order, total = 0;
+    for (order = 0; order <= BUDDY_MAX_ORDER; order ++) {
+        int count = 0;
+        list_entry_t *le = &buddy_list(order);
+        while ((le = list_next(le)) != &buddy_list(order)) {
+            struct Page *p = le2page(le, page_link);
+            assert(PageProperty(p) && p->property == order);
+            assert(page2ppn(p) % (1 << order) == 0);
+            count ++;
+        }
+        assert(count == buddy_area[order].nr_free);
+        total += count << order;
+    }
+    assert(total == nr_free_pages());
+
+    struct Page *p0, *p1, *p2, *p3;
+    assert((p0 = alloc_pages(4)) != NULL);
+    assert(!PageProperty(p0) && page2ppn(p0) % 4 == 0);
+
+    /* run the rest on the 4 pages of p0 only */
+    free_area_t area_store[BUDDY_MAX_ORDER + 1];
+    size_t nr_free_store = buddy_nr_free;
+    for (order = 0; order <= BUDDY_MAX_ORDER; order ++) {
+        area_store[order] = buddy_area[order];
+    }
+    buddy_init();
+    assert(alloc_page() == NULL);
+
+    free_pages(p0, 4);
+    assert(buddy_area[2].nr_free == 1 && PageProperty(p0) && p0->property == 2);
+
+    /* split */
+    assert((p1 = alloc_page()) == p0);
+    assert((p2 = alloc_page()) == p0 + 1);
+    assert((p3 = alloc_pages(2)) == p0 + 2);
+    assert(alloc_page() == NULL && nr_free_pages() == 0);
+
+    /* merge */
+    free_page(p1);
+    assert(PageProperty(p0) && p0->property == 0);
+    free_page(p2);
+    assert(PageProperty(p0) && p0->property == 1 && !PageProperty(p0 + 1));
+    free_pages(p3, 2);
+    assert(PageProperty(p0) && p0->property == 2 && !PageProperty(p0 + 2));
+    assert(buddy_area[0].nr_free == 0 && buddy_area[1].nr_free == 0 && buddy_area[2].nr_free == 1);
+
+    /* a request which is not a power of 2 takes exactly n pages */
+    assert((p1 = alloc_pages(3)) == p0);
+    assert(nr_free_pages() == 1 && PageProperty(p0 + 3) && p0[3].property == 0);
+    free_pages(p1, 3);
+    assert(buddy_area[2].nr_free == 1 && PageProperty(p0) && p0->property == 2);
+
+    assert(alloc_pages(4) == p0);
+    assert(nr_free_pages() == 0);
+    for (order = 0; order <= BUDDY_MAX_ORDER; order ++) {
+        buddy_area[order] = area_store[order];
+    }
+    buddy_nr_free = nr_free_store;
+    free_pages(p0, 4);
+    assert(total == nr_free_pages());
+}
+
+const struct pmm_manager buddy_pmm_manager = {
+    .name = "buddy_pmm_manager",
+    .init = buddy_init,
+    .init_memmap = buddy_init_memmap,
+    .alloc_pages = buddy_alloc_pages,
+    .free_pages = buddy_free_pages,
+    .nr_free_pages = buddy_nr_free_pages,
+    .free_stat = buddy_free_stat,
+    .check = buddy_check,
+};
+
@@ -0,0 +1,11 @@
+#ifndef __KERN_MM_BUDDY_PMM_H__
+#define  __KERN_MM_BUDDY_PMM_H__
+
+#include <pmm.h>
+
+#define BUDDY_MAX_ORDER             (PMM_NR_ORDER - 1) // the largest block is 2^10 pages (4MB)
+
+extern const struct pmm_manager buddy_pmm_manager;
+
+#endif /* ! __KERN_MM_BUDDY_PMM_H__ */
+
@@ -195,6 +195,21 @@ default_nr_free_pages(void) {
     return nr_free;
 }
 
+static void
+default_free_stat(struct free_stat *stat) {
+    memset(stat, 0, sizeof(struct free_stat));
+    list_entry_t *le = &free_list;
+    while ((le = list_next(le)) != &free_list) {
+        struct Page *p = le2page(le, page_link);
+        int order = 0;
+        while (order < PMM_NR_ORDER - 1 && ((size_t)2 << order) <= p->property) {
+            order ++;
+        }
+        stat->nr_blocks[order] ++;
+        stat->nr_pages[order] += p->property;
+    }
+}
+
 static void
 basic_check(void) {
     struct Page *p0, *p1, *p2;
@@ -318,5 +333,6 @@ const struct pmm_manager default_pmm_manager = {
     .alloc_pages = default_alloc_pages,
     .free_pages = default_free_pages,
     .nr_free_pages = default_nr_free_pages,
+    .free_stat = default_free_stat,
     .check = default_check,
 };
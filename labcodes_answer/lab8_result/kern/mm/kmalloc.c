@@ -3,9 +3,12 @@
 #include <memlayout.h>
 #include <assert.h>
 #include <kmalloc.h>
+#include <slab.h>
 #include <sync.h>
 #include <pmm.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <x86.h>
 
 /*
  * SLOB Allocator: Simple List Of Blocks
@@ -24,9 +27,10 @@
  * Above this is an implementation of kmalloc/kfree. Blocks returned
  * from kmalloc are 8-byte aligned and prepended with a 8-byte header.
  * If kmalloc is asked for objects of PAGE_SIZE or larger, it calls
- * __get_free_pages directly so that it can return page-aligned blocks
- * and keeps a linked list of such pages and their orders. These
- * objects are detected in kfree() by their page alignment.
+ * __get_free_pages directly so that it can return page-aligned blocks.
+ * The first page of such a block is marked PG_bigblock with the order
+ * of the block in its property, so kfree() and ksize() tell them from
+ * SLOB blocks by the page descriptor in O(1).
  *
  * SLAB is emulated on top of SLOB by simply calling constructors and
  * destructors for every SLAB allocation. Objects are returned with
@@ -66,16 +70,8 @@ typedef struct slob_block slob_t;
 #define SLOB_UNITS(size) (((size) + SLOB_UNIT - 1)/SLOB_UNIT)
 #define SLOB_ALIGN L1_CACHE_BYTES
 
-struct bigblock {
-	int order;
-	void *pages;
-	struct bigblock *next;
-};
-typedef struct bigblock bigblock_t;
-
 static slob_t arena = { .next = &arena, .units = 1 };
 static slob_t *slobfree = &arena;
-static bigblock_t *bigblocks;
 
 
 static void* __slob_get_free_pages(gfp_t gfp, int order)
@@ -196,9 +192,13 @@ slab_init(void) {
   check_slab();
 }
 
+static void kmalloc_bench(void);
+
 inline void 
 kmalloc_init(void) {
     slab_init();
+    kmem_cache_init();
+    kmalloc_bench();
     cprintf("kmalloc_init() succeeded!\n");
 }
 
@@ -215,39 +215,39 @@ kallocated(void) {
 static int find_order(int size)
 {
 	int order = 0;
-	for ( ; size > 4096 ; size >>=1)
-		order++;
+	for ( ; (PAGE_SIZE << order) < size ; order++)
+		;
 	return order;
 }
 
+/* the first page of a page-sized kmalloc block, or NULL for a SLOB block */
+static inline struct Page *bigblock_page(const void *block)
+{
+	if ((unsigned long)block & (PAGE_SIZE-1))
+		return NULL;
+	struct Page *page = kva2page((void *)block);
+	return PageBigblock(page) ? page : NULL;
+}
+
 static void *__kmalloc(size_t size, gfp_t gfp)
 {
 	slob_t *m;
-	bigblock_t *bb;
-	unsigned long flags;
+	struct Page *page;
+	int order;
 
 	if (size < PAGE_SIZE - SLOB_UNIT) {
 		m = slob_alloc(size + SLOB_UNIT, gfp, 0);
 		return m ? (void *)(m + 1) : 0;
 	}
 
-	bb = slob_alloc(sizeof(bigblock_t), gfp, 0);
-	if (!bb)
+	if (size > (PAGE_SIZE << KMALLOC_MAX_ORDER))
 		return 0;
-
-	bb->order = find_order(size);
-	bb->pages = (void *)__slob_get_free_pages(gfp, bb->order);
-
-	if (bb->pages) {
-		spin_lock_irqsave(&block_lock, flags);
-		bb->next = bigblocks;
-		bigblocks = bb;
-		spin_unlock_irqrestore(&block_lock, flags);
-		return bb->pages;
-	}
-
-	slob_free(bb, sizeof(bigblock_t));
-	return 0;
+	order = find_order(size);
+	if (!(page = alloc_pages(1 << order)))
+		return 0;
+	page->property = order;
+	SetPageBigblock(page);
+	return page2kva(page);
 }
 
 void *
@@ -259,25 +259,17 @@ kmalloc(size_t size)
 
 void kfree(void *block)
 {
-	bigblock_t *bb, **last = &bigblocks;
-	unsigned long flags;
+	struct Page *page;
 
 	if (!block)
 		return;
 
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		/* might be on the big block list */
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; last = &bb->next, bb = bb->next) {
-			if (bb->pages == block) {
-				*last = bb->next;
-				spin_unlock_irqrestore(&block_lock, flags);
-				__slob_free_pages((unsigned long)block, bb->order);
-				slob_free(bb, sizeof(bigblock_t));
-				return;
-			}
-		}
-		spin_unlock_irqrestore(&block_lock, flags);
+	if ((page = bigblock_page(block)) != NULL) {
+		int order = page->property;
+		ClearPageBigblock(page);
+		page->property = 0;
+		__slob_free_pages((unsigned long)block, order);
+		return;
 	}
 
 	slob_free((slob_t *)block - 1, 0);
@@ -287,24 +279,71 @@ void kfree(void *block)
 
 unsigned int ksize(const void *block)
 {
-	bigblock_t *bb;
-	unsigned long flags;
+	struct Page *page;
 
 	if (!block)
 		return 0;
 
-	if (!((unsigned long)block & (PAGE_SIZE-1))) {
-		spin_lock_irqsave(&block_lock, flags);
-		for (bb = bigblocks; bb; bb = bb->next)
-			if (bb->pages == block) {
-				spin_unlock_irqrestore(&slob_lock, flags);
-				return PAGE_SIZE << bb->order;
-			}
-		spin_unlock_irqrestore(&block_lock, flags);
-	}
+	if ((page = bigblock_page(block)) != NULL)
+		return PAGE_SIZE << page->property;
 
 	return ((slob_t *)block - 1)->units * SLOB_UNIT;
 }
 
+#define KMALLOC_BENCH_SLOTS         128             // blocks held at the same time
+#define KMALLOC_BENCH_OPS           8192            // timed kmalloc/kfree operations
+
+static void *bench_block[KMALLOC_BENCH_SLOTS];
+static bool bench_large[KMALLOC_BENCH_SLOTS];
 
+/*
+ * kmalloc_bench - time random kmalloc/kfree of small (16~1024 bytes) and
+ * large (1~3 pages) blocks mixed 3:1, with up to KMALLOC_BENCH_SLOTS blocks
+ * alive, and check ksize of every block.
+ */
+static void
+kmalloc_bench(void) {
+    uint64_t alloc_cycles[2] = {0, 0}, free_cycles[2] = {0, 0}, start;
+    int nr_alloc[2] = {0, 0}, nr_free[2] = {0, 0}, nr_failed = 0;
+    int i, op, large;
+    srand(1);
+    for (op = 0; op < KMALLOC_BENCH_OPS; op ++) {
+        i = rand() % KMALLOC_BENCH_SLOTS;
+        if (bench_block[i] != NULL) {
+            large = bench_large[i];
+            start = read_tsc();
+            kfree(bench_block[i]);
+            free_cycles[large] += read_tsc() - start;
+            bench_block[i] = NULL, nr_free[large] ++;
+            continue;
+        }
+        large = (rand() % 4 == 0);
+        size_t size = large ? PAGE_SIZE + rand() % (2 * PAGE_SIZE) : 16 + rand() % 1009;
+        start = read_tsc();
+        bench_block[i] = kmalloc(size);
+        alloc_cycles[large] += read_tsc() - start;
+        if (bench_block[i] == NULL) {
+            nr_failed ++;
+            continue;
+        }
+        assert(ksize(bench_block[i]) >= size);
+        bench_large[i] = large, nr_alloc[large] ++;
+    }
+    for (i = 0; i < KMALLOC_BENCH_SLOTS; i ++) {
+        kfree(bench_block[i]);
+        bench_block[i] = NULL;
+    }
+
+    for (large = 0; large < 2; large ++) {
+        if (nr_alloc[large] > 0) {
+            do_div(alloc_cycles[large], nr_alloc[large]);
+        }
+        if (nr_free[large] > 0) {
+            do_div(free_cycles[large], nr_free[large]);
+        }
+        cprintf("kmalloc_bench: %s: alloc %llu cycles, free %llu cycles.\n",
+                large ? "large" : "small", alloc_cycles[large], free_cycles[large]);
+    }
+    assert(nr_failed == 0);
+}
 
@@ -134,6 +134,8 @@ struct Page {
     list_entry_t page_link;         // free list link
     list_entry_t pra_page_link;     // used for pra (page replace algorithm)
     uintptr_t pra_vaddr;            // used for pra (page replace algorithm)
+    size_t pra_time;                // virtual time the page was last seen referenced, used by wsclock
+    swap_entry_t pra_entry;         // the swap entry holding a copy of the page, if PageSwapCache
 };
 
 /* Flags describing the status of a page frame */
@@ -158,10 +160,30 @@ typedef struct {
 } free_area_t;
 
 /* for slab style kmalloc */
-//#define PG_slab                     2       // page frame is included in a slab
-//#define SetPageSlab(page)           set_bit(PG_slab, &((page)->flags))
-//#define ClearPageSlab(page)         clear_bit(PG_slab, &((page)->flags))
-//#define PageSlab(page)              test_bit(PG_slab, &((page)->flags))
+#define PG_slab                     2       // page frame is included in a slab
+#define SetPageSlab(page)           set_bit(PG_slab, &((page)->flags))
+#define ClearPageSlab(page)         clear_bit(PG_slab, &((page)->flags))
+#define PageSlab(page)              test_bit(PG_slab, &((page)->flags))
+
+/* for page-sized kmalloc blocks */
+#define PG_bigblock                 3       // the first page of a kmalloc block of 2^property pages
+#define SetPageBigblock(page)       set_bit(PG_bigblock, &((page)->flags))
+#define ClearPageBigblock(page)     clear_bit(PG_bigblock, &((page)->flags))
+#define PageBigblock(page)          test_bit(PG_bigblock, &((page)->flags))
+
+/* for swap */
+#define PG_swapcache                4       // the page holds a reference to the swap entry pra_entry
+#define SetPageSwapCache(page)      set_bit(PG_swapcache, &((page)->flags))
+#define ClearPageSwapCache(page)    clear_bit(PG_swapcache, &((page)->flags))
+#define PageSwapCache(page)         test_bit(PG_swapcache, &((page)->flags))
+#define PG_swappable                5       // the page is on the swappable list of the only mm mapping it
+#define SetPageSwappable(page)      set_bit(PG_swappable, &((page)->flags))
+#define ClearPageSwappable(page)    clear_bit(PG_swappable, &((page)->flags))
+#define PageSwappable(page)         test_bit(PG_swappable, &((page)->flags))
+#define PG_writeback                6       // the page is unmapped and being written to its swap entry
+#define SetPageWriteback(page)      set_bit(PG_writeback, &((page)->flags))
+#define ClearPageWriteback(page)    clear_bit(PG_writeback, &((page)->flags))
+#define PageWriteback(page)         test_bit(PG_writeback, &((page)->flags))
 
 #endif /* !__ASSEMBLER__ */
 
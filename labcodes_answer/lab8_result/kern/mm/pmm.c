@@ -6,6 +6,8 @@
 #include <memlayout.h>
 #include <pmm.h>
 #include <default_pmm.h>
+#include <buddy_pmm.h>
+#include <stdlib.h>
 #include <sync.h>
 #include <error.h>
 #include <swap.h>
@@ -140,7 +142,8 @@ gdt_init(void) {
 //init_pmm_manager - initialize a pmm_manager instance
 static void
 init_pmm_manager(void) {
-    pmm_manager = &default_pmm_manager;
+    // default_pmm_manager (first fit) also works here, see pmm_bench for the difference
+    pmm_manager = &buddy_pmm_manager;
     cprintf("memory management: %s\n", pmm_manager->name);
     pmm_manager->init();
 }
@@ -151,6 +154,19 @@ init_memmap(struct Page *base, size_t n) {
     pmm_manager->init_memmap(base, n);
 }
 
+// allocation requests and failures of alloc_pages, by the order of n
+static size_t pmm_alloc_num[PMM_NR_ORDER], pmm_alloc_failed[PMM_NR_ORDER];
+
+// pmm_order - the order of a block of n pages, the last order holds all larger ones
+static int
+pmm_order(size_t n) {
+    int order = 0;
+    while (order < PMM_NR_ORDER - 1 && ((size_t)1 << order) < n) {
+        order ++;
+    }
+    return order;
+}
+
 //alloc_pages - call pmm->alloc_pages to allocate a continuous n*PAGESIZE memory 
 struct Page *
 alloc_pages(size_t n) {
@@ -169,9 +185,30 @@ alloc_pages(size_t n) {
          
          extern struct mm_struct *check_mm_struct;
          //cprintf("page %x, call swap_out in alloc_pages %d\n",page, n);
-         swap_out(check_mm_struct, n, 0);
+         if (check_mm_struct != NULL) {
+              swap_out(check_mm_struct, n, 0);
+              continue;
+         }
+         // kswapd has not kept up: reclaim a page here, without sleeping on the
+         // swap device, as the caller may not expect alloc_pages to sleep
+         int nr;
+         local_intr_save(intr_flag);
+         {
+              nr = swap_reclaim(n);
+         }
+         local_intr_restore(intr_flag);
+         if (nr == 0) break;
+         swap_direct_num += nr;
+    }
+    if (swap_init_ok) {
+         kswapd_wakeup();
     }
     //cprintf("n %d,get page %x, No %d in alloc_pages\n",n,page,(page-pages));
+    int order = pmm_order(n);
+    pmm_alloc_num[order] ++;
+    if (page == NULL) {
+        pmm_alloc_failed[order] ++;
+    }
     return page;
 }
 
@@ -200,6 +237,163 @@ nr_free_pages(void) {
     return ret;
 }
 
+#define PMM_BENCH_NPAGES            4096            // pages handed to each manager by pmm_bench
+#define PMM_BENCH_SLOTS             256             // blocks held at the same time
+#define PMM_BENCH_OPS               8192            // timed alloc/free operations
+
+static struct Page *bench_block[PMM_BENCH_SLOTS];
+static size_t bench_size[PMM_BENCH_SLOTS];
+
+/*
+ * pmm_bench - compare the pmm managers on the free pages [base, base + n)
+ * before they are given to the real pmm_manager. Each manager gets the same
+ * pages, which are first fragmented by holding every other small block, then
+ * PMM_BENCH_OPS random allocations (1~16 pages) and frees are timed by tsc.
+ */
+static void
+pmm_bench(struct Page *base, size_t n) {
+    const struct pmm_manager *managers[] = {&default_pmm_manager, &buddy_pmm_manager};
+    struct Page *p;
+    int i, k, op;
+    if (n > PMM_BENCH_NPAGES) {
+        n = PMM_BENCH_NPAGES;
+    }
+    for (k = 0; k < sizeof(managers) / sizeof(managers[0]); k ++) {
+        const struct pmm_manager *m = managers[k];
+        m->init();
+        m->init_memmap(base, n);
+        srand(1);
+
+        /* fragment: fill all slots with 1~8 pages, then free the even ones */
+        for (i = 0; i < PMM_BENCH_SLOTS; i ++) {
+            bench_size[i] = rand() % 8 + 1;
+            if ((bench_block[i] = m->alloc_pages(bench_size[i])) == NULL) {
+                bench_size[i] = 0;
+            }
+        }
+        for (i = 0; i < PMM_BENCH_SLOTS; i += 2) {
+            if (bench_block[i] != NULL) {
+                m->free_pages(bench_block[i], bench_size[i]);
+                bench_block[i] = NULL;
+            }
+        }
+
+        uint64_t alloc_cycles = 0, free_cycles = 0, start;
+        int nr_alloc = 0, nr_free = 0, nr_failed = 0;
+        for (op = 0; op < PMM_BENCH_OPS; op ++) {
+            i = rand() % PMM_BENCH_SLOTS;
+            if (bench_block[i] != NULL) {
+                start = read_tsc();
+                m->free_pages(bench_block[i], bench_size[i]);
+                free_cycles += read_tsc() - start;
+                bench_block[i] = NULL, nr_free ++;
+            }
+            else {
+                bench_size[i] = rand() % 16 + 1;
+                start = read_tsc();
+                bench_block[i] = m->alloc_pages(bench_size[i]);
+                alloc_cycles += read_tsc() - start;
+                if (bench_block[i] != NULL) {
+                    nr_alloc ++;
+                }
+                else {
+                    nr_failed ++;
+                }
+            }
+        }
+
+        for (i = 0; i < PMM_BENCH_SLOTS; i ++) {
+            if (bench_block[i] != NULL) {
+                m->free_pages(bench_block[i], bench_size[i]);
+                bench_block[i] = NULL;
+            }
+        }
+        assert(m->nr_free_pages() == n);
+
+        if (nr_alloc + nr_failed > 0) {
+            do_div(alloc_cycles, nr_alloc + nr_failed);
+        }
+        if (nr_free > 0) {
+            do_div(free_cycles, nr_free);
+        }
+        cprintf("pmm_bench: %s: alloc %llu cycles, free %llu cycles, %d failed.\n",
+                m->name, alloc_cycles, free_cycles, nr_failed);
+
+        /* give the pages back as they were found */
+        for (p = base; p != base + n; p ++) {
+            p->flags = p->property = 0;
+            set_page_ref(p, 0);
+            SetPageReserved(p);
+        }
+    }
+    pmm_manager->init();
+}
+
+//pmm_free_stat - call pmm->free_stat to count the free blocks by order
+void
+pmm_free_stat(struct free_stat *stat) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        pmm_manager->free_stat(stat);
+    }
+    local_intr_restore(intr_flag);
+}
+
+/*
+ * pmm_format_stat - print the free block histogram, the allocation failures and
+ * the fragmentation of free memory by order into buf, return the length of the text.
+ *
+ * For a request of 2^order pages:
+ *   unusable - the part of free memory in blocks too small for it (0 ~ 1),
+ *   fragidx  - if it fails, whether because of fragmentation (near 1) or
+ *              lack of memory (near 0); '-' if a large enough block exists.
+ */
+int
+pmm_format_stat(char *buf, size_t len) {
+    struct free_stat stat;
+    pmm_free_stat(&stat);
+
+    size_t total_pages = 0, total_blocks = 0, total_failed = 0;
+    int order, n;
+    for (order = 0; order < PMM_NR_ORDER; order ++) {
+        total_pages += stat.nr_pages[order];
+        total_blocks += stat.nr_blocks[order];
+        total_failed += pmm_alloc_failed[order];
+    }
+    n = snprintf(buf, len, "%s: %u pages free in %u blocks, %u allocations failed\n"
+                 "order   blocks    pages   allocs  failed  unusable  fragidx\n",
+                 pmm_manager->name, total_pages, total_blocks, total_failed);
+
+    size_t large_pages = total_pages, large_blocks = total_blocks;
+    for (order = 0; order < PMM_NR_ORDER && n < len; order ++) {
+        int unusable = 0, fragidx = -1;
+        if (total_pages != 0) {
+            unusable = (total_pages - large_pages) * 1000 / total_pages;
+        }
+        if (large_blocks == 0 && total_blocks != 0) {
+            fragidx = 1000 - (1000 + total_pages * 1000 / (1 << order)) / total_blocks;
+            if (fragidx < 0) {
+                fragidx = 0;
+            }
+        }
+        n += snprintf(buf + n, len - n, "%5d %8u %8u %8u %7u     %d.%03d",
+                      order, stat.nr_blocks[order], stat.nr_pages[order],
+                      pmm_alloc_num[order], pmm_alloc_failed[order], unusable / 1000, unusable % 1000);
+        if (n < len) {
+            if (fragidx < 0) {
+                n += snprintf(buf + n, len - n, "        -\n");
+            }
+            else {
+                n += snprintf(buf + n, len - n, "    %d.%03d\n", fragidx / 1000, fragidx % 1000);
+            }
+        }
+        large_pages -= stat.nr_pages[order];
+        large_blocks -= stat.nr_blocks[order];
+    }
+    return (n < len) ? n : len - 1;
+}
+
 /* pmm_init - initialize the physical memory management */
 static void
 page_init(void) {
@@ -232,6 +426,7 @@ page_init(void) {
     }
 
     uintptr_t freemem = PADDR((uintptr_t)pages + sizeof(struct Page) * npage);
+    bool benched = 0;
 
     for (i = 0; i < memmap->nr_map; i ++) {
         uint64_t begin = memmap->map[i].addr, end = begin + memmap->map[i].size;
@@ -246,6 +441,10 @@ page_init(void) {
                 begin = ROUNDUP(begin, PGSIZE);
                 end = ROUNDDOWN(end, PGSIZE);
                 if (begin < end) {
+                    if (!benched) {
+                        pmm_bench(pa2page(begin), (end - begin) / PGSIZE);
+                        benched = 1;
+                    }
                     init_memmap(pa2page(begin), (end - begin) / PGSIZE);
                 }
             }
@@ -295,7 +494,7 @@ pmm_init(void) {
     //So a framework of physical memory manager (struct pmm_manager)is defined in pmm.h
     //First we should init a physical memory manager(pmm) based on the framework.
     //Then pmm can alloc/free the physical memory. 
-    //Now the first_fit/best_fit/worst_fit/buddy_system pmm are available.
+    //Now the first_fit and buddy_system pmm are available, buddy_system is used.
     init_pmm_manager();
 
     // detect physical memory space, reserve already used memory,
@@ -434,12 +633,21 @@ page_remove_pte(pde_t *pgdir, uintptr_t la, pte_t *ptep) {
 #endif
     if (*ptep & PTE_P) {
         struct Page *page = pte2page(*ptep);
+        if (PageSwappable(page)) {
+            swap_remove_page(page);
+        }
         if (page_ref_dec(page) == 0) {
+            swap_cache_release(page);
             free_page(page);
         }
         *ptep = 0;
         tlb_invalidate(pgdir, la);
     }
+    else if (*ptep != 0) {
+        // the page has been swapped out
+        swap_free(*ptep);
+        *ptep = 0;
+    }
 }
 
 void
@@ -475,10 +683,14 @@ exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end) {
         start += PTSIZE;
     } while (start != 0 && start < end);
 }
+// the number of pages shared copy-on-write by copy_range instead of being copied
+volatile unsigned int cow_share_num = 0;
+
 /* copy_range - copy content of memory (start, end) of one process A to another process B
  * @to:    the addr of process B's Page Directory
  * @from:  the addr of process A's Page Directory
- * @share: flags to indicate to dup OR share. We just use dup method, so it didn't be used.
+ * @share: flags to indicate to dup OR share. If share, the pages are mapped read-only
+ *         in both A and B (copy on write), do_pgfault copies them on the first write.
  *
  * CALL GRAPH: copy_mm-->dup_mmap-->copy_range
  */
@@ -495,14 +707,40 @@ copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool share) {
             continue ;
         }
         //call get_pte to find process B's pte according to the addr start. If pte is NULL, just alloc a PT
-        if (*ptep & PTE_P) {
+        if (*ptep != 0) {
             if ((nptep = get_pte(to, start, 1)) == NULL) {
                 return -E_NO_MEM;
             }
+        }
+        // look at *ptep only now, allocating the PT may have swapped the page out
+        if (*ptep != 0 && !(*ptep & PTE_P)) {
+            // B refers to the same swap entry, each one swaps in a private copy
+            swap_duplicate(*ptep);
+            *nptep = *ptep;
+        }
+        else if (*ptep & PTE_P) {
         uint32_t perm = (*ptep & PTE_USER);
         //get page from ptep
         struct Page *page = pte2page(*ptep);
-        // alloc a page for process B
+        if (share) {
+            // write-protect the page in A, and map the same page read-only in B
+            if (perm & PTE_W) {
+                *ptep &= ~PTE_W;
+                tlb_invalidate(from, start);
+                perm &= ~PTE_W;
+            }
+            if (page_insert(to, page, start, perm) != 0) {
+                return -E_NO_MEM;
+            }
+            cow_share_num ++;
+            start += PGSIZE;
+            continue;
+        }
+        // alloc a page for process B, which must not swap the page of A out
+        // under us: the page of A is not swappable from now on
+        if (PageSwappable(page)) {
+            swap_remove_page(page);
+        }
         struct Page *npage=alloc_page();
         assert(page!=NULL);
         assert(npage!=NULL);
@@ -567,6 +805,13 @@ page_insert(pde_t *pgdir, struct Page *page, uintptr_t la, uint32_t perm) {
             page_remove_pte(pgdir, la, ptep);
         }
     }
+    else if (*ptep != 0) {
+        page_remove_pte(pgdir, la, ptep);
+    }
+    // a swappable page is mapped by one mm only, a shared one can not be reclaimed
+    if (PageSwappable(page) && page_ref(page) > 1) {
+        swap_remove_page(page);
+    }
     *ptep = page2pa(page) | PTE_P | perm;
     tlb_invalidate(pgdir, la);
     return 0;
@@ -592,21 +837,8 @@ pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
             free_page(page);
             return NULL;
         }
-        if (swap_init_ok){
-            if(check_mm_struct!=NULL) {
-                swap_map_swappable(check_mm_struct, la, page, 0);
-                page->pra_vaddr=la;
-                assert(page_ref(page) == 1);
-                //cprintf("get No. %d  page: pra_vaddr %x, pra_link.prev %x, pra_link_next %x in pgdir_alloc_page\n", (page-pages), page->pra_vaddr,page->pra_page_link.prev, page->pra_page_link.next);
-            } 
-            else  {  //now current is existed, should fix it in the future
-                //swap_map_swappable(current->mm, la, page, 0);
-                //page->pra_vaddr=la;
-                //assert(page_ref(page) == 1);
-                //panic("pgdir_alloc_page: no pages. now current is existed, should fix it in the future\n");
-            }
-        }
-
+        // the caller makes the page swappable (see do_pgfault) once it is filled,
+        // so that it can not be swapped out meanwhile
     }
 
     return page;
@@ -615,6 +847,16 @@ pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm) {
 static void
 check_alloc_page(void) {
     pmm_manager->check();
+
+    struct free_stat stat;
+    size_t total = 0;
+    int order;
+    pmm_free_stat(&stat);
+    for (order = 0; order < PMM_NR_ORDER; order ++) {
+        assert(stat.nr_pages[order] >= stat.nr_blocks[order] << order);
+        total += stat.nr_pages[order];
+    }
+    assert(total == nr_free_pages());
     cprintf("check_alloc_page() succeeded!\n");
 }
 
@@ -7,6 +7,15 @@
 #include <atomic.h>
 #include <assert.h>
 
+#define PMM_NR_ORDER                11              // free blocks are counted by order 0 ~ 10 (the last one holds larger blocks)
+#define PMM_STAT_BUFSIZE            1024            // enough for the text of pmm_format_stat
+
+// free_stat - free blocks (and the pages in them) of 2^order ~ 2^(order+1)-1 pages
+struct free_stat {
+    size_t nr_blocks[PMM_NR_ORDER];
+    size_t nr_pages[PMM_NR_ORDER];
+};
+
 // pmm_manager is a physical memory management class. A special pmm manager - XXX_pmm_manager
 // only needs to implement the methods in pmm_manager class, then XXX_pmm_manager can be used
 // by ucore to manage the total physical memory space.
@@ -19,6 +28,7 @@ struct pmm_manager {
     struct Page *(*alloc_pages)(size_t n);            // allocate >=n pages, depend on the allocation algorithm 
     void (*free_pages)(struct Page *base, size_t n);  // free >=n pages with "base" addr of Page descriptor structures(memlayout.h)
     size_t (*nr_free_pages)(void);                    // return the number of free pages 
+    void (*free_stat)(struct free_stat *stat);        // count the free blocks by order
     void (*check)(void);                              // check the correctness of XXX_pmm_manager 
 };
 
@@ -31,6 +41,8 @@ void pmm_init(void);
 struct Page *alloc_pages(size_t n);
 void free_pages(struct Page *base, size_t n);
 size_t nr_free_pages(void);
+void pmm_free_stat(struct free_stat *stat);
+int pmm_format_stat(char *buf, size_t len);
 
 #define alloc_page() alloc_pages(1)
 #define free_page(page) free_pages(page, 1)
@@ -46,6 +58,7 @@ struct Page *pgdir_alloc_page(pde_t *pgdir, uintptr_t la, uint32_t perm);
 void unmap_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
 void exit_range(pde_t *pgdir, uintptr_t start, uintptr_t end);
 int copy_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end, bool share);
+extern volatile unsigned int cow_share_num;
 
 void print_pgdir(void);
 
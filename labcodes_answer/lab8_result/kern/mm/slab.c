@@ -0,0 +1,340 @@
+#include <defs.h>
+#include <list.h>
+#include <memlayout.h>
+#include <assert.h>
+#include <sync.h>
+#include <pmm.h>
+#include <kmalloc.h>
+#include <slab.h>
+#include <stdio.h>
+
+/* *
+ * Slab allocator: object caches for the most used kernel structures
+ *
+ * kmalloc keeps all its blocks in one first-fit list, which is walked on
+ * every allocation and every free. A kmem_cache holds objects of a single
+ * size instead, so an object is taken from and given back to a free index
+ * list of its slab in O(1), and objects of the same type are packed together.
+ *
+ * Layout of a slab (2^page_order pages):
+ *
+ *   | struct slab | bufctl[num] | pad | obj 0 | obj 1 | ... | obj num-1 |
+ *
+ * For objects of PGSIZE/8 bytes or more, struct slab and bufctl[] are
+ * kmalloc'ed instead, so the slab holds objects only. bufctl[i] is the index
+ * of the free object after object i, slab->free the first one.
+ *
+ * Every page of a slab is marked PG_slab, and its page_link, unused while the
+ * page is allocated, points to the cache (next) and to the slab (prev), so
+ * kmem_cache_free finds the slab of an object from its page.
+ *
+ * The lists of a cache are protected by disabling interrupts; pages are
+ * allocated and freed with interrupts restored.
+ * */
+
+struct slab {
+    list_entry_t slab_link;         // entry in slabs_full/slabs_partial of the cache
+    void *s_mem;                    // the first object
+    size_t inuse;                   // number of objects allocated
+    kmem_bufctl_t free;             // index of the first free object
+};
+
+#define BUFCTL_END                  ((kmem_bufctl_t)-1)
+
+#define slab_bufctl(slabp)          ((kmem_bufctl_t *)((struct slab *)(slabp) + 1))
+
+#define le2slab(le, member)                         \
+    to_struct((le), struct slab, member)
+
+#define SET_PAGE_CACHE(page, cachep)    ((page)->page_link.next = (list_entry_t *)(cachep))
+#define GET_PAGE_CACHE(page)            ((kmem_cache_t *)((page)->page_link.next))
+#define SET_PAGE_SLAB(page, slabp)      ((page)->page_link.prev = (list_entry_t *)(slabp))
+#define GET_PAGE_SLAB(page)             ((struct slab *)((page)->page_link.prev))
+
+// the list of all caches
+static list_entry_t cache_list;
+
+// kmem_cache_estimate - number of objects in a slab of bytes, and the offset of the first one
+static size_t
+kmem_cache_estimate(size_t bytes, size_t objsize, bool off_slab, size_t *offset) {
+    if (off_slab) {
+        *offset = 0;
+        return bytes / objsize;
+    }
+    size_t num = (bytes - sizeof(struct slab)) / (objsize + sizeof(kmem_bufctl_t));
+    while (num > 0 && ROUNDUP(sizeof(struct slab) + num * sizeof(kmem_bufctl_t), SLAB_OBJ_ALIGN)
+           + num * objsize > bytes) {
+        num --;
+    }
+    *offset = ROUNDUP(sizeof(struct slab) + num * sizeof(kmem_bufctl_t), SLAB_OBJ_ALIGN);
+    return num;
+}
+
+/*
+ * kmem_cache_create - create a cache of objects of size bytes
+ * @name: name of the cache, kept by reference
+ * @ctor: called for every object when its slab is created, may be NULL
+ */
+kmem_cache_t *
+kmem_cache_create(const char *name, size_t size, void (*ctor)(void *objp)) {
+    assert(size > 0 && size <= (PGSIZE << SLAB_MAX_ORDER));
+    kmem_cache_t *cachep;
+    if ((cachep = kmalloc(sizeof(kmem_cache_t))) == NULL) {
+        return NULL;
+    }
+    cachep->name = name;
+    cachep->objsize = ROUNDUP(size, SLAB_OBJ_ALIGN);
+    cachep->off_slab = (cachep->objsize >= PGSIZE / 8);
+    cachep->ctor = ctor;
+
+    /* the smallest slab which wastes no more than 1/8 of its space */
+    size_t order, num, offset;
+    for (order = 0; ; order ++) {
+        size_t bytes = PGSIZE << order;
+        num = kmem_cache_estimate(bytes, cachep->objsize, cachep->off_slab, &offset);
+        if (order == SLAB_MAX_ORDER || (num > 0 && (bytes - offset - num * cachep->objsize) * 8 <= bytes)) {
+            break;
+        }
+    }
+    assert(num > 0 && num < BUFCTL_END);
+    cachep->num = num, cachep->page_order = order, cachep->offset = offset;
+
+    list_init(&(cachep->slabs_full));
+    list_init(&(cachep->slabs_partial));
+    cachep->nr_active = cachep->nr_slabs = 0;
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_add_before(&cache_list, &(cachep->cache_link));
+    }
+    local_intr_restore(intr_flag);
+    return cachep;
+}
+
+/*
+ * kmem_cache_destroy - destroy a cache, all of its objects must have been freed
+ */
+void
+kmem_cache_destroy(kmem_cache_t *cachep) {
+    assert(list_empty(&(cachep->slabs_full)) && list_empty(&(cachep->slabs_partial)));
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_del(&(cachep->cache_link));
+    }
+    local_intr_restore(intr_flag);
+    kfree(cachep);
+}
+
+// kmem_cache_grow - create a new slab of cachep with all objects free and constructed
+static struct slab *
+kmem_cache_grow(kmem_cache_t *cachep) {
+    size_t i, npages = 1 << cachep->page_order;
+    struct Page *page;
+    if ((page = alloc_pages(npages)) == NULL) {
+        return NULL;
+    }
+    void *kva = page2kva(page);
+    struct slab *slabp;
+    if (cachep->off_slab) {
+        if ((slabp = kmalloc(sizeof(struct slab) + cachep->num * sizeof(kmem_bufctl_t))) == NULL) {
+            free_pages(page, npages);
+            return NULL;
+        }
+        slabp->s_mem = kva;
+    }
+    else {
+        slabp = kva;
+        slabp->s_mem = kva + cachep->offset;
+    }
+    slabp->inuse = 0;
+    slabp->free = 0;
+
+    kmem_bufctl_t *bufctl = slab_bufctl(slabp);
+    for (i = 0; i < cachep->num; i ++) {
+        bufctl[i] = i + 1;
+        if (cachep->ctor != NULL) {
+            cachep->ctor(slabp->s_mem + i * cachep->objsize);
+        }
+    }
+    bufctl[cachep->num - 1] = BUFCTL_END;
+
+    for (i = 0; i < npages; i ++) {
+        SetPageSlab(page + i);
+        SET_PAGE_CACHE(page + i, cachep);
+        SET_PAGE_SLAB(page + i, slabp);
+    }
+    return slabp;
+}
+
+// kmem_slab_destroy - give the pages of an empty slab back
+static void
+kmem_slab_destroy(kmem_cache_t *cachep, struct slab *slabp) {
+    size_t i, npages = 1 << cachep->page_order;
+    struct Page *page = kva2page(cachep->off_slab ? slabp->s_mem : (void *)slabp);
+    for (i = 0; i < npages; i ++) {
+        ClearPageSlab(page + i);
+        list_init(&(page[i].page_link));
+    }
+    free_pages(page, npages);
+    if (cachep->off_slab) {
+        kfree(slabp);
+    }
+}
+
+/*
+ * kmem_cache_alloc - allocate a constructed object from cachep
+ */
+void *
+kmem_cache_alloc(kmem_cache_t *cachep) {
+    struct slab *slabp;
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    while (list_empty(&(cachep->slabs_partial))) {
+        local_intr_restore(intr_flag);
+        if ((slabp = kmem_cache_grow(cachep)) == NULL) {
+            return NULL;
+        }
+        local_intr_save(intr_flag);
+        list_add(&(cachep->slabs_partial), &(slabp->slab_link));
+        cachep->nr_slabs ++;
+    }
+
+    slabp = le2slab(list_next(&(cachep->slabs_partial)), slab_link);
+    void *objp = slabp->s_mem + slabp->free * cachep->objsize;
+    slabp->free = slab_bufctl(slabp)[slabp->free];
+    slabp->inuse ++, cachep->nr_active ++;
+    if (slabp->free == BUFCTL_END) {
+        list_del(&(slabp->slab_link));
+        list_add(&(cachep->slabs_full), &(slabp->slab_link));
+    }
+    local_intr_restore(intr_flag);
+    return objp;
+}
+
+/*
+ * kmem_cache_free - give an object allocated from cachep back, in its constructed state
+ */
+void
+kmem_cache_free(kmem_cache_t *cachep, void *objp) {
+    struct Page *page = kva2page(objp);
+    assert(PageSlab(page) && GET_PAGE_CACHE(page) == cachep);
+    struct slab *slabp = GET_PAGE_SLAB(page);
+    size_t idx = (objp - slabp->s_mem) / cachep->objsize;
+    assert(idx < cachep->num && objp == slabp->s_mem + idx * cachep->objsize);
+
+    bool destroy = 0, intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (slabp->free == BUFCTL_END) {
+            list_del(&(slabp->slab_link));
+            list_add(&(cachep->slabs_partial), &(slabp->slab_link));
+        }
+        slab_bufctl(slabp)[idx] = slabp->free;
+        slabp->free = idx;
+        slabp->inuse --, cachep->nr_active --;
+        if (slabp->inuse == 0) {
+            list_del(&(slabp->slab_link));
+            cachep->nr_slabs --;
+            destroy = 1;
+        }
+    }
+    local_intr_restore(intr_flag);
+    if (destroy) {
+        kmem_slab_destroy(cachep, slabp);
+    }
+}
+
+void
+kmem_cache_print_stat(void) {
+    cprintf("cache            objsize  active   total  slabs  pages/slab\n");
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_entry_t *le = &cache_list;
+        while ((le = list_next(le)) != &cache_list) {
+            kmem_cache_t *cachep = to_struct(le, kmem_cache_t, cache_link);
+            cprintf("%-16s %7u %7u %7u %6u %11u\n", cachep->name, cachep->objsize, cachep->nr_active,
+                    cachep->nr_slabs * cachep->num, cachep->nr_slabs, 1 << cachep->page_order);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+struct check_obj {
+    uint32_t magic;
+    struct check_obj *next;
+    char data[92];
+};
+
+#define CHECK_MAGIC                 0x5ab5ab5a
+
+static size_t check_ctor_num;
+
+static void
+check_ctor(void *objp) {
+    ((struct check_obj *)objp)->magic = CHECK_MAGIC;
+    check_ctor_num ++;
+}
+
+static void
+check_kmem_cache(void) {
+    kmem_cache_t *cachep, *big_cachep;
+    assert((cachep = kmem_cache_create("check", sizeof(struct check_obj), check_ctor)) != NULL);
+    assert((big_cachep = kmem_cache_create("check-big", 1024, NULL)) != NULL);
+    assert(!cachep->off_slab && cachep->objsize == sizeof(struct check_obj) && cachep->num > 1);
+    assert(big_cachep->off_slab && big_cachep->page_order == 0 && big_cachep->num == PGSIZE / 1024);
+
+    size_t nr_free_pages_store = nr_free_pages();
+
+    /* one object more than a slab holds: two slabs, all objects constructed */
+    struct check_obj *head = NULL, *obj;
+    int i;
+    check_ctor_num = 0;
+    for (i = 0; i <= cachep->num; i ++) {
+        assert((obj = kmem_cache_alloc(cachep)) != NULL);
+        assert(obj->magic == CHECK_MAGIC && ((uintptr_t)obj % SLAB_OBJ_ALIGN) == 0);
+        obj->next = head, head = obj;
+    }
+    assert(cachep->nr_slabs == 2 && cachep->nr_active == cachep->num + 1);
+    assert(check_ctor_num == 2 * cachep->num);
+    assert(nr_free_pages_store == nr_free_pages() + 2);
+
+    /* freed objects are reused first, without calling ctor again */
+    obj = head, head = head->next;
+    kmem_cache_free(cachep, obj);
+    assert(kmem_cache_alloc(cachep) == obj && check_ctor_num == 2 * cachep->num);
+    obj->next = head, head = obj;
+
+    /* empty slabs go back to pmm */
+    while ((obj = head) != NULL) {
+        head = obj->next;
+        kmem_cache_free(cachep, obj);
+    }
+    assert(cachep->nr_slabs == 0 && cachep->nr_active == 0);
+    assert(nr_free_pages_store == nr_free_pages());
+
+    void *objs[PGSIZE / 1024 + 1];
+    for (i = 0; i <= big_cachep->num; i ++) {
+        assert((objs[i] = kmem_cache_alloc(big_cachep)) != NULL);
+        assert(PageSlab(kva2page(objs[i])) && ((uintptr_t)objs[i] % 1024) == 0);
+    }
+    assert(big_cachep->nr_slabs == 2 && ROUNDDOWN(objs[0], PGSIZE) == ROUNDDOWN(objs[1], PGSIZE));
+    for (i = 0; i <= big_cachep->num; i ++) {
+        kmem_cache_free(big_cachep, objs[i]);
+    }
+    assert(big_cachep->nr_slabs == 0 && !PageSlab(kva2page(objs[0])));
+    assert(nr_free_pages_store == nr_free_pages());
+
+    kmem_cache_destroy(cachep);
+    kmem_cache_destroy(big_cachep);
+    cprintf("check_kmem_cache() succeeded!\n");
+}
+
+void
+kmem_cache_init(void) {
+    list_init(&cache_list);
+    check_kmem_cache();
+}
+
@@ -0,0 +1,45 @@
+#ifndef __KERN_MM_SLAB_CACHE_H__
+#define __KERN_MM_SLAB_CACHE_H__
+
+#include <defs.h>
+#include <list.h>
+
+#define SLAB_MAX_ORDER              3               // a slab is at most 2^3 pages
+#define SLAB_OBJ_ALIGN              8               // objects are 8-byte aligned
+
+typedef uint16_t kmem_bufctl_t;                     // index of the next free object in a slab
+
+/* *
+ * kmem_cache_t - a cache of objects of one type and size. Objects are carved
+ * out of slabs of 2^page_order pages; a slab is on slabs_partial while it has
+ * free objects and on slabs_full otherwise, and is given back to pmm as soon
+ * as all of its objects are freed. The slab descriptor sits at the start of
+ * the slab, or is kmalloc'ed (off_slab) for large objects.
+ *
+ * ctor is called once per object when its slab is created, so an object is in
+ * its constructed state when allocated, and must be freed in that state.
+ * */
+typedef struct kmem_cache {
+    const char *name;
+    size_t objsize;                 // size of an object, aligned
+    size_t num;                     // number of objects in a slab
+    size_t page_order;              // pages of a slab = 2^page_order
+    size_t offset;                  // offset of the first object in a slab
+    bool off_slab;                  // the slab descriptor is out of the slab
+    void (*ctor)(void *objp);       // constructor, may be NULL
+    list_entry_t slabs_full;        // slabs without free objects
+    list_entry_t slabs_partial;     // slabs with free objects
+    size_t nr_active;               // objects allocated
+    size_t nr_slabs;                // slabs held by this cache
+    list_entry_t cache_link;        // entry in the list of all caches
+} kmem_cache_t;
+
+void kmem_cache_init(void);
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, void (*ctor)(void *objp));
+void kmem_cache_destroy(kmem_cache_t *cachep);
+void *kmem_cache_alloc(kmem_cache_t *cachep);
+void kmem_cache_free(kmem_cache_t *cachep, void *objp);
+void kmem_cache_print_stat(void);
+
+#endif /* !__KERN_MM_SLAB_CACHE_H__ */
+
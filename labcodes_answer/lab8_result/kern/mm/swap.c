@@ -1,6 +1,9 @@
 #include <swap.h>
 #include <swapfs.h>
+#include <zswap.h>
 #include <swap_fifo.h>
+#include <swap_clock.h>
+#include <swap_wsclock.h>
 #include <stdio.h>
 #include <string.h>
 #include <memlayout.h>
@@ -8,6 +11,11 @@
 #include <mmu.h>
 #include <default_pmm.h>
 #include <kdebug.h>
+#include <kmalloc.h>
+#include <error.h>
+#include <sync.h>
+#include <proc.h>
+#include <sched.h>
 
 // the valid vaddr for check is between 0~CHECK_VALID_VADDR-1
 #define CHECK_VALID_VIR_PAGE_NUM 5
@@ -21,6 +29,15 @@
 static struct swap_manager *sm;
 size_t max_swap_offset;
 
+// all swap managers, each one is checked and benchmarked by swap_init
+static struct swap_manager *swap_managers[] = {
+     &swap_manager_fifo,
+     &swap_manager_clock,
+     &swap_manager_wsclock,
+};
+
+#define NR_SWAP_MANAGERS        (sizeof(swap_managers) / sizeof(swap_managers[0]))
+
 volatile int swap_init_ok = 0;
 
 unsigned int swap_page[CHECK_VALID_VIR_PAGE_NUM];
@@ -28,6 +45,44 @@ unsigned int swap_page[CHECK_VALID_VIR_PAGE_NUM];
 unsigned int swap_in_seq_no[MAX_SEQ_NO],swap_out_seq_no[MAX_SEQ_NO];
 
 static void check_swap(void);
+static void check_reclaim(void);
+static void swap_bench(void);
+static int kswapd(void *arg);
+
+// references to each swap slot, see swap.h; swap_alloc searches from swap_next_offset
+static unsigned short *swap_map;
+static size_t swap_next_offset;
+// the number of slots in use
+size_t swap_nr_used;
+
+/* *
+ * Swap slots are handed out by clusters of SWAP_CLUSTER aligned slots: swap_alloc
+ * fills the cluster it has taken from the first slot to the last before it takes
+ * another free one, so the pages swap_out writes together get consecutive slots,
+ * are written by one request, and are read back by one request of swap_in. Only
+ * when no cluster is free, swap_alloc takes any free slot after the one taken last.
+ * */
+static unsigned char *swap_cluster_used;        // slots in use in each cluster
+static size_t swap_nr_cluster;
+static size_t swap_cluster_offset, swap_cluster_left;   // the next slot of the cluster taken, and how many are left
+static size_t swap_cluster_next;                // the next cluster to look at
+
+// pages unmapped by swap_out which still own their swap entry: being written to it, or
+// failed to be; swap_in copies such a page instead of reading the swap device
+static list_entry_t swap_writeback_list;
+
+// pages read ahead by swap_in, not mapped yet, oldest first; each holds its swap entry
+static list_entry_t swap_ra_list;
+size_t swap_ra_nr;
+
+// bounce buffers of SWAP_CLUSTER pages for the reads ahead and the writes of clusters
+static char *swap_rbuf, *swap_wbuf;
+static bool swap_rbuf_busy, swap_wbuf_busy;
+
+static struct proc_struct *kswapd_proc;
+size_t swap_low_watermark, swap_high_watermark;
+// kswapd wakeups, pages kswapd swapped out, and pages swapped out by alloc_pages itself
+volatile unsigned int kswapd_wakeup_num = 0, kswapd_reclaim_num = 0, swap_direct_num = 0;
 
 int
 swap_init(void)
@@ -38,19 +93,64 @@ swap_init(void)
      {
           panic("bad max_swap_offset %08x.\n", max_swap_offset);
      }
-     
+     if ((swap_map = kmalloc(max_swap_offset * sizeof(swap_map[0]))) == NULL)
+     {
+          panic("swap: alloc swap_map failed.\n");
+     }
+     memset(swap_map, 0, max_swap_offset * sizeof(swap_map[0]));
+     swap_next_offset = 1;
+     swap_nr_cluster = max_swap_offset / SWAP_CLUSTER;
+     if ((swap_cluster_used = kmalloc(swap_nr_cluster)) == NULL)
+     {
+          panic("swap: alloc swap_cluster_used failed.\n");
+     }
+     memset(swap_cluster_used, 0, swap_nr_cluster);
+     // slot 0 is no swap entry, its cluster is never taken
+     swap_cluster_used[0] = 1;
+     list_init(&swap_writeback_list);
+     list_init(&swap_ra_list);
 
-     sm = &swap_manager_fifo;
-     int r = sm->init();
-     
-     if (r == 0)
+     struct Page *rbuf, *wbuf;
+     if ((rbuf = alloc_pages(SWAP_CLUSTER)) == NULL || (wbuf = alloc_pages(SWAP_CLUSTER)) == NULL)
+     {
+          panic("swap: alloc cluster buffers failed.\n");
+     }
+     swap_rbuf = page2kva(rbuf), swap_wbuf = page2kva(wbuf);
+
+     int i, r;
+     for (i = 0; i < NR_SWAP_MANAGERS; i ++)
      {
+          sm = swap_managers[i];
+          if ((r = sm->init()) != 0)
+          {
+               return r;
+          }
           swap_init_ok = 1;
-          cprintf("SWAP: manager = %s\n", sm->name);
+          cprintf("SWAP: check %s\n", sm->name);
           check_swap();
      }
+     swap_bench();
 
-     return r;
+     sm = &swap_manager_clock;
+     if ((r = sm->init()) != 0)
+     {
+          return r;
+     }
+     cprintf("SWAP: manager = %s\n", sm->name);
+     check_reclaim();
+     zswap_init();
+
+     size_t total = nr_free_pages();
+     swap_low_watermark = total / KSWAPD_LOW_RATIO;
+     swap_high_watermark = total / KSWAPD_HIGH_RATIO;
+     int pid;
+     if ((pid = kernel_daemon(kswapd, NULL, "kswapd")) <= 0)
+     {
+          panic("swap: create kswapd failed.\n");
+     }
+     kswapd_proc = find_proc(pid);
+     cprintf("SWAP: kswapd watermarks low %d, high %d pages\n", swap_low_watermark, swap_high_watermark);
+     return 0;
 }
 
 int
@@ -65,74 +165,530 @@ swap_tick_event(struct mm_struct *mm)
      return sm->tick_event(mm);
 }
 
+// swap_map_swappable - let the swap manager reclaim page, if it is mapped at addr by mm only
 int
 swap_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
 {
+     if (mm->sm_priv == NULL || PageSwappable(page) || page_ref(page) != 1)
+     {
+          return 0;
+     }
+     page->pra_vaddr = addr;
+     SetPageSwappable(page);
      return sm->map_swappable(mm, addr, page, swap_in);
 }
 
+// swap_remove_page - take page off the swappable list, it is being unmapped or shared
+void
+swap_remove_page(struct Page *page)
+{
+     assert(PageSwappable(page));
+     list_del(&(page->pra_page_link));
+     ClearPageSwappable(page);
+}
+
 int
 swap_set_unswappable(struct mm_struct *mm, uintptr_t addr)
 {
      return sm->set_unswappable(mm, addr);
 }
 
-volatile unsigned int swap_out_num=0;
+// swap_cluster_reserve - take a new cluster at the next swap_alloc, if fewer than nr slots are left
+static void
+swap_cluster_reserve(size_t nr)
+{
+     if (swap_cluster_left < nr)
+     {
+          swap_cluster_left = 0;
+     }
+}
+
+// swap_alloc - take a free swap slot, see above; return its swap entry with one
+//            - reference, or 0 if swap is full
+swap_entry_t
+swap_alloc(void)
+{
+     size_t offset, i, c;
+     if (swap_cluster_left == 0)
+     {
+          for (i = 0, c = swap_cluster_next; i < swap_nr_cluster; i ++, c ++)
+          {
+               if (c >= swap_nr_cluster)
+               {
+                    c = 0;
+               }
+               if (swap_cluster_used[c] == 0)
+               {
+                    swap_cluster_offset = c * SWAP_CLUSTER;
+                    swap_cluster_left = SWAP_CLUSTER;
+                    swap_cluster_next = c + 1;
+                    break;
+               }
+          }
+     }
+     if (swap_cluster_left > 0)
+     {
+          offset = swap_cluster_offset ++;
+          swap_cluster_left --;
+          assert(swap_map[offset] == 0);
+          goto found;
+     }
+     for (i = 1, offset = swap_next_offset; i < max_swap_offset; i ++, offset ++)
+     {
+          if (offset >= max_swap_offset)
+          {
+               offset = 1;
+          }
+          if (swap_map[offset] == 0)
+          {
+               swap_next_offset = offset + 1;
+               goto found;
+          }
+     }
+     return 0;
+
+found:
+     swap_map[offset] = 1;
+     swap_nr_used ++;
+     if (offset / SWAP_CLUSTER < swap_nr_cluster)
+     {
+          swap_cluster_used[offset / SWAP_CLUSTER] ++;
+     }
+     return offset << 8;
+}
+
+void
+swap_duplicate(swap_entry_t entry)
+{
+     size_t offset = swap_offset(entry);
+     assert(swap_map[offset] > 0 && swap_map[offset] < SWAP_MAP_MAX);
+     swap_map[offset] ++;
+}
+
+static struct Page *swap_cache_lookup(list_entry_t *list, swap_entry_t entry);
+static void swap_page_free(struct Page *page);
+static void swap_ra_drop(struct Page *page);
+
+void
+swap_free(swap_entry_t entry)
+{
+     size_t offset = swap_offset(entry);
+     assert(swap_map[offset] > 0);
+     if (-- swap_map[offset] == 0)
+     {
+          swap_nr_used --;
+          if (offset / SWAP_CLUSTER < swap_nr_cluster)
+          {
+               swap_cluster_used[offset / SWAP_CLUSTER] --;
+          }
+          zswap_invalidate(entry);
+     }
+     else if (swap_map[offset] == 1)
+     {
+          // nobody refers to a page read ahead or whose write failed any more
+          struct Page *page;
+          if ((page = swap_cache_lookup(&swap_ra_list, entry)) != NULL)
+          {
+               swap_ra_drop(page);
+          }
+          else if ((page = swap_cache_lookup(&swap_writeback_list, entry)) != NULL
+                   && !PageWriteback(page))
+          {
+               list_del(&(page->pra_page_link));
+               swap_page_free(page);
+          }
+     }
+}
+
+// swap_cache_release - drop the reference of page to its swap entry
+void
+swap_cache_release(struct Page *page)
+{
+     if (PageSwapCache(page))
+     {
+          ClearPageSwapCache(page);
+          swap_free(page->pra_entry);
+          page->pra_entry = 0;
+     }
+}
+
+// swap_cache_lookup - find the page owning entry on list (swap_writeback_list or swap_ra_list)
+static struct Page *
+swap_cache_lookup(list_entry_t *list, swap_entry_t entry)
+{
+     list_entry_t *le = list;
+     while ((le = list_next(le)) != list)
+     {
+          struct Page *page = le2page(le, pra_page_link);
+          if (page->pra_entry == entry)
+          {
+               return page;
+          }
+     }
+     return NULL;
+}
+
+// swap_page_free - free an unmapped page which swap_out holds the last reference to
+static void
+swap_page_free(struct Page *page)
+{
+     assert(page_ref(page) == 1);
+     set_page_ref(page, 0);
+     swap_cache_release(page);
+     free_page(page);
+}
+
+// swap_ra_drop - free a page read ahead, nobody has faulted it in
+static void
+swap_ra_drop(struct Page *page)
+{
+     assert(page_ref(page) == 0);
+     list_del(&(page->pra_page_link));
+     swap_ra_nr --;
+     swap_cache_release(page);
+     free_page(page);
+}
+
+//number of pages swapped in, swapped out, and written to swap when swapped out
+volatile unsigned int swap_in_num=0, swap_out_num=0, swap_write_num=0;
+//read and write requests to the swap device, pages read ahead and faulted in later
+volatile unsigned int swap_read_io=0, swap_write_io=0, swap_ra_num=0, swap_ra_hit=0;
+
+/* *
+ * swap_writepages - write the nr unmapped pages swap_out has put on
+ * swap_writeback_list, and free them. The pages zswap takes never reach the
+ * swap device; of the others, pages in consecutive slots are copied to
+ * swap_wbuf and written by one request.
+ * */
+static void
+swap_writepages(struct Page **pages, int nr)
+{
+     int i, j, r, nr_disk = 0;
+     for (i = 0; i < nr; i ++)
+     {
+          struct Page *page = pages[i];
+          if (zswap_store(page->pra_entry, page) != 0)
+          {
+               pages[nr_disk ++] = page;
+               continue;
+          }
+          ClearPageWriteback(page);
+          swap_write_num ++;
+          list_del(&(page->pra_page_link));
+          swap_page_free(page);
+     }
+     nr = nr_disk;
+     for (i = 0; i < nr; i = j)
+     {
+          swap_entry_t entry = pages[i]->pra_entry;
+          for (j = i + 1; j < nr && pages[j]->pra_entry == entry + ((j - i) << 8); j ++)
+               /* nothing */ ;
+          if (j - i > 1 && !swap_wbuf_busy)
+          {
+               swap_wbuf_busy = 1;
+               int k;
+               for (k = i; k < j; k ++)
+               {
+                    memcpy(swap_wbuf + (k - i) * PGSIZE, page2kva(pages[k]), PGSIZE);
+               }
+               r = swapfs_write_cluster(entry, swap_wbuf, j - i);
+               swap_wbuf_busy = 0;
+          }
+          else
+          {
+               j = i + 1;
+               r = swapfs_write(entry, pages[i]);
+          }
+          swap_write_io ++;
+          for (; i < j; i ++)
+          {
+               struct Page *page = pages[i];
+               ClearPageWriteback(page);
+               if (r != 0)
+               {
+                    // keep the page until nobody refers to its swap entry any more
+                    cprintf("SWAP: failed to save\n");
+                    if (swap_map[swap_offset(page->pra_entry)] == 1)
+                    {
+                         list_del(&(page->pra_page_link));
+                         swap_page_free(page);
+                    }
+                    continue;
+               }
+               swap_write_num ++;
+               list_del(&(page->pra_page_link));
+               swap_page_free(page);
+          }
+     }
+}
 
+/* *
+ * swap_out - swap out n pages of mm chosen by the swap manager, SWAP_CLUSTER at
+ * a time: they are unmapped (their ptes hold the swap entries now) before they
+ * are written, so the process can not change them while the writes sleep on the
+ * swap device; if the process needs one meanwhile, swap_in copies it from
+ * swap_writeback_list. mm may go away while the writes sleep, so a caller not
+ * holding mm passes n <= SWAP_CLUSTER.
+ * */
 int
 swap_out(struct mm_struct *mm, int n, int in_tick)
 {
-     int i;
-     for (i = 0; i != n; ++ i)
+     int i = 0;
+     while (i != n)
      {
-          uintptr_t v;
-          //struct Page **ptr_page=NULL;
-          struct Page *page;
-          // cprintf("i %d, SWAP: call swap_out_victim\n",i);
-          int r = sm->swap_out_victim(mm, &page, in_tick);
-          if (r != 0) {
+          struct Page *pages[SWAP_CLUSTER];
+          int nr = 0, batch = (n - i < SWAP_CLUSTER) ? n - i : SWAP_CLUSTER;
+          swap_cluster_reserve(batch);
+          for (; batch > 0; batch --)
+          {
+               uintptr_t v;
+               //struct Page **ptr_page=NULL;
+               struct Page *page;
+               if (list_empty(&(mm->pra_list))) {
+                    break;
+               }
+               // cprintf("i %d, SWAP: call swap_out_victim\n",i);
+               int r = sm->swap_out_victim(mm, &page, in_tick);
+               if (r != 0) {
                     cprintf("i %d, swap_out: call swap_out_victim failed\n",i);
-                  break;
-          }          
-          //assert(!PageReserved(page));
+                    break;
+               }
+               //assert(!PageReserved(page));
+               ClearPageSwappable(page);
 
-          //cprintf("SWAP: choose victim page 0x%08x\n", page);
-          
-          v=page->pra_vaddr; 
-          pte_t *ptep = get_pte(mm->pgdir, v, 0);
-          assert((*ptep & PTE_P) != 0);
+               //cprintf("SWAP: choose victim page 0x%08x\n", page);
 
-          if (swapfs_write( (page->pra_vaddr/PGSIZE+1)<<8, page) != 0) {
-                    cprintf("SWAP: failed to save\n");
-                    sm->map_swappable(mm, v, page, 0);
+               v=page->pra_vaddr;
+               pte_t *ptep = get_pte(mm->pgdir, v, 0);
+               assert(ptep != NULL && (*ptep & PTE_P) != 0);
+               assert(pte2page(*ptep) == page && page_ref(page) == 1);
+
+               // a page not written since it was swapped in is still at its swap entry
+               bool dirty = swap_page_dirty(*ptep, page);
+               if (dirty) {
+                    swap_entry_t entry;
+                    if ((entry = swap_alloc()) == 0) {
+                         cprintf("SWAP: no free swap slot\n");
+                         swap_map_swappable(mm, v, page, 0);
+                         break;
+                    }
+                    swap_cache_release(page);
+                    page->pra_entry = entry;
+                    SetPageSwapCache(page);
+               }
+               swap_duplicate(page->pra_entry);
+               *ptep = page->pra_entry;
+               tlb_invalidate(mm->pgdir, v);
+               swap_out_num ++;
+               i ++;
+
+               if (!dirty) {
+                    swap_page_free(page);
                     continue;
+               }
+               SetPageWriteback(page);
+               list_add_before(&swap_writeback_list, &(page->pra_page_link));
+               pages[nr ++] = page;
           }
-          else {
-                    cprintf("swap_out: i %d, store page in vaddr 0x%x to disk swap entry %d\n", i, v, page->pra_vaddr/PGSIZE+1);
-                    *ptep = (page->pra_vaddr/PGSIZE+1)<<8;
-                    free_page(page);
+          swap_writepages(pages, nr);
+          if (batch > 0) {
+               break;
           }
-          
-          tlb_invalidate(mm->pgdir, v);
      }
      return i;
 }
 
+/* *
+ * swap_reclaim - free up to n pages: first the pages read ahead which nobody
+ * has faulted in, then swap out up to SWAP_CLUSTER pages from each mm with
+ * swappable pages in turn; the mm pages are taken from goes to the back of
+ * mm_list. Return the number of pages freed, fewer than n only if there is
+ * nothing left to swap out.
+ * */
 int
-swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result)
+swap_reclaim(int n)
+{
+     int nr = 0;
+     while (nr < n && !list_empty(&swap_ra_list))
+     {
+          swap_ra_drop(le2page(list_next(&swap_ra_list), pra_page_link));
+          nr ++;
+     }
+     while (nr < n)
+     {
+          struct mm_struct *mm = NULL;
+          list_entry_t *le = &mm_list;
+          bool intr_flag;
+          local_intr_save(intr_flag);
+          {
+               while ((le = list_next(le)) != &mm_list)
+               {
+                    if (!list_empty(&(le2mm(le, mm_link)->pra_list)))
+                    {
+                         mm = le2mm(le, mm_link);
+                         list_del(le);
+                         list_add_before(&mm_list, le);
+                         break;
+                    }
+               }
+          }
+          local_intr_restore(intr_flag);
+          int batch = (n - nr < SWAP_CLUSTER) ? n - nr : SWAP_CLUSTER, r;
+          if (mm == NULL || (r = swap_out(mm, batch, 0)) == 0)
+          {
+               break;
+          }
+          nr += r;
+     }
+     return nr;
+}
+
+// kswapd_wakeup - wake kswapd up if free pages have dropped below the low watermark
+void
+kswapd_wakeup(void)
+{
+     struct proc_struct *proc = kswapd_proc;
+     if (proc != NULL && nr_free_pages() < swap_low_watermark)
+     {
+          bool intr_flag;
+          local_intr_save(intr_flag);
+          if (proc->state == PROC_SLEEPING && proc->wait_state == WT_KSWAPD)
+          {
+               wakeup_proc(proc);
+          }
+          local_intr_restore(intr_flag);
+     }
+}
+
+/* *
+ * kswapd - the kernel thread swapping pages out in the background: woken up
+ * by kswapd_wakeup, it reclaims pages of all mms until the high watermark is
+ * reached, sleeping on the swap device instead of the allocating process.
+ * */
+static int
+kswapd(void *arg)
+{
+     while (1)
+     {
+          bool intr_flag;
+          local_intr_save(intr_flag);
+          {
+               current->state = PROC_SLEEPING;
+               current->wait_state = WT_KSWAPD;
+          }
+          local_intr_restore(intr_flag);
+
+          schedule();
+
+          kswapd_wakeup_num ++;
+          int r;
+          while (nr_free_pages() < swap_high_watermark && (r = swap_reclaim(SWAP_CLUSTER)) > 0)
+          {
+               kswapd_reclaim_num += r;
+          }
+     }
+     return 0;
+}
+
+/* *
+ * swap_read - read the page at entry into page, from zswap if it is there.
+ * The slots in use following entry, up to a cluster, come along in the same
+ * request from the swap device if memory allows:
+ * they are likely to be needed soon (see swap_alloc), so they wait on
+ * swap_ra_list, not mapped, for a fault to take them (see swap_in).
+ * */
+static int
+swap_read(swap_entry_t entry, struct Page *page)
 {
-     struct Page *result = alloc_page();
-     assert(result!=NULL);
+     size_t offset = swap_offset(entry), nr = 1, i;
+     if (zswap_load(entry, page) == 0)
+     {
+          return 0;
+     }
+     if (!swap_rbuf_busy && nr_free_pages() > swap_low_watermark + SWAP_CLUSTER)
+     {
+          for (; nr < SWAP_CLUSTER && offset + nr < max_swap_offset; nr ++)
+          {
+               swap_entry_t e = (offset + nr) << 8;
+               if (swap_map[offset + nr] == 0 || swap_cache_lookup(&swap_ra_list, e) != NULL
+                   || swap_cache_lookup(&swap_writeback_list, e) != NULL || zswap_contains(e))
+               {
+                    break;
+               }
+          }
+     }
+     int r;
+     swap_read_io ++;
+     if (nr == 1)
+     {
+          return swapfs_read(entry, page);
+     }
+     swap_rbuf_busy = 1;
+     if ((r = swapfs_read_cluster(entry, swap_rbuf, nr)) == 0)
+     {
+          memcpy(page2kva(page), swap_rbuf, PGSIZE);
+          for (i = 1; i < nr; i ++)
+          {
+               struct Page *p;
+               // alloc_page may have freed the slot with the page holding it
+               if (swap_map[offset + i] == 0 || (p = alloc_page()) == NULL)
+               {
+                    break;
+               }
+               memcpy(page2kva(p), swap_rbuf + i * PGSIZE, PGSIZE);
+               p->pra_entry = (offset + i) << 8;
+               swap_duplicate(p->pra_entry);
+               SetPageSwapCache(p);
+               list_add_before(&swap_ra_list, &(p->pra_page_link));
+               swap_ra_num ++;
+               if (++ swap_ra_nr > SWAP_RA_MAX)
+               {
+                    swap_ra_drop(le2page(list_next(&swap_ra_list), pra_page_link));
+               }
+          }
+     }
+     swap_rbuf_busy = 0;
+     return r;
+}
 
+int
+swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result)
+{
      pte_t *ptep = get_pte(mm->pgdir, addr, 0);
+     swap_entry_t entry = *ptep;
+     struct Page *result, *page;
+
+     // read ahead by an earlier swap_in: it holds the reference to entry already
+     if ((result = swap_cache_lookup(&swap_ra_list, entry)) != NULL)
+     {
+          list_del(&(result->pra_page_link));
+          swap_ra_nr --;
+          swap_ra_hit ++;
+          swap_in_num ++;
+          *ptr_result = result;
+          return 0;
+     }
+
+     if ((result = alloc_page()) == NULL)
+     {
+          return -E_NO_MEM;
+     }
      // cprintf("SWAP: load ptep %x swap entry %d to vaddr 0x%08x, page %x, No %d\n", ptep, (*ptep)>>8, addr, result, (result-pages));
     
      int r;
-     if ((r = swapfs_read((*ptep), result)) != 0)
+     if ((page = swap_cache_lookup(&swap_writeback_list, entry)) != NULL)
      {
-        assert(r!=0);
+          memcpy(page2kva(result), page2kva(page), PGSIZE);
      }
-     cprintf("swap_in: load disk swap entry %d with swap_page in vadr 0x%x\n", (*ptep)>>8, addr);
+     else if ((r = swap_read(entry, result)) != 0)
+     {
+          free_page(result);
+          return r;
+     }
+     swap_duplicate(entry);
+     result->pra_entry = entry;
+     SetPageSwapCache(result);
+     swap_in_num ++;
      *ptr_result=result;
      return 0;
 }
@@ -171,24 +727,13 @@ struct Page * check_rp[CHECK_VALID_PHY_PAGE_NUM];
 pte_t * check_ptep[CHECK_VALID_PHY_PAGE_NUM];
 unsigned int check_swap_addr[CHECK_VALID_VIR_PAGE_NUM];
 
-extern free_area_t free_area;
-
-#define free_list (free_area.free_list)
-#define nr_free (free_area.nr_free)
-
 static void
 check_swap(void)
 {
     //backup mem env
-     int ret, count = 0, total = 0, i;
-     list_entry_t *le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-        struct Page *p = le2page(le, page_link);
-        assert(PageProperty(p));
-        count ++, total += p->property;
-     }
-     assert(total == nr_free_pages());
-     cprintf("BEGIN check_swap: count %d, total %d\n",count,total);
+     int ret, count = 0, total = nr_free_pages(), i;
+     size_t swap_nr_used_store = swap_nr_used;
+     cprintf("BEGIN check_swap: total %d\n",total);
      
      //now we set the phy pages env     
      struct mm_struct *mm = mm_create();
@@ -214,23 +759,27 @@ check_swap(void)
      assert(temp_ptep!= NULL);
      cprintf("setup Page Table vaddr 0~4MB OVER!\n");
      
+     struct Page *check_base = alloc_pages(CHECK_VALID_PHY_PAGE_NUM);
+     assert(check_base != NULL);
      for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
-          check_rp[i] = alloc_page();
-          assert(check_rp[i] != NULL );
+          check_rp[i] = check_base + i;
           assert(!PageProperty(check_rp[i]));
      }
-     list_entry_t free_list_store = free_list;
-     list_init(&free_list);
-     assert(list_empty(&free_list));
-     
-     //assert(alloc_page() == NULL);
+     // take all other free pages away, so only check_rp can be allocated;
+     // this works for any pmm_manager, not only one with a single free_list
+     list_entry_t drained;
+     list_init(&drained);
+     struct Page *p;
+     while ((p = pmm_manager->alloc_pages(1)) != NULL) {
+          list_add(&drained, &(p->page_link));
+          count ++;
+     }
+     assert(nr_free_pages() == 0);
      
-     unsigned int nr_free_store = nr_free;
-     nr_free = 0;
      for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
         free_pages(check_rp[i],1);
      }
-     assert(nr_free==CHECK_VALID_PHY_PAGE_NUM);
+     assert(nr_free_pages()==CHECK_VALID_PHY_PAGE_NUM);
      
      cprintf("set up init env for check_swap begin!\n");
      //setup initial vir_page<->phy_page environment for page relpacement algorithm 
@@ -239,7 +788,7 @@ check_swap(void)
      pgfault_num=0;
      
      check_content_set();
-     assert( nr_free == 0);         
+     assert( nr_free_pages() == 0);         
      for(i = 0; i<MAX_SEQ_NO ; i++) 
          swap_out_seq_no[i]=swap_in_seq_no[i]=-1;
      
@@ -256,29 +805,255 @@ check_swap(void)
      ret=check_content_access();
      assert(ret==0);
      
-     //restore kernel mem env
-     for (i=0;i<CHECK_VALID_PHY_PAGE_NUM;i++) {
-         free_pages(check_rp[i],1);
-     } 
+     //restore kernel mem env: the pages of check_rp are mapped, the others swapped out
+     for (i=0;i<CHECK_VALID_VIR_PAGE_NUM;i++) {
+         page_remove(pgdir, BEING_CHECK_VALID_VADDR + i * PGSIZE);
+     }
+     assert(swap_nr_used == swap_nr_used_store);
 
      //free_page(pte2page(*temp_ptep));
     free_page(pde2page(pgdir[0]));
      pgdir[0] = 0;
+     lcr3(boot_cr3);
      mm->pgdir = NULL;
      mm_destroy(mm);
      check_mm_struct = NULL;
      
-     nr_free = nr_free_store;
-     free_list = free_list_store;
-
-     
-     le = &free_list;
-     while ((le = list_next(le)) != &free_list) {
-         struct Page *p = le2page(le, page_link);
-         count --, total -= p->property;
+     list_entry_t *le;
+     while ((le = list_next(&drained)) != &drained) {
+         list_del(le);
+         free_page(le2page(le, page_link));
+         count --;
      }
-     cprintf("count is %d, total is %d\n",count,total);
-     //assert(count == 0);
+     cprintf("count is %d, total is %d\n",count,nr_free_pages());
+     assert(count == 0);
      
      cprintf("check_swap() succeeded!\n");
 }
+
+/* *
+ * swap_bench - count the page faults and swap writes of every swap manager on
+ * the access patterns of related_info/lab3/locality, on an int matrix of
+ * SWAP_BENCH_PAGES rows of one page each, with only SWAP_BENCH_FRAMES frames:
+ *   good - row by row, the order the matrix is laid out in memory
+ *   bad  - column by column, each access goes to another page
+ *   hot  - all SWAP_BENCH_HOT hot pages are read between the writes of a scan
+ *          over the cold ones; keeping the hot pages, only the cold ones fault
+ * The pages are touched through swap_bench_access instead of taking real page
+ * faults, so that the page fault handler does not print each of them.
+ * */
+#define SWAP_BENCH_FRAMES       6
+#define SWAP_BENCH_PAGES        12
+#define SWAP_BENCH_HOT          3
+#define SWAP_BENCH_COLUMNS      8       // columns visited by bad
+#define SWAP_BENCH_LOOPS        96      // scan steps of hot
+#define SWAP_BENCH_TICK         8       // accesses per swap tick event
+#define SWAP_BENCH_ROWSIZE      (PGSIZE / sizeof(int))
+
+#define SWAP_BENCH_GOOD         0
+#define SWAP_BENCH_BAD          1
+#define SWAP_BENCH_HOTCOLD      2
+#define SWAP_BENCH_NR           3
+
+static unsigned int swap_bench_accesses;
+
+// swap_bench_access - read or write the int at (row, col) of the matrix
+static void
+swap_bench_access(struct mm_struct *mm, int row, int col, bool write) {
+    uintptr_t la = BEING_CHECK_VALID_VADDR + row * PGSIZE;
+    pte_t *ptep = get_pte(mm->pgdir, la, 0);
+    if (ptep == NULL || !(*ptep & PTE_P)) {
+        assert(do_pgfault(mm, write ? 2 : 0, la) == 0);
+    }
+    volatile int *p = (int *)la + col;
+    if (write) {
+        *p = row + col;
+    }
+    else {
+        assert(*p == 0 || *p == row + col);
+    }
+    if (++ swap_bench_accesses % SWAP_BENCH_TICK == 0) {
+        swap_tick_event(mm);
+    }
+}
+
+// swap_bench_run - run pattern in a fresh check_mm_struct with the current swap manager
+static void
+swap_bench_run(int pattern, unsigned int *faults, unsigned int *writes) {
+    list_entry_t drained, *le;
+    list_init(&drained);
+
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL && check_mm_struct == NULL);
+    check_mm_struct = mm;
+    pde_t *pgdir = mm->pgdir = boot_pgdir;
+    assert(pgdir[0] == 0);
+
+    uintptr_t la, end = BEING_CHECK_VALID_VADDR + SWAP_BENCH_PAGES * PGSIZE;
+    struct vma_struct *vma = vma_create(BEING_CHECK_VALID_VADDR, end, VM_WRITE | VM_READ);
+    assert(vma != NULL);
+    insert_vma_struct(mm, vma);
+    assert(get_pte(pgdir, BEING_CHECK_VALID_VADDR, 1) != NULL);
+
+    // leave only SWAP_BENCH_FRAMES free pages
+    struct Page *frames = alloc_pages(SWAP_BENCH_FRAMES), *p;
+    assert(frames != NULL);
+    while ((p = pmm_manager->alloc_pages(1)) != NULL) {
+        list_add(&drained, &(p->page_link));
+    }
+    free_pages(frames, SWAP_BENCH_FRAMES);
+
+    unsigned int pgfault_store = pgfault_num, swap_write_store = swap_write_num;
+    int i, j, k;
+    swap_bench_accesses = 0;
+    switch (pattern) {
+    case SWAP_BENCH_GOOD:
+        for (k = 0; k < 2; k ++) {
+            for (i = 0; i < SWAP_BENCH_PAGES; i ++) {
+                for (j = 0; j < SWAP_BENCH_ROWSIZE; j ++) {
+                    swap_bench_access(mm, i, j, 1);
+                }
+            }
+        }
+        break;
+    case SWAP_BENCH_BAD:
+        for (k = 0; k < 2; k ++) {
+            for (j = 0; j < SWAP_BENCH_COLUMNS; j ++) {
+                for (i = 0; i < SWAP_BENCH_PAGES; i ++) {
+                    swap_bench_access(mm, i, j, 1);
+                }
+            }
+        }
+        break;
+    case SWAP_BENCH_HOTCOLD:
+        for (k = 0; k < SWAP_BENCH_LOOPS; k ++) {
+            for (i = 0; i < SWAP_BENCH_HOT; i ++) {
+                swap_bench_access(mm, i, 0, 0);
+            }
+            swap_bench_access(mm, SWAP_BENCH_HOT + k % (SWAP_BENCH_PAGES - SWAP_BENCH_HOT), 0, 1);
+        }
+        break;
+    }
+    *faults = pgfault_num - pgfault_store;
+    *writes = swap_write_num - swap_write_store;
+
+    // give back the pages still mapped and the swap slots, the page table and the drained pages
+    for (la = BEING_CHECK_VALID_VADDR; la < end; la += PGSIZE) {
+        page_remove(pgdir, la);
+    }
+    free_page(pde2page(pgdir[0]));
+    pgdir[0] = 0;
+    lcr3(boot_cr3);
+    mm->pgdir = NULL;
+    mm_destroy(mm);
+    check_mm_struct = NULL;
+
+    while ((le = list_next(&drained)) != &drained) {
+        list_del(le);
+        free_page(le2page(le, page_link));
+    }
+}
+
+/* *
+ * check_reclaim - check that swap_reclaim takes pages from every mm with
+ * swappable pages in turn, that the pages of a mm are written to a cluster by
+ * one request and read back by one request, the rest of the cluster ahead, and
+ * that they are swapped in intact: two mms sharing boot_pgdir map
+ * CHECK_RECLAIM_PAGES pages each, the second one right above the first one.
+ * */
+#define CHECK_RECLAIM_PAGES     SWAP_CLUSTER
+#define CHECK_RECLAIM_VADDR(k, i)                                       \
+    (BEING_CHECK_VALID_VADDR + ((k) * CHECK_RECLAIM_PAGES + (i)) * PGSIZE)
+
+static void
+check_reclaim(void) {
+    size_t nr_free_pages_store = nr_free_pages(), swap_nr_used_store = swap_nr_used;
+    unsigned int swap_in_store = swap_in_num, swap_ra_hit_store = swap_ra_hit;
+    unsigned int swap_read_io_store = swap_read_io, swap_write_io_store = swap_write_io;
+    struct mm_struct *mms[2];
+    pde_t *pgdir = boot_pgdir;
+    pte_t *ptep;
+    int i, k, nr_out[2];
+    assert(pgdir[0] == 0 && check_mm_struct == NULL);
+    assert(get_pte(pgdir, BEING_CHECK_VALID_VADDR, 1) != NULL);
+
+    for (k = 0; k < 2; k ++) {
+        struct vma_struct *vma;
+        assert((mms[k] = mm_create()) != NULL);
+        mms[k]->pgdir = pgdir;
+        vma = vma_create(CHECK_RECLAIM_VADDR(k, 0), CHECK_RECLAIM_VADDR(k + 1, 0), VM_WRITE | VM_READ);
+        assert(vma != NULL);
+        insert_vma_struct(mms[k], vma);
+        for (i = 0; i < CHECK_RECLAIM_PAGES; i ++) {
+            assert(do_pgfault(mms[k], 2, CHECK_RECLAIM_VADDR(k, i)) == 0);
+            *(int *)CHECK_RECLAIM_VADDR(k, i) = k * CHECK_RECLAIM_PAGES + i;
+        }
+    }
+
+    // a cluster goes from one mm, the rest from the other one, a request each
+    assert(swap_reclaim(CHECK_RECLAIM_PAGES + 2) == CHECK_RECLAIM_PAGES + 2);
+    for (k = 0; k < 2; k ++) {
+        swap_entry_t prev = 0;
+        nr_out[k] = 0;
+        for (i = 0; i < CHECK_RECLAIM_PAGES; i ++) {
+            assert((ptep = get_pte(pgdir, CHECK_RECLAIM_VADDR(k, i), 0)) != NULL && *ptep != 0);
+            if (!(*ptep & PTE_P)) {
+                assert(prev == 0 || *ptep == prev + (1 << 8));
+                prev = *ptep, nr_out[k] ++;
+            }
+        }
+    }
+    assert(nr_out[0] + nr_out[1] == CHECK_RECLAIM_PAGES + 2 && (nr_out[0] == 2 || nr_out[1] == 2));
+    assert(swap_nr_used == swap_nr_used_store + CHECK_RECLAIM_PAGES + 2);
+    assert(swap_write_io == swap_write_io_store + 2);
+
+    // the first fault of each mm reads its cluster, the others find their pages read ahead
+    for (k = 0; k < 2; k ++) {
+        for (i = 0; i < CHECK_RECLAIM_PAGES; i ++) {
+            uintptr_t la = CHECK_RECLAIM_VADDR(k, i);
+            if (!(*get_pte(pgdir, la, 0) & PTE_P)) {
+                assert(do_pgfault(mms[k], 0, la) == 0);
+            }
+            assert(*(int *)la == k * CHECK_RECLAIM_PAGES + i);
+        }
+    }
+    assert(swap_in_num == swap_in_store + CHECK_RECLAIM_PAGES + 2);
+    assert(swap_read_io == swap_read_io_store + 2 && swap_ra_hit == swap_ra_hit_store + CHECK_RECLAIM_PAGES);
+    assert(swap_ra_nr == 0);
+
+    for (k = 0; k < 2; k ++) {
+        for (i = 0; i < CHECK_RECLAIM_PAGES; i ++) {
+            page_remove(pgdir, CHECK_RECLAIM_VADDR(k, i));
+        }
+    }
+    free_page(pde2page(pgdir[0]));
+    pgdir[0] = 0;
+    lcr3(boot_cr3);
+    for (k = 0; k < 2; k ++) {
+        mms[k]->pgdir = NULL;
+        mm_destroy(mms[k]);
+    }
+    assert(nr_free_pages_store == nr_free_pages());
+    assert(swap_nr_used == swap_nr_used_store);
+    cprintf("check_reclaim() succeeded!\n");
+}
+
+static void
+swap_bench(void) {
+    static const char *pattern_name[SWAP_BENCH_NR] = {"good", "bad", "hot"};
+    size_t nr_free_pages_store = nr_free_pages();
+    unsigned int faults, writes;
+    int i, pattern;
+    cprintf("swap_bench: %d frames, %d pages, faults/writes:\n", SWAP_BENCH_FRAMES, SWAP_BENCH_PAGES);
+    for (i = 0; i < NR_SWAP_MANAGERS; i ++) {
+        sm = swap_managers[i];
+        assert(sm->init() == 0);
+        cprintf("  %-22s", sm->name);
+        for (pattern = 0; pattern < SWAP_BENCH_NR; pattern ++) {
+            swap_bench_run(pattern, &faults, &writes);
+            cprintf("  %s %4u/%-4u", pattern_name[pattern], faults, writes);
+        }
+        cprintf("\n");
+    }
+    assert(nr_free_pages_store == nr_free_pages());
+}
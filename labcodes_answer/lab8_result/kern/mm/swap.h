@@ -30,6 +30,30 @@ extern size_t max_swap_offset;
                __offset;                                            \
           })
 
+/* *
+ * Each swap slot (offset) has a reference count in swap_map: one for every pte
+ * holding its swap entry, and one for the page which holds it as pra_entry
+ * (PageSwapCache), the page having been swapped in from it or out to it. The
+ * slot is free when the count drops to 0.
+ * */
+#define SWAP_MAP_MAX                            0xffff
+
+/* *
+ * kswapd wakes up when an allocation leaves fewer than 1/KSWAPD_LOW_RATIO of
+ * the pages (free after swap_init) free, and swaps out pages of all mms in
+ * turn until 1/KSWAPD_HIGH_RATIO of them are free again.
+ * */
+#define KSWAPD_LOW_RATIO                        64
+#define KSWAPD_HIGH_RATIO                       32
+
+/* *
+ * Slots are allocated, written and read ahead by clusters of SWAP_CLUSTER
+ * pages, one IDE request each. At most SWAP_RA_MAX pages read ahead wait on
+ * the readahead list to be faulted in.
+ * */
+#define SWAP_CLUSTER                            8
+#define SWAP_RA_MAX                             32
+
 struct swap_manager
 {
      const char *name;
@@ -44,13 +68,29 @@ struct swap_manager
      /* When a page is marked as shared, this routine is called to
       * delete the addr entry from the swap manager */
      int (*set_unswappable) (struct mm_struct *mm, uintptr_t addr);
-     /* Try to swap out a page, return then victim */
+     /* Try to swap out a page, return then victim. The swappable pages of mm
+      * sit on mm->pra_list, linked by pra_page_link, any of them may be
+      * unlinked by swap_remove_page when it is unmapped or shared. */
      int (*swap_out_victim) (struct mm_struct *mm, struct Page **ptr_page, int in_tick);
      /* check the page relpacement algorithm */
      int (*check_swap)(void);     
 };
 
+/* *
+ * swap_page_dirty - whether the page mapped by pte has to be written to swap
+ * before it is reclaimed: it has been written since it was swapped in, or it
+ * has never been swapped out at all.
+ * */
+static inline bool
+swap_page_dirty(pte_t pte, struct Page *page) {
+    return (pte & PTE_D) || !PageSwapCache(page);
+}
+
 extern volatile int swap_init_ok;
+extern volatile unsigned int swap_in_num, swap_out_num, swap_write_num;
+extern volatile unsigned int kswapd_wakeup_num, kswapd_reclaim_num, swap_direct_num;
+extern volatile unsigned int swap_read_io, swap_write_io, swap_ra_num, swap_ra_hit;
+extern size_t swap_nr_used, swap_ra_nr, swap_low_watermark, swap_high_watermark;
 int swap_init(void);
 int swap_init_mm(struct mm_struct *mm);
 int swap_tick_event(struct mm_struct *mm);
@@ -58,6 +98,13 @@ int swap_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page,
 int swap_set_unswappable(struct mm_struct *mm, uintptr_t addr);
 int swap_out(struct mm_struct *mm, int n, int in_tick);
 int swap_in(struct mm_struct *mm, uintptr_t addr, struct Page **ptr_result);
+int swap_reclaim(int n);
+void kswapd_wakeup(void);
+void swap_remove_page(struct Page *page);
+void swap_cache_release(struct Page *page);
+swap_entry_t swap_alloc(void);
+void swap_duplicate(swap_entry_t entry);
+void swap_free(swap_entry_t entry);
 
 //#define MEMBER_OFFSET(m,t) ((int)(&((t *)0)->m))
 //#define FROM_MEMBER(m,t,a) ((t *)((char *)(a) - MEMBER_OFFSET(m,t)))
@@ -0,0 +1,158 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <swap.h>
+#include <swap_clock.h>
+#include <list.h>
+
+/* *
+ * Enhanced clock (second chance) page replacement
+ *
+ * The swappable pages of a mm sit on the circular list mm->pra_list, the hand
+ * points at the first one: a page the hand passes by moves to the back, and a
+ * new page is linked in at the back, so it is the last one the hand reaches.
+ * (Moving pages instead of a hand pointer lets swap_remove_page unlink any
+ * page.) A page falls into one of four classes by its accessed bit
+ * A and whether it has to be written to swap (D, see swap_page_dirty):
+ *     (0, 0) not used recently, clean      -- the best victim
+ *     (0, 1) not used recently, dirty
+ *     (1, 0) used recently, clean
+ *     (1, 1) used recently, dirty          -- the worst victim
+ * The hand goes round the list once, clearing A of the pages it passes by (a
+ * second chance) and taking the first (0, 0) page. If there is none, the first
+ * (0, 1) page it met is taken; if every page was used, all of them have A
+ * cleared now and a second round must find a victim. Unlike fifo, a page used
+ * since the hand last passed by stays, and a page which is not written back
+ * is preferred to one which is, but never to one used recently.
+ * */
+
+static int
+_clock_init(void)
+{
+    return 0;
+}
+
+static int
+_clock_init_mm(struct mm_struct *mm)
+{
+    mm->pra_vtime = 0;
+    mm->sm_priv = &(mm->pra_list);
+    return 0;
+}
+
+static int
+_clock_tick_event(struct mm_struct *mm)
+{
+    return 0;
+}
+
+// _clock_map_swappable - link the page in behind the hand, the hand reaches it last
+static int
+_clock_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
+{
+    list_add_before(&(mm->pra_list), &(page->pra_page_link));
+    return 0;
+}
+
+static int
+_clock_set_unswappable(struct mm_struct *mm, uintptr_t addr)
+{
+    return 0;
+}
+
+static int
+_clock_swap_out_victim(struct mm_struct *mm, struct Page **ptr_page, int in_tick)
+{
+    list_entry_t *head = &(mm->pra_list), *le;
+    assert(!list_empty(head) && in_tick == 0);
+    int round;
+    for (round = 0; round < 2; round ++) {
+        list_entry_t *last = list_prev(head), *dirty = NULL;
+        do {
+            le = list_next(head);
+            struct Page *page = le2page(le, pra_page_link);
+            pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
+            assert(ptep != NULL && (*ptep & PTE_P));
+            if (*ptep & PTE_A) {
+                *ptep &= ~PTE_A;
+                tlb_invalidate(mm->pgdir, page->pra_vaddr);
+            }
+            else if (!swap_page_dirty(*ptep, page)) {
+                goto found;
+            }
+            else if (dirty == NULL) {
+                dirty = le;
+            }
+            list_del(le);
+            list_add_before(head, le);
+        } while (le != last);
+        if (dirty != NULL) {
+            // bring the hand back to it
+            while ((le = list_next(head)) != dirty) {
+                list_del(le);
+                list_add_before(head, le);
+            }
+            goto found;
+        }
+    }
+    panic("clock: no victim found.\n");
+
+found:
+    list_del(le);
+    *ptr_page = le2page(le, pra_page_link);
+    return 0;
+}
+
+static int
+_clock_check_swap(void) {
+    unsigned int swap_write_store = swap_write_num;
+    pte_t *ptep;
+    // a, b, c, d are all used and dirty: the hand clears A of them and comes back to a
+    cprintf("read Virt Page e in clock_check_swap\n");
+    assert(*(unsigned char *)0x5000 == 0);
+    assert(pgfault_num==5 && swap_write_num==swap_write_store+1);
+    cprintf("write Virt Page a in clock_check_swap\n");
+    *(unsigned char *)0x1000 = 0x0a;
+    assert(pgfault_num==6 && swap_write_num==swap_write_store+2);
+    cprintf("write Virt Page c in clock_check_swap\n");
+    *(unsigned char *)0x3000 = 0x0c;
+    assert(pgfault_num==6);
+    cprintf("read Virt Page b in clock_check_swap\n");
+    assert(*(unsigned char *)0x2000 == 0x0b);
+    assert(pgfault_num==7 && swap_write_num==swap_write_store+3);
+    cprintf("read Virt Page c in clock_check_swap\n");
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    assert(pgfault_num==7);
+    // b is clean but was just used: e, not used since the hand passed, goes
+    cprintf("write Virt Page d in clock_check_swap\n");
+    *(unsigned char *)0x4000 = 0x0d;
+    assert(pgfault_num==8 && swap_write_num==swap_write_store+4);
+    assert((ptep = get_pte(boot_pgdir, 0x2000, 0)) != NULL && (*ptep & PTE_P));
+    // now b is clean and not used since: dropped without a write
+    cprintf("read Virt Page e in clock_check_swap\n");
+    assert(*(unsigned char *)0x5000 == 0);
+    assert(pgfault_num==9 && swap_write_num==swap_write_store+4);
+    assert((ptep = get_pte(boot_pgdir, 0x2000, 0)) != NULL && !(*ptep & PTE_P));
+    // c is used all the time and stays, fifo would have swapped it out by now
+    cprintf("read Virt Page c in clock_check_swap\n");
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    cprintf("write Virt Page a in clock_check_swap\n");
+    *(unsigned char *)0x1000 = 0x0a;
+    cprintf("read Virt Page c in clock_check_swap\n");
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    assert(pgfault_num==9 && swap_write_num==swap_write_store+4);
+    return 0;
+}
+
+struct swap_manager swap_manager_clock =
+{
+     .name            = "clock swap manager",
+     .init            = &_clock_init,
+     .init_mm         = &_clock_init_mm,
+     .tick_event      = &_clock_tick_event,
+     .map_swappable   = &_clock_map_swappable,
+     .set_unswappable = &_clock_set_unswappable,
+     .swap_out_victim = &_clock_swap_out_victim,
+     .check_swap      = &_clock_check_swap,
+};
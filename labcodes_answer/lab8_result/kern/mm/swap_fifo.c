@@ -25,16 +25,15 @@
  *              le2page (in memlayout.h), (in future labs: le2vma (in vmm.h), le2proc (in proc.h),etc.
  */
 
-list_entry_t pra_list_head;
 /*
- * (2) _fifo_init_mm: init pra_list_head and let  mm->sm_priv point to the addr of pra_list_head.
+ * (2) _fifo_init_mm: let mm->sm_priv point to the addr of mm->pra_list, the queue of
+ *              the pages of mm (each mm has its own, as swap_reclaim takes pages of every mm).
  *              Now, From the memory control struct mm_struct, we can access FIFO PRA
  */
 static int
 _fifo_init_mm(struct mm_struct *mm)
 {     
-     list_init(&pra_list_head);
-     mm->sm_priv = &pra_list_head;
+     mm->sm_priv = &(mm->pra_list);
      //cprintf(" mm->sm_priv %x in fifo_init_mm\n",mm->sm_priv);
      return 0;
 }
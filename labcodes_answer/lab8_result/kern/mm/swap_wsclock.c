@@ -0,0 +1,164 @@
+#include <defs.h>
+#include <x86.h>
+#include <stdio.h>
+#include <string.h>
+#include <swap.h>
+#include <swap_wsclock.h>
+#include <list.h>
+
+/* *
+ * WSClock page replacement
+ *
+ * Like clock, the swappable pages of a mm sit on the circular list
+ * mm->pra_list with the hand at its front, but a page is only a good victim once it has left
+ * the working set of its mm: it has not been used during the last WSCLOCK_TAU
+ * units of the virtual time of the mm, which swap_tick_event advances on
+ * every timer tick the mm runs. When the hand finds A set, it clears it and
+ * records the current virtual time in pra_time of the page.
+ *
+ * Among the pages out of the working set the first clean one is taken (it
+ * needs no write), else the first dirty one; if every page is in the working
+ * set, the one used least recently is taken.
+ * */
+
+#define WSCLOCK_TAU             2       // working set window, in virtual time
+
+static int
+_wsclock_init(void)
+{
+    return 0;
+}
+
+static int
+_wsclock_init_mm(struct mm_struct *mm)
+{
+    mm->pra_vtime = 0;
+    mm->sm_priv = &(mm->pra_list);
+    return 0;
+}
+
+// _wsclock_tick_event - advance the virtual time of mm, its process is running
+static int
+_wsclock_tick_event(struct mm_struct *mm)
+{
+    mm->pra_vtime ++;
+    return 0;
+}
+
+// _wsclock_map_swappable - link the page in behind the hand, it is used now
+static int
+_wsclock_map_swappable(struct mm_struct *mm, uintptr_t addr, struct Page *page, int swap_in)
+{
+    list_add_before(&(mm->pra_list), &(page->pra_page_link));
+    page->pra_time = mm->pra_vtime;
+    return 0;
+}
+
+static int
+_wsclock_set_unswappable(struct mm_struct *mm, uintptr_t addr)
+{
+    return 0;
+}
+
+static int
+_wsclock_swap_out_victim(struct mm_struct *mm, struct Page **ptr_page, int in_tick)
+{
+    list_entry_t *head = &(mm->pra_list), *le, *last = list_prev(head);
+    assert(!list_empty(head) && in_tick == 0);
+    struct Page *victim = NULL, *dirty = NULL, *oldest = NULL;
+    size_t vtime = mm->pra_vtime;
+
+    // the hand is at the front, a page it passes by moves to the back
+    do {
+        le = list_next(head);
+        struct Page *page = le2page(le, pra_page_link);
+        pte_t *ptep = get_pte(mm->pgdir, page->pra_vaddr, 0);
+        assert(ptep != NULL && (*ptep & PTE_P));
+        if (*ptep & PTE_A) {
+            *ptep &= ~PTE_A;
+            tlb_invalidate(mm->pgdir, page->pra_vaddr);
+            page->pra_time = vtime;
+        }
+        else if (vtime - page->pra_time > WSCLOCK_TAU) {
+            if (!swap_page_dirty(*ptep, page)) {
+                victim = page;
+                break;
+            }
+            if (dirty == NULL) {
+                dirty = page;
+            }
+        }
+        if (oldest == NULL || vtime - page->pra_time > vtime - oldest->pra_time) {
+            oldest = page;
+        }
+        list_del(le);
+        list_add_before(head, le);
+    } while (le != last);
+
+    if (victim == NULL) {
+        victim = (dirty != NULL) ? dirty : oldest;
+        // bring the hand back to it
+        while ((le = list_next(head)) != &(victim->pra_page_link)) {
+            list_del(le);
+            list_add_before(head, le);
+        }
+    }
+    le = &(victim->pra_page_link);
+    list_del(le);
+    *ptr_page = victim;
+    return 0;
+}
+
+static int
+_wsclock_check_swap(void) {
+    extern struct mm_struct *check_mm_struct;
+    struct mm_struct *mm = check_mm_struct;
+    unsigned int swap_write_store = swap_write_num;
+    pte_t *ptep;
+    // no page has left the working set yet, all were used just now: the hand takes a
+    cprintf("write Virt Page e in wsclock_check_swap\n");
+    *(unsigned char *)0x5000 = 0x0e;
+    assert(pgfault_num==5 && swap_write_num==swap_write_store+1);
+    swap_tick_event(mm);
+    swap_tick_event(mm);
+    swap_tick_event(mm);
+    cprintf("read Virt Page b in wsclock_check_swap\n");
+    assert(*(unsigned char *)0x2000 == 0x0b);
+    cprintf("read Virt Page c in wsclock_check_swap\n");
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    assert(pgfault_num==5);
+    // b and c are in the working set, d has not been used for longer than tau
+    cprintf("write Virt Page a in wsclock_check_swap\n");
+    *(unsigned char *)0x1000 = 0x0a;
+    assert(pgfault_num==6 && swap_write_num==swap_write_store+2);
+    assert((ptep = get_pte(boot_pgdir, 0x4000, 0)) != NULL && !(*ptep & PTE_P));
+    assert((ptep = get_pte(boot_pgdir, 0x2000, 0)) != NULL && (*ptep & PTE_P));
+    assert((ptep = get_pte(boot_pgdir, 0x3000, 0)) != NULL && (*ptep & PTE_P));
+    cprintf("read Virt Page d in wsclock_check_swap\n");
+    assert(*(unsigned char *)0x4000 == 0x0d);
+    assert(pgfault_num==7 && swap_write_num==swap_write_store+3);
+    swap_tick_event(mm);
+    swap_tick_event(mm);
+    swap_tick_event(mm);
+    cprintf("write Virt Page a in wsclock_check_swap\n");
+    *(unsigned char *)0x1000 = 0x0a;
+    cprintf("read Virt Page c in wsclock_check_swap\n");
+    assert(*(unsigned char *)0x3000 == 0x0c);
+    assert(pgfault_num==7);
+    cprintf("read Virt Page e in wsclock_check_swap\n");
+    assert(*(unsigned char *)0x5000 == 0x0e);
+    assert(pgfault_num==8 && swap_write_num==swap_write_store+4);
+    return 0;
+}
+
+struct swap_manager swap_manager_wsclock =
+{
+     .name            = "wsclock swap manager",
+     .init            = &_wsclock_init,
+     .init_mm         = &_wsclock_init_mm,
+     .tick_event      = &_wsclock_tick_event,
+     .map_swappable   = &_wsclock_map_swappable,
+     .set_unswappable = &_wsclock_set_unswappable,
+     .swap_out_victim = &_wsclock_swap_out_victim,
+     .check_swap      = &_wsclock_check_swap,
+};
@@ -0,0 +1,7 @@
+#ifndef __KERN_MM_SWAP_WSCLOCK_H__
+#define __KERN_MM_SWAP_WSCLOCK_H__
+
+#include <swap.h>
+extern struct swap_manager swap_manager_wsclock;
+
+#endif
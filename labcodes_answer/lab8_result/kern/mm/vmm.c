@@ -8,12 +8,22 @@
 #include <x86.h>
 #include <swap.h>
 #include <kmalloc.h>
+#include <slab.h>
+#include <inode.h>
+#include <iobuf.h>
+#include <pcache.h>
+#include <file.h>
+#include <stat.h>
+#include <unistd.h>
 
 /* 
   vmm design include two parts: mm_struct (mm) & vma_struct (vma)
   mm is the memory manager for the set of continuous virtual memory  
   area which have the same PDT. vma is a continuous virtual memory area.
   There a linear link list for vma & a redblack link list for vma in mm.
+  The redblack tree is augmented with the largest free gap below the vmas
+  of every subtree, so get_unmapped_area skips subtrees without a gap large
+  enough.
 ---------------
   mm related functions:
    golbal functions
@@ -28,33 +38,61 @@
      struct vma_struct * find_vma(struct mm_struct *mm, uintptr_t addr)
    local functions
      inline void check_vma_overlap(struct vma_struct *prev, struct vma_struct *next)
+     void vma_gap_augment(rb_node_t *node)
+     void vma_update_gap(struct mm_struct *mm, struct vma_struct *vma)
+     void vma_remove(struct mm_struct *mm, struct vma_struct *vma)
+     void vma_resize(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end)
 ---------------
    check correctness functions
      void check_vmm(void);
      void check_vma_struct(void);
+     void check_unmapped_area(void);
      void check_pgfault(void);
 */
 
 static void check_vmm(void);
 static void check_vma_struct(void);
+static void check_unmapped_area(void);
 static void check_pgfault(void);
+static void check_cow(void);
+
+static kmem_cache_t *mm_cachep, *vma_cachep;
+
+// all mms, in the order swap_reclaim takes pages from them
+list_entry_t mm_list;
+
+static void vma_gap_augment(rb_node_t *node);
+
+// mm_ctor - constructor of mm_cachep, a freed mm_struct has no vma and mm_sem is up
+static void
+mm_ctor(void *objp) {
+    struct mm_struct *mm = objp;
+    list_init(&(mm->mmap_list));
+    sem_init(&(mm->mm_sem), 1);
+}
 
 // mm_create -  alloc a mm_struct & initialize it.
 struct mm_struct *
 mm_create(void) {
-    struct mm_struct *mm = kmalloc(sizeof(struct mm_struct));
+    struct mm_struct *mm = kmem_cache_alloc(mm_cachep);
 
     if (mm != NULL) {
-        list_init(&(mm->mmap_list));
+        assert(list_empty(&(mm->mmap_list)));
+        rb_tree_init(&(mm->mmap_tree), vma_gap_augment);
         mm->mmap_cache = NULL;
         mm->pgdir = NULL;
         mm->map_count = 0;
+        list_init(&(mm->pra_list));
 
         if (swap_init_ok) swap_init_mm(mm);
         else mm->sm_priv = NULL;
         
         set_mm_count(mm, 0);
-        sem_init(&(mm->mm_sem), 1);
+
+        bool intr_flag;
+        local_intr_save(intr_flag);
+        list_add_before(&mm_list, &(mm->mm_link));
+        local_intr_restore(intr_flag);
     }    
     return mm;
 }
@@ -62,16 +100,50 @@ mm_create(void) {
 // vma_create - alloc a vma_struct & initialize it. (addr range: vm_start~vm_end)
 struct vma_struct *
 vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags) {
-    struct vma_struct *vma = kmalloc(sizeof(struct vma_struct));
+    struct vma_struct *vma = kmem_cache_alloc(vma_cachep);
 
     if (vma != NULL) {
         vma->vm_start = vm_start;
         vma->vm_end = vm_end;
         vma->vm_flags = vm_flags;
+        vma->vm_file = NULL;
+        vma->vm_foff = 0;
+        vma->vm_fstart = vma->vm_fend = vm_start;
     }
     return vma;
 }
 
+// vma_set_file - back [start, start + size) of vma by node from offset off,
+//              - the rest of the vma is zero-filled on page fault
+void
+vma_set_file(struct vma_struct *vma, struct inode *node, off_t off, uintptr_t start, size_t size) {
+    assert(vma->vm_file == NULL && node != NULL);
+    assert(vma->vm_start <= start && start + size <= vma->vm_end);
+    vop_ref_inc(node);
+    vma->vm_file = node;
+    vma->vm_foff = off;
+    vma->vm_fstart = start, vma->vm_fend = start + size;
+}
+
+// vma_copy_file - make vma to map the same file as vma from, at the same addresses
+static void
+vma_copy_file(struct vma_struct *to, struct vma_struct *from) {
+    if ((to->vm_file = from->vm_file) != NULL) {
+        vop_ref_inc(to->vm_file);
+        to->vm_foff = from->vm_foff;
+        to->vm_fstart = from->vm_fstart, to->vm_fend = from->vm_fend;
+    }
+}
+
+// vma_destroy - drop the file of vma and free it
+static void
+vma_destroy(struct vma_struct *vma) {
+    if (vma->vm_file != NULL) {
+        vop_ref_dec(vma->vm_file);
+    }
+    kmem_cache_free(vma_cachep, vma);
+}
+
 
 // find_vma - find a vma  (vma->vm_start <= addr <= vma_vm_end)
 struct vma_struct *
@@ -80,18 +152,21 @@ find_vma(struct mm_struct *mm, uintptr_t addr) {
     if (mm != NULL) {
         vma = mm->mmap_cache;
         if (!(vma != NULL && vma->vm_start <= addr && vma->vm_end > addr)) {
-                bool found = 0;
-                list_entry_t *list = &(mm->mmap_list), *le = list;
-                while ((le = list_next(le)) != list) {
-                    vma = le2vma(le, list_link);
-                    if (vma->vm_start<=addr && addr < vma->vm_end) {
-                        found = 1;
-                        break;
-                    }
+            rb_node_t *node = mm->mmap_tree.root;
+            vma = NULL;
+            while (node != NULL) {
+                struct vma_struct *tmp = rbn2vma(node, rb_link);
+                if (addr < tmp->vm_start) {
+                    node = node->left;
                 }
-                if (!found) {
-                    vma = NULL;
+                else if (addr >= tmp->vm_end) {
+                    node = node->right;
                 }
+                else {
+                    vma = tmp;
+                    break;
+                }
+            }
         }
         if (vma != NULL) {
             mm->mmap_cache = vma;
@@ -110,21 +185,86 @@ check_vma_overlap(struct vma_struct *prev, struct vma_struct *next) {
 }
 
 
-// insert_vma_struct -insert vma in mm's list link
+// vma_gap_augment - recompute vm_subtree_gap of the vma at node from its children
+static void
+vma_gap_augment(rb_node_t *node) {
+    struct vma_struct *vma = rbn2vma(node, rb_link);
+    size_t gap = vma->vm_gap;
+    if (node->left != NULL && rbn2vma(node->left, rb_link)->vm_subtree_gap > gap) {
+        gap = rbn2vma(node->left, rb_link)->vm_subtree_gap;
+    }
+    if (node->right != NULL && rbn2vma(node->right, rb_link)->vm_subtree_gap > gap) {
+        gap = rbn2vma(node->right, rb_link)->vm_subtree_gap;
+    }
+    vma->vm_subtree_gap = gap;
+}
+
+// vma_prev_end - the end of the vma before vma in mm, 0 if it is the first one
+static inline uintptr_t
+vma_prev_end(struct mm_struct *mm, struct vma_struct *vma) {
+    list_entry_t *le = list_prev(&(vma->list_link));
+    return (le == &(mm->mmap_list)) ? 0 : le2vma(le, list_link)->vm_end;
+}
+
+// vma_update_gap - recompute vm_gap of vma after it or the vma before it changed
+static void
+vma_update_gap(struct mm_struct *mm, struct vma_struct *vma) {
+    vma->vm_gap = vma->vm_start - vma_prev_end(mm, vma);
+    rb_augment_path(&(mm->mmap_tree), &(vma->rb_link));
+}
+
+// vma_update_next_gap - recompute vm_gap of the vma after vma, if any
+static void
+vma_update_next_gap(struct mm_struct *mm, struct vma_struct *vma) {
+    list_entry_t *le = list_next(&(vma->list_link));
+    if (le != &(mm->mmap_list)) {
+        vma_update_gap(mm, le2vma(le, list_link));
+    }
+}
+
+// vma_remove - take vma out of mm's list and tree, the caller frees it
+static void
+vma_remove(struct mm_struct *mm, struct vma_struct *vma) {
+    list_entry_t *le_next = list_next(&(vma->list_link));
+    list_del(&(vma->list_link));
+    rb_erase(&(mm->mmap_tree), &(vma->rb_link));
+    if (le_next != &(mm->mmap_list)) {
+        vma_update_gap(mm, le2vma(le_next, list_link));
+    }
+    if (mm->mmap_cache == vma) {
+        mm->mmap_cache = NULL;
+    }
+    mm->map_count --;
+}
+
+// vma_resize - change the range of vma in mm to [start, end) without passing its neighbours
+static void
+vma_resize(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end) {
+    assert(start < end);
+    vma->vm_start = start, vma->vm_end = end;
+    vma_update_gap(mm, vma);
+    vma_update_next_gap(mm, vma);
+}
+
+// insert_vma_struct -insert vma in mm's list link and redblack tree
 void
 insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
     assert(vma->vm_start < vma->vm_end);
     list_entry_t *list = &(mm->mmap_list);
     list_entry_t *le_prev = list, *le_next;
 
-        list_entry_t *le = list;
-        while ((le = list_next(le)) != list) {
-            struct vma_struct *mmap_prev = le2vma(le, list_link);
-            if (mmap_prev->vm_start > vma->vm_start) {
-                break;
-            }
-            le_prev = le;
+    /* find the last vma starting at or before vma, and where to link vma in the tree */
+    rb_node_t **link = &(mm->mmap_tree.root), *parent = NULL;
+    while (*link != NULL) {
+        struct vma_struct *mmap_prev = rbn2vma(parent = *link, rb_link);
+        if (mmap_prev->vm_start > vma->vm_start) {
+            link = &(parent->left);
         }
+        else {
+            le_prev = &(mmap_prev->list_link);
+            link = &(parent->right);
+        }
+    }
 
     le_next = list_next(le_prev);
 
@@ -138,6 +278,9 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
 
     vma->vm_mm = mm;
     list_add_after(le_prev, &(vma->list_link));
+    vma->vm_gap = vma->vm_start - vma_prev_end(mm, vma);
+    rb_insert(&(mm->mmap_tree), &(vma->rb_link), parent, link);
+    vma_update_next_gap(mm, vma);
 
     mm->map_count ++;
 }
@@ -146,13 +289,20 @@ insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma) {
 void
 mm_destroy(struct mm_struct *mm) {
     assert(mm_count(mm) == 0);
+    // every page has been unmapped, so it is no longer swappable
+    assert(list_empty(&(mm->pra_list)));
+
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    list_del(&(mm->mm_link));
+    local_intr_restore(intr_flag);
 
     list_entry_t *list = &(mm->mmap_list), *le;
     while ((le = list_next(list)) != list) {
         list_del(le);
-        kfree(le2vma(le, list_link));  //kfree vma        
+        vma_destroy(le2vma(le, list_link));  //kfree vma
     }
-    kfree(mm); //kfree mm
+    kmem_cache_free(mm_cachep, mm); //kfree mm
     mm=NULL;
 }
 
@@ -187,6 +337,23 @@ out:
     return ret;
 }
 
+// share_range - map the pages present in [start, end) of from at the same addresses in to,
+//             - writable if they are writable in from
+static int
+share_range(pde_t *to, pde_t *from, uintptr_t start, uintptr_t end) {
+    uintptr_t la;
+    for (la = start; la < end; la += PGSIZE) {
+        pte_t *ptep = get_pte(from, la, 0);
+        if (ptep == NULL || !(*ptep & PTE_P)) {
+            continue;
+        }
+        if (page_insert(to, pte2page(*ptep), la, *ptep & (PTE_U | PTE_W)) != 0) {
+            return -E_NO_MEM;
+        }
+    }
+    return 0;
+}
+
 int
 dup_mmap(struct mm_struct *to, struct mm_struct *from) {
     assert(to != NULL && from != NULL);
@@ -199,9 +366,18 @@ dup_mmap(struct mm_struct *to, struct mm_struct *from) {
             return -E_NO_MEM;
         }
 
+        vma_copy_file(nvma, vma);
         insert_vma_struct(to, nvma);
 
-        bool share = 0;
+        /* a shared file mapping is not copied copy-on-write, the child maps
+         * the same pages of the page cache, and sees what the parent wrote */
+        if (vma->vm_flags & VM_SHARED) {
+            if (share_range(to->pgdir, from->pgdir, vma->vm_start, vma->vm_end) != 0) {
+                return -E_NO_MEM;
+            }
+            continue;
+        }
+        bool share = 1;
         if (copy_range(to->pgdir, from->pgdir, vma->vm_start, vma->vm_end, share) != 0) {
             return -E_NO_MEM;
         }
@@ -209,6 +385,41 @@ dup_mmap(struct mm_struct *to, struct mm_struct *from) {
     return 0;
 }
 
+// vma_writeback - write the dirty pages in [start, end) of a shared file mapping back
+//               - to the file, the file is never extended
+static void
+vma_writeback(struct mm_struct *mm, struct vma_struct *vma, uintptr_t start, uintptr_t end) {
+    if (vma->vm_file == NULL || !(vma->vm_flags & VM_SHARED)) {
+        return ;
+    }
+    struct stat __stat, *stat = &__stat;
+    if (vop_fstat(vma->vm_file, stat) != 0) {
+        return ;
+    }
+    uintptr_t la;
+    for (la = start; la < end; la += PGSIZE) {
+        pte_t *ptep = get_pte(mm->pgdir, la, 0);
+        if (ptep == NULL || (*ptep & (PTE_P | PTE_D)) != (PTE_P | PTE_D)) {
+            continue;
+        }
+        off_t off = vma->vm_foff + (off_t)(la - vma->vm_fstart);
+        if (off < 0 || off >= stat->st_size) {
+            continue;
+        }
+        size_t size = stat->st_size - off;
+        if (size > PGSIZE) {
+            size = PGSIZE;
+        }
+        int ret;
+        struct iobuf __iob, *iob = iobuf_init(&__iob, page2kva(pte2page(*ptep)), size, off);
+        if ((ret = vop_write(vma->vm_file, iob)) != 0) {
+            warn("vma_writeback: write back %x failed: %e.\n", la, ret);
+        }
+        *ptep &= ~PTE_D;
+        tlb_invalidate(mm->pgdir, la);
+    }
+}
+
 void
 exit_mmap(struct mm_struct *mm) {
     assert(mm != NULL && mm_count(mm) == 0);
@@ -216,6 +427,7 @@ exit_mmap(struct mm_struct *mm) {
     list_entry_t *list = &(mm->mmap_list), *le = list;
     while ((le = list_next(le)) != list) {
         struct vma_struct *vma = le2vma(le, list_link);
+        vma_writeback(mm, vma, vma->vm_start, vma->vm_end);
         unmap_range(pgdir, vma->vm_start, vma->vm_end);
     }
     while ((le = list_next(le)) != list) {
@@ -224,6 +436,190 @@ exit_mmap(struct mm_struct *mm) {
     }
 }
 
+// mm_unmap - remove the mapping of [addr, addr + len), the vmas partly in the range are
+//          - shrunk or split. the page tables are kept until exit_mmap.
+int
+mm_unmap(struct mm_struct *mm, uintptr_t addr, size_t len) {
+    uintptr_t start = addr, end = ROUNDUP(addr + len, PGSIZE);
+    if (start % PGSIZE != 0 || !USER_ACCESS(start, end)) {
+        return -E_INVAL;
+    }
+
+    assert(mm != NULL);
+
+    list_entry_t *list = &(mm->mmap_list), *le = list_next(list);
+    while (le != list) {
+        struct vma_struct *vma = le2vma(le, list_link);
+        le = list_next(le);
+        if (vma->vm_end <= start || vma->vm_start >= end) {
+            continue;
+        }
+        uintptr_t un_start = (vma->vm_start > start) ? vma->vm_start : start;
+        uintptr_t un_end = (vma->vm_end < end) ? vma->vm_end : end;
+        if (vma->vm_start < un_start && un_end < vma->vm_end) {
+            /* the range is in the middle of vma, split the tail off */
+            struct vma_struct *nvma;
+            if ((nvma = vma_create(un_end, vma->vm_end, vma->vm_flags)) == NULL) {
+                return -E_NO_MEM;
+            }
+            vma_copy_file(nvma, vma);
+            vma_resize(mm, vma, vma->vm_start, un_end);
+            insert_vma_struct(mm, nvma);
+        }
+        vma_writeback(mm, vma, un_start, un_end);
+        unmap_range(mm->pgdir, un_start, un_end);
+        if (vma->vm_start == un_start && vma->vm_end == un_end) {
+            vma_remove(mm, vma);
+            vma_destroy(vma);
+        }
+        else if (vma->vm_start == un_start) {
+            vma_resize(mm, vma, un_end, vma->vm_end);
+        }
+        else {
+            vma_resize(mm, vma, vma->vm_start, un_start);
+        }
+    }
+    mm->mmap_cache = NULL;
+    return 0;
+}
+
+// gap_search - find the highest free range of len bytes in [USERBASE, end) below a vma
+//            - in the subtree of node, return its end, 0 if there is none
+static uintptr_t
+gap_search(rb_node_t *node, size_t len, uintptr_t end) {
+    if (node == NULL) {
+        return 0;
+    }
+    struct vma_struct *vma = rbn2vma(node, rb_link);
+    if (vma->vm_subtree_gap < len) {
+        return 0;
+    }
+    uintptr_t hi;
+    if (vma->vm_start < end && (hi = gap_search(node->right, len, end)) != 0) {
+        return hi;
+    }
+    uintptr_t lo = vma->vm_start - vma->vm_gap;
+    hi = (vma->vm_start < end) ? vma->vm_start : end;
+    if (lo < USERBASE) {
+        lo = USERBASE;
+    }
+    if (lo < hi && hi - lo >= len) {
+        return hi;
+    }
+    return gap_search(node->left, len, end);
+}
+
+// get_unmapped_area - find a free range of len bytes, searching downwards from the bottom
+//                   - of the user stack, return 0 if there is none
+uintptr_t
+get_unmapped_area(struct mm_struct *mm, size_t len) {
+    len = ROUNDUP(len, PGSIZE);
+    uintptr_t end = USTACKTOP - USTACKSIZE, hi;
+    if (len == 0 || len > end - USERBASE) {
+        return 0;
+    }
+    /* above the last vma */
+    rb_node_t *node = rb_last(&(mm->mmap_tree));
+    uintptr_t last_end = (node != NULL) ? rbn2vma(node, rb_link)->vm_end : USERBASE;
+    if (last_end <= end - len) {
+        return end - len;
+    }
+    /* below some vma */
+    if ((hi = gap_search(mm->mmap_tree.root, len, end)) != 0) {
+        return hi - len;
+    }
+    return 0;
+}
+
+/* do_mmap - map len bytes of anonymous memory, or of the file fd from offset, in current
+ * @addr_store:  in: the address wanted, 0 to let the kernel choose, out: the address mapped
+ * @mmap_flags:  PROT_* | MAP_*, exactly one of MAP_SHARED and MAP_PRIVATE. a private
+ *               mapping is copy-on-write, a shared file mapping writes the pages back
+ *               to the file on munmap/exit. MAP_SHARED | MAP_ANONYMOUS is not supported.
+ * the pages are read in (or zero-filled) by do_pgfault when touched.
+ */
+int
+do_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call mmap!!.\n");
+    }
+    bool shared = (mmap_flags & MAP_SHARED) != 0, anon = (mmap_flags & MAP_ANONYMOUS) != 0;
+    if (len == 0 || shared == ((mmap_flags & MAP_PRIVATE) != 0) || (shared && anon)) {
+        return -E_INVAL;
+    }
+
+    int ret;
+    struct inode *node = NULL;
+    if (!anon) {
+        if (offset < 0 || offset % PGSIZE != 0) {
+            return -E_INVAL;
+        }
+        /* a shared writable mapping writes to the file */
+        if (!file_testfd(fd, 1, shared && (mmap_flags & PROT_WRITE))) {
+            return -E_INVAL;
+        }
+        if ((ret = file_node(fd, &node)) != 0) {
+            return ret;
+        }
+    }
+
+    uint32_t vm_flags = 0;
+    if (mmap_flags & PROT_READ) vm_flags |= VM_READ;
+    if (mmap_flags & PROT_WRITE) vm_flags |= VM_WRITE;
+    if (mmap_flags & PROT_EXEC) vm_flags |= VM_EXEC;
+    if (shared) vm_flags |= VM_SHARED;
+
+    uintptr_t addr;
+    struct vma_struct *vma;
+    len = ROUNDUP(len, PGSIZE);
+
+    lock_mm(mm);
+    ret = -E_INVAL;
+    if (!copy_from_user(mm, &addr, addr_store, sizeof(uintptr_t), 1)) {
+        goto out_unlock;
+    }
+    if (addr == 0) {
+        ret = -E_NO_MEM;
+        if ((addr = get_unmapped_area(mm, len)) == 0) {
+            goto out_unlock;
+        }
+    }
+    else if (addr % PGSIZE != 0) {
+        goto out_unlock;
+    }
+    if ((ret = mm_map(mm, addr, len, vm_flags, &vma)) != 0) {
+        goto out_unlock;
+    }
+    if (node != NULL) {
+        vma_set_file(vma, node, offset, addr, len);
+    }
+    copy_to_user(mm, addr_store, &addr, sizeof(uintptr_t));
+    ret = 0;
+out_unlock:
+    unlock_mm(mm);
+    return ret;
+}
+
+// do_munmap - remove the mappings of [addr, addr + len) in current
+int
+do_munmap(uintptr_t addr, size_t len) {
+    struct mm_struct *mm = current->mm;
+    if (mm == NULL) {
+        panic("kernel thread call munmap!!.\n");
+    }
+    if (len == 0) {
+        return -E_INVAL;
+    }
+    int ret;
+    lock_mm(mm);
+    {
+        ret = mm_unmap(mm, addr, len);
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
 bool
 copy_from_user(struct mm_struct *mm, void *dst, const void *src, size_t len, bool writable) {
     if (!user_mem_check(mm, (uintptr_t)src, len, writable)) {
@@ -246,6 +642,11 @@ copy_to_user(struct mm_struct *mm, void *dst, const void *src, size_t len) {
 //          - now just call check_vmm to check correctness of vmm
 void
 vmm_init(void) {
+    list_init(&mm_list);
+    if ((mm_cachep = kmem_cache_create("mm_struct", sizeof(struct mm_struct), mm_ctor)) == NULL
+        || (vma_cachep = kmem_cache_create("vma_struct", sizeof(struct vma_struct), NULL)) == NULL) {
+        panic("vmm: create caches failed.\n");
+    }
     check_vmm();
 }
 
@@ -255,13 +656,61 @@ check_vmm(void) {
     size_t nr_free_pages_store = nr_free_pages();
     
     check_vma_struct();
+    check_unmapped_area();
     check_pgfault();
+    check_cow();
 
     //assert(nr_free_pages_store == nr_free_pages());
 
     cprintf("check_vmm() succeeded.\n");
 }
 
+// check_vma_subtree - check order, colors and gaps in the subtree of node, return its black height
+static int
+check_vma_subtree(struct mm_struct *mm, rb_node_t *node, int *count) {
+    if (node == NULL) {
+        return 1;
+    }
+    struct vma_struct *vma = rbn2vma(node, rb_link);
+    size_t gap = vma->vm_gap;
+    assert(vma->vm_gap == vma->vm_start - vma_prev_end(mm, vma));
+    if (node->left != NULL) {
+        struct vma_struct *left = rbn2vma(node->left, rb_link);
+        assert(node->left->parent == node && left->vm_start < vma->vm_start);
+        assert(!(node->red && node->left->red));
+        gap = (left->vm_subtree_gap > gap) ? left->vm_subtree_gap : gap;
+    }
+    if (node->right != NULL) {
+        struct vma_struct *right = rbn2vma(node->right, rb_link);
+        assert(node->right->parent == node && right->vm_start > vma->vm_start);
+        assert(!(node->red && node->right->red));
+        gap = (right->vm_subtree_gap > gap) ? right->vm_subtree_gap : gap;
+    }
+    assert(vma->vm_subtree_gap == gap);
+    int height = check_vma_subtree(mm, node->left, count);
+    assert(height == check_vma_subtree(mm, node->right, count));
+    (*count) ++;
+    return height + !node->red;
+}
+
+// check_vma_tree - check the redblack tree of mm against its vma list
+static void
+check_vma_tree(struct mm_struct *mm) {
+    int count = 0;
+    rb_node_t *root = mm->mmap_tree.root;
+    assert(root == NULL || (root->parent == NULL && !root->red));
+    check_vma_subtree(mm, root, &count);
+    assert(count == mm->map_count);
+
+    list_entry_t *list = &(mm->mmap_list), *le = list;
+    rb_node_t *node = rb_first(&(mm->mmap_tree));
+    while ((le = list_next(le)) != list) {
+        assert(node != NULL && le2vma(le, list_link) == rbn2vma(node, rb_link));
+        node = rb_next(node);
+    }
+    assert(node == NULL);
+}
+
 static void
 check_vma_struct(void) {
     size_t nr_free_pages_store = nr_free_pages();
@@ -317,6 +766,8 @@ check_vma_struct(void) {
         assert(vma_below_5 == NULL);
     }
 
+    check_vma_tree(mm);
+
     mm_destroy(mm);
 
   //  assert(nr_free_pages_store == nr_free_pages());
@@ -324,6 +775,70 @@ check_vma_struct(void) {
     cprintf("check_vma_struct() succeeded!\n");
 }
 
+// check_unmapped_area - check removing and resizing vmas and the gap search
+static void
+check_unmapped_area(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+
+    struct mm_struct *mm = mm_create();
+    assert(mm != NULL);
+    mm->pgdir = boot_pgdir;
+
+    uintptr_t end = USTACKTOP - USTACKSIZE;
+    assert(get_unmapped_area(mm, PGSIZE) == end - PGSIZE);
+    assert(mm_map(mm, end, USTACKSIZE, VM_READ | VM_WRITE | VM_STACK, NULL) == 0);
+    assert(mm_map(mm, USERBASE, 4 * PGSIZE, VM_READ, NULL) == 0);
+    assert(mm_map(mm, USERBASE + 6 * PGSIZE, PGSIZE, VM_READ, NULL) == 0);
+    assert(mm_map(mm, end - 3 * PGSIZE, 2 * PGSIZE, VM_READ, NULL) == 0);
+    check_vma_tree(mm);
+
+    assert(get_unmapped_area(mm, PGSIZE) == end - PGSIZE);
+    assert(get_unmapped_area(mm, 2 * PGSIZE) == end - 5 * PGSIZE);
+    uintptr_t start = USERBASE + 7 * PGSIZE;
+    assert(mm_map(mm, start, end - 3 * PGSIZE - start, VM_READ, NULL) == 0);
+    assert(get_unmapped_area(mm, 2 * PGSIZE) == USERBASE + 4 * PGSIZE);
+    assert(get_unmapped_area(mm, 3 * PGSIZE) == 0);
+
+    /* split, shrink and remove */
+    assert(mm_unmap(mm, USERBASE + PGSIZE, PGSIZE) == 0);
+    check_vma_tree(mm);
+    assert(mm->map_count == 6 && get_unmapped_area(mm, 3 * PGSIZE) == 0);
+    assert(mm_unmap(mm, USERBASE + 2 * PGSIZE, 4 * PGSIZE) == 0);
+    check_vma_tree(mm);
+    assert(mm->map_count == 5 && get_unmapped_area(mm, 5 * PGSIZE) == USERBASE + PGSIZE);
+    assert(mm_unmap(mm, USERBASE, USTACKTOP - USERBASE) == 0);
+    check_vma_tree(mm);
+    assert(mm->map_count == 0 && mm->mmap_tree.root == NULL);
+
+    /* many vmas inserted and removed out of order, one page at every other even page */
+    int i, k, n = 64;
+    for (i = 0; i < n; i ++) {
+        k = (i * 37) % n;
+        assert(mm_map(mm, USERBASE + 2 * k * PGSIZE, PGSIZE, VM_READ, NULL) == 0);
+    }
+    check_vma_tree(mm);
+    assert(mm_map(mm, USERBASE + 2 * n * PGSIZE, end - USERBASE - 2 * n * PGSIZE, VM_READ, NULL) == 0);
+    for (i = 0; i < n; i ++) {
+        if ((k = (i * 11) % n) % 2 == 0) {
+            assert(mm_unmap(mm, USERBASE + 2 * k * PGSIZE, PGSIZE) == 0);
+            check_vma_tree(mm);
+        }
+    }
+    assert(mm->map_count == n / 2 + 1);
+    assert(get_unmapped_area(mm, PGSIZE) == USERBASE + (2 * n - 1) * PGSIZE);
+    assert(get_unmapped_area(mm, 3 * PGSIZE) == USERBASE + (2 * n - 5) * PGSIZE);
+    assert(get_unmapped_area(mm, 4 * PGSIZE) == 0);
+    assert(mm_unmap(mm, USERBASE, USTACKTOP - USERBASE) == 0);
+    assert(mm->map_count == 0);
+
+    mm->pgdir = NULL;
+    mm_destroy(mm);
+
+    assert(nr_free_pages_store == nr_free_pages());
+
+    cprintf("check_unmapped_area() succeeded!\n");
+}
+
 struct mm_struct *check_mm_struct;
 
 // check_pgfault - check correctness of pgfault handler
@@ -368,8 +883,218 @@ check_pgfault(void) {
 
     cprintf("check_pgfault() succeeded!\n");
 }
+// check_cow - check copy-on-write sharing in copy_range and the write-protect fault in do_pgfault
+static void
+check_cow(void) {
+    size_t nr_free_pages_store = nr_free_pages();
+    unsigned int cow_copy_store = pgfault_stat[PGFAULT_COW_COPY].count;
+    unsigned int cow_reuse_store = pgfault_stat[PGFAULT_COW_REUSE].count;
+    unsigned int spurious_store = pgfault_stat[PGFAULT_SPURIOUS].count;
+
+    struct mm_struct *from = mm_create(), *to = mm_create();
+    assert(from != NULL && to != NULL);
+
+    struct Page *from_pgdir = alloc_page(), *to_pgdir = alloc_page();
+    assert(from_pgdir != NULL && to_pgdir != NULL);
+    from->pgdir = page2kva(from_pgdir), to->pgdir = page2kva(to_pgdir);
+    memcpy(from->pgdir, boot_pgdir, PGSIZE);
+    memcpy(to->pgdir, boot_pgdir, PGSIZE);
+
+    struct vma_struct *vma;
+    assert((vma = vma_create(0, PTSIZE, VM_READ | VM_WRITE)) != NULL);
+    insert_vma_struct(from, vma);
+    assert((vma = vma_create(0, PTSIZE, VM_READ | VM_WRITE)) != NULL);
+    insert_vma_struct(to, vma);
+
+    uintptr_t addr = 0x1000;
+    struct Page *page = pgdir_alloc_page(from->pgdir, addr, PTE_W | PTE_U);
+    assert(page != NULL);
+    memset(page2kva(page), 0x5a, PGSIZE);
+
+    // fork: the page is shared read-only
+    assert(copy_range(to->pgdir, from->pgdir, 0, PTSIZE, 1) == 0);
+    pte_t *from_ptep = get_pte(from->pgdir, addr, 0), *to_ptep = get_pte(to->pgdir, addr, 0);
+    assert(from_ptep != NULL && to_ptep != NULL);
+    assert(pte2page(*from_ptep) == page && pte2page(*to_ptep) == page && page_ref(page) == 2);
+    assert(!(*from_ptep & PTE_W) && !(*to_ptep & PTE_W));
+
+    // the first writer gets a private copy
+    assert(do_pgfault(to, 3, addr + 0x10) == 0);
+    struct Page *npage = pte2page(*to_ptep);
+    assert(npage != page && page_ref(page) == 1 && page_ref(npage) == 1 && (*to_ptep & PTE_W));
+    assert(*(unsigned char *)(page2kva(npage) + 0x10) == 0x5a);
+
+    // the last sharer takes the page over without copying
+    assert(do_pgfault(from, 3, addr + 0x10) == 0);
+    assert(pte2page(*from_ptep) == page && (*from_ptep & PTE_W));
+    assert(pgfault_stat[PGFAULT_COW_COPY].count == cow_copy_store + 1);
+    assert(pgfault_stat[PGFAULT_COW_REUSE].count == cow_reuse_store + 1);
+
+    // a fault on a page already mapped writable leaves it alone
+    assert(do_pgfault(from, 3, addr + 0x10) == 0 && do_pgfault(from, 0, addr) == 0);
+    assert(pte2page(*from_ptep) == page && page_ref(page) == 1);
+    assert(pgfault_stat[PGFAULT_SPURIOUS].count == spurious_store + 2);
+    assert(pgfault_stat[PGFAULT_COW_REUSE].count == cow_reuse_store + 1);
+
+    unmap_range(from->pgdir, 0, PTSIZE);
+    exit_range(from->pgdir, 0, PTSIZE);
+    unmap_range(to->pgdir, 0, PTSIZE);
+    exit_range(to->pgdir, 0, PTSIZE);
+    free_page(from_pgdir);
+    free_page(to_pgdir);
+    from->pgdir = to->pgdir = NULL;
+    mm_destroy(from);
+    mm_destroy(to);
+
+    assert(nr_free_pages_store == nr_free_pages());
+
+    cprintf("check_cow() succeeded!\n");
+}
+
 //page fault number
 volatile unsigned int pgfault_num=0;
+//number of page faults and their latency, by how they were resolved
+struct pgfault_stat pgfault_stat[PGFAULT_NR_KIND];
+
+// pgfault_account - count a page fault of kind which started at TSC start
+static void
+pgfault_account(int kind, uint64_t start) {
+    uint64_t cycles = read_tsc() - start, rest = cycles >> (PGFAULT_HIST_SHIFT + 1);
+    struct pgfault_stat *stat = pgfault_stat + kind;
+    int bucket = 0;
+    while (rest != 0 && bucket < PGFAULT_NR_BUCKET - 1) {
+        rest >>= 1, bucket ++;
+    }
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        stat->count ++, stat->hist[bucket] ++;
+        stat->cycles += cycles;
+        if (stat->max_cycles < cycles) {
+            stat->max_cycles = cycles;
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+// pgfault_get_stat - take a consistent snapshot of the page fault counters
+void
+pgfault_get_stat(struct pgfault_stat *stat) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        memcpy(stat, pgfault_stat, sizeof(pgfault_stat));
+    }
+    local_intr_restore(intr_flag);
+}
+
+// pgfault_print_stat - print the count, average and maximum latency in cycles
+//                    - of every kind of page fault, and the non-empty buckets
+void
+pgfault_print_stat(void) {
+    static struct pgfault_stat stat[PGFAULT_NR_KIND];
+    pgfault_get_stat(stat);
+    int kind, i;
+    cprintf("page faults: %u\n", pgfault_num);
+    for (kind = 0; kind < PGFAULT_NR_KIND; kind ++) {
+        struct pgfault_stat *s = stat + kind;
+        if (s->count == 0) {
+            continue;
+        }
+        uint64_t avg = s->cycles;
+        do_div(avg, s->count);
+        cprintf("  %-10s %8u  avg %10llu  max %10llu cycles\n", pgfault_kind_name(kind),
+                s->count, avg, s->max_cycles);
+        for (i = 0; i < PGFAULT_NR_BUCKET; i ++) {
+            if (s->hist[i] != 0) {
+                cprintf("    %s2^%-2d %8u\n", (i == 0) ? "< " : ">=",
+                        i + PGFAULT_HIST_SHIFT + (i == 0), s->hist[i]);
+            }
+        }
+    }
+}
+
+// do_pgfstat - copy the page fault counters to user, for SYS_pgfstat
+int
+do_pgfstat(struct pgfault_stat *store, int n) {
+    static struct pgfault_stat stat[PGFAULT_NR_KIND];
+    struct mm_struct *mm = current->mm;
+    if (n < 0) {
+        return -E_INVAL;
+    }
+    if (n > PGFAULT_NR_KIND) {
+        n = PGFAULT_NR_KIND;
+    }
+    pgfault_get_stat(stat);
+    int ret = -E_INVAL;
+    lock_mm(mm);
+    {
+        if (copy_to_user(mm, store, stat, sizeof(struct pgfault_stat) * n)) {
+            ret = n;
+        }
+    }
+    unlock_mm(mm);
+    return ret;
+}
+
+// vma_fill_page - fill the page at la of a file-backed vma: the part inside
+//               - [vm_fstart, vm_fend) is read from vm_file, the rest is zeroed
+static int
+vma_fill_page(struct vma_struct *vma, uintptr_t la, void *kva) {
+    uintptr_t start = la, end = la + PGSIZE;
+    memset(kva, 0, PGSIZE);
+    if (start < vma->vm_fstart) {
+        start = vma->vm_fstart;
+    }
+    if (end > vma->vm_fend) {
+        end = vma->vm_fend;
+    }
+    if (start >= end) {
+        return 0;
+    }
+    /* a short read leaves the tail zeroed, as for a file shorter than the mapping */
+    struct iobuf __iob, *iob = iobuf_init(&__iob, kva + (start - la), end - start,
+                                          vma->vm_foff + (start - vma->vm_fstart));
+    return vop_read(vma->vm_file, iob);
+}
+
+// vma_pcache_index - the page at la of a read-only file-backed vma is shared through the
+//                  - page cache if it starts at a page boundary of the file, return the
+//                  - page number in the file, or -1 if the page must be a private copy.
+//                  - the bytes of a shared page outside [vm_fstart, vm_fend) are those of
+//                  - the file instead of zero, which is harmless as the page is read-only.
+static int
+vma_pcache_index(struct vma_struct *vma, uintptr_t la) {
+    if (vma->vm_file == NULL || ((vma->vm_flags & VM_WRITE) && !(vma->vm_flags & VM_SHARED))) {
+        return -1;
+    }
+    if (la >= vma->vm_fend || la + PGSIZE <= vma->vm_fstart) {
+        return -1;
+    }
+    off_t off = vma->vm_foff + (off_t)(la - vma->vm_fstart);
+    if (off < 0 || off % PGSIZE != 0) {
+        return -1;
+    }
+    return off / PGSIZE;
+}
+
+// vma_map_cached - map the pages of a read-only file-backed vma which are in the page cache
+//                - already, so a program launched again does not even fault on its text
+void
+vma_map_cached(struct mm_struct *mm, struct vma_struct *vma) {
+    uintptr_t la;
+    for (la = vma->vm_start; la < vma->vm_end; la += PGSIZE) {
+        struct Page *page;
+        int index;
+        if ((index = vma_pcache_index(vma, la)) < 0
+            || (page = pcache_find(vma->vm_file, index)) == NULL) {
+            continue;
+        }
+        if (page_insert(mm->pgdir, page, la, PTE_U) != 0) {
+            break;
+        }
+    }
+}
 
 /* do_pgfault - interrupt handler to process the page fault execption
  * @mm         : the control struct for a set of vma using the same PDT
@@ -394,7 +1119,8 @@ volatile unsigned int pgfault_num=0;
  */
 int
 do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
-    int ret = -E_INVAL;
+    uint64_t start = read_tsc();
+    int ret = -E_INVAL, kind = PGFAULT_INVALID;
     //try to find a vma which include addr
     struct vma_struct *vma = find_vma(mm, addr);
 
@@ -503,43 +1229,130 @@ do_pgfault(struct mm_struct *mm, uint32_t error_code, uintptr_t addr) {
         cprintf("get_pte in do_pgfault failed\n");
         goto failed;
     }
-    
-    if (*ptep == 0) { // if the phy addr isn't exist, then alloc a page & map the phy addr with logical addr
-        if (pgdir_alloc_page(mm->pgdir, addr, perm) == NULL) {
+    // someone sharing mm (or an earlier fault on a stale tlb entry) has already
+    // mapped the page the way we need it, nothing to do
+    if ((*ptep & PTE_P) && (!(error_code & 2) || (*ptep & PTE_W))) {
+        kind = PGFAULT_SPURIOUS;
+        goto done;
+    }
+
+    if (*ptep == 0 && vma->vm_file != NULL) {
+        // demand paging of a file-backed vma (e.g. a segment of the program, see load_icode):
+        // read-only pages are shared through the page cache, the others are private copies
+        // read from the file, which are never written back.
+        struct Page *page;
+        int index;
+        if (vma->vm_flags & VM_SHARED) {
+            // every mapping of the file must see the one copy of the page in the cache,
+            // a private copy would hide the writes of this process from the others
+            index = vma_pcache_index(vma, addr);
+            assert(index >= 0);
+            if ((ret = pcache_get_wait(vma->vm_file, index, &page)) != 0) {
+                cprintf("pcache_get_wait for shared file vma in do_pgfault failed: %e\n", ret);
+                goto failed;
+            }
+            if (*ptep == 0 && page_insert(mm->pgdir, page, addr, perm) != 0) {
+                ret = -E_NO_MEM;
+                goto failed;
+            }
+            kind = PGFAULT_FILE;
+            goto done;
+        }
+        if ((index = vma_pcache_index(vma, addr)) >= 0
+            && (page = pcache_get(vma->vm_file, index)) != NULL) {
+            // someone sharing mm may have faulted the page in while we were reading
+            if (*ptep == 0 && page_insert(mm->pgdir, page, addr, perm) != 0) {
+                goto failed;
+            }
+            kind = PGFAULT_FILE;
+            goto done;
+        }
+        if ((page = alloc_page()) == NULL) {
+            cprintf("alloc_page for file-backed vma in do_pgfault failed\n");
+            goto failed;
+        }
+        if ((ret = vma_fill_page(vma, addr, page2kva(page))) != 0) {
+            free_page(page);
+            goto failed;
+        }
+        // someone sharing mm may have faulted the page in while we were reading
+        if (*ptep != 0) {
+            free_page(page);
+        }
+        else if (page_insert(mm->pgdir, page, addr, perm) != 0) {
+            free_page(page);
+            ret = -E_NO_MEM;
+            goto failed;
+        }
+        kind = PGFAULT_FILE;
+    }
+    else if (*ptep == 0) { // if the phy addr isn't exist, then alloc a page & map the phy addr with logical addr
+        struct Page *page;
+        if ((page = pgdir_alloc_page(mm->pgdir, addr, perm)) == NULL) {
             cprintf("pgdir_alloc_page in do_pgfault failed\n");
             goto failed;
         }
+        // anonymous memory (stack, heap, MAP_ANONYMOUS) starts zero-filled
+        memset(page2kva(page), 0, PGSIZE);
+        kind = PGFAULT_ANON;
+    }
+    else if (*ptep & PTE_P) {
+        //process writes to an existed readonly page of a writable vma: the page is
+        //shared copy-on-write since fork (see copy_range), copy it unless we are the last user.
+        //a shared mapping never copies, the page was only mapped readonly by someone.
+        struct Page *page = pte2page(*ptep);
+        if (vma->vm_flags & VM_SHARED) {
+            *ptep |= PTE_W;
+            tlb_invalidate(mm->pgdir, addr);
+            kind = PGFAULT_SHARED;
+        }
+        else if (page_ref(page) == 1) {
+            *ptep |= PTE_W;
+            tlb_invalidate(mm->pgdir, addr);
+            kind = PGFAULT_COW_REUSE;
+        }
+        else {
+            struct Page *npage;
+            if ((npage = alloc_page()) == NULL) {
+                cprintf("alloc_page for copy on write in do_pgfault failed\n");
+                goto failed;
+            }
+            memcpy(page2kva(npage), page2kva(page), PGSIZE);
+            if (page_insert(mm->pgdir, npage, addr, perm) != 0) {
+                free_page(npage);
+                goto failed;
+            }
+            kind = PGFAULT_COW_COPY;
+        }
     }
     else {
         struct Page *page=NULL;
-        cprintf("do pgfault: ptep %x, pte %x\n",ptep, *ptep);
-        if (*ptep & PTE_P) {
-            //if process write to this existed readonly page (PTE_P means existed), then should be here now.
-            //we can implement the delayed memory space copy for fork child process (AKA copy on write, COW).
-            //we didn't implement now, we will do it in future.
-            panic("error write a non-writable pte");
-            //page = pte2page(*ptep);
-        } else{
-           // if this pte is a swap entry, then load data from disk to a page with phy addr
-           // and call page_insert to map the phy addr with logical addr
-           if(swap_init_ok) {               
-               if ((ret = swap_in(mm, addr, &page)) != 0) {
-                   cprintf("swap_in in do_pgfault failed\n");
-                   goto failed;
-               }    
-
-           }  
-           else {
+        // if this pte is a swap entry, then load data from disk to a page with phy addr
+        // and call page_insert to map the phy addr with logical addr
+        if(swap_init_ok) {
+            if ((ret = swap_in(mm, addr, &page)) != 0) {
+                cprintf("swap_in in do_pgfault failed\n");
+                goto failed;
+            }
+        }
+        else {
             cprintf("no swap_init_ok but ptep is %x, failed\n",*ptep);
             goto failed;
-           }
-       } 
-       page_insert(mm->pgdir, page, addr, perm);
-       swap_map_swappable(mm, addr, page, 1);
-       page->pra_vaddr = addr;
-   }
-   ret = 0;
+        }
+        page_insert(mm->pgdir, page, addr, perm);
+        kind = PGFAULT_SWAPIN;
+    }
+    // a page mapped by mm only can be reclaimed now, swap_map_swappable skips the
+    // others (e.g. the pages of the page cache or shared copy-on-write). the page of
+    // a shared file mapping never goes to swap: its changes belong to the file, and
+    // vma_writeback only writes back the pages which are present.
+    if (swap_init_ok && (*ptep & PTE_P) && !(vma->vm_flags & VM_SHARED)) {
+        swap_map_swappable(mm, addr, pte2page(*ptep), kind == PGFAULT_SWAPIN);
+    }
+done:
+    ret = 0;
 failed:
+    pgfault_account((ret == 0) ? kind : PGFAULT_INVALID, start);
     return ret;
 }
 
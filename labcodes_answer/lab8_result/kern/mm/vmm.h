@@ -7,9 +7,12 @@
 #include <sync.h>
 #include <proc.h>
 #include <sem.h>
+#include <rb_tree.h>
+#include <pgfault.h>
 
 //pre define
 struct mm_struct;
+struct inode;
 
 // the virtual continuous memory area(vma)
 struct vma_struct {
@@ -17,33 +20,54 @@ struct vma_struct {
     uintptr_t vm_start;      //    start addr of vma    
     uintptr_t vm_end;        // end addr of vma
     uint32_t vm_flags;       // flags of vma
+    struct inode *vm_file;   // the file mapped in the vma, NULL for anonymous memory
+    off_t vm_foff;           // offset in vm_file of the byte at vm_fstart
+    uintptr_t vm_fstart;     // [vm_fstart, vm_fend) is read from vm_file on page fault,
+    uintptr_t vm_fend;       // the rest of the vma is zero-filled
     list_entry_t list_link;  // linear list link which sorted by start addr of vma
+    rb_node_t rb_link;       // redblack tree link which sorted by start addr of vma
+    size_t vm_gap;           // the free space below the vma: vm_start - the vm_end of the previous vma (or 0)
+    size_t vm_subtree_gap;   // the largest vm_gap in the subtree of rb_link
 };
 
 #define le2vma(le, member)                  \
     to_struct((le), struct vma_struct, member)
 
+#define rbn2vma(node, member)               \
+    rbn2struct((node), struct vma_struct, member)
+
 #define VM_READ                 0x00000001
 #define VM_WRITE                0x00000002
 #define VM_EXEC                 0x00000004
 #define VM_STACK                0x00000008
+#define VM_SHARED               0x00000010
 
 // the control struct for a set of vma using the same PDT
 struct mm_struct {
     list_entry_t mmap_list;        // linear list link which sorted by start addr of vma
+    rb_tree_t mmap_tree;           // redblack tree of the same vmas, for find_vma and get_unmapped_area
     struct vma_struct *mmap_cache; // current accessed vma, used for speed purpose
     pde_t *pgdir;                  // the PDT of these vma
     int map_count;                 // the count of these vma
     void *sm_priv;                 // the private data for swap manager
+    list_entry_t pra_list;         // swappable pages, in the order of the swap manager
+    size_t pra_vtime;              // virtual time of the mm in swap tick events, used by wsclock
     int mm_count;                  // the number ofprocess which shared the mm
     semaphore_t mm_sem;            // mutex for using dup_mmap fun to duplicat the mm 
     int locked_by;                 // the lock owner process's pid
-
+    list_entry_t mm_link;          // entry in mm_list of all mms, scanned by swap_reclaim
 };
 
+#define le2mm(le, member)                   \
+    to_struct((le), struct mm_struct, member)
+
+extern list_entry_t mm_list;
+
 struct vma_struct *find_vma(struct mm_struct *mm, uintptr_t addr);
 struct vma_struct *vma_create(uintptr_t vm_start, uintptr_t vm_end, uint32_t vm_flags);
 void insert_vma_struct(struct mm_struct *mm, struct vma_struct *vma);
+void vma_set_file(struct vma_struct *vma, struct inode *node, off_t off, uintptr_t start, size_t size);
+void vma_map_cached(struct mm_struct *mm, struct vma_struct *vma);
 
 struct mm_struct *mm_create(void);
 void mm_destroy(struct mm_struct *mm);
@@ -58,8 +82,14 @@ int dup_mmap(struct mm_struct *to, struct mm_struct *from);
 void exit_mmap(struct mm_struct *mm);
 uintptr_t get_unmapped_area(struct mm_struct *mm, size_t len);
 int mm_brk(struct mm_struct *mm, uintptr_t addr, size_t len);
+int do_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset);
+int do_munmap(uintptr_t addr, size_t len);
+int do_pgfstat(struct pgfault_stat *store, int n);
+void pgfault_get_stat(struct pgfault_stat *stat);
+void pgfault_print_stat(void);
 
 extern volatile unsigned int pgfault_num;
+extern struct pgfault_stat pgfault_stat[PGFAULT_NR_KIND];
 extern struct mm_struct *check_mm_struct;
 
 bool user_mem_check(struct mm_struct *mm, uintptr_t start, size_t len, bool write);
@@ -0,0 +1,280 @@
+#include <defs.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <list.h>
+#include <error.h>
+#include <assert.h>
+#include <pmm.h>
+#include <swap.h>
+#include <lz.h>
+#include <zswap.h>
+
+/* *
+ * zswap - a compressed cache of swapped out pages in front of the swap device.
+ *
+ * swap_out offers every page it has to write to zswap_store first: the page
+ * is compressed with lz_compress and kept in memory, indexed by its swap
+ * entry, so it never reaches the disk. swap_in takes it back by zswap_load;
+ * the copy stays until the swap slot is freed (swap_free calls
+ * zswap_invalidate), as the page may be dropped again without being written.
+ * A page is written to the swap device as before if it compresses to nearly
+ * a page, or if the pool already has its maximum number of pages.
+ *
+ * The pool is kept like zbud in Linux: each pool page holds at most two
+ * compressed pages, the first one right after the header chunk and the last
+ * one at the end of the page, in chunks of ZSWAP_CHUNK_SIZE bytes. A pool
+ * page with one of them free sits on unbuddied[n], n its free chunks, so the
+ * best fitting one is found at once. The pool grows a page at a time as long
+ * as pages are free, it never reclaims pages to grow.
+ * */
+
+#define ZSWAP_CHUNK_SHIFT           6
+#define ZSWAP_CHUNK_SIZE            (1 << ZSWAP_CHUNK_SHIFT)
+#define ZSWAP_NR_CHUNKS             (PGSIZE >> ZSWAP_CHUNK_SHIFT)   // the first one holds the header
+
+// the header of a pool page, in its first chunk
+struct zbud_header {
+    list_entry_t buddy_link;        // entry in unbuddied, if one of the two is free
+    uint16_t first_chunks;          // chunks the first compressed page takes, 0 if free
+    uint16_t last_chunks;           // chunks the last compressed page takes, 0 if free
+};
+
+// a compressed page in the pool, the data follows
+struct zswap_entry {
+    list_entry_t hash_link;         // entry in zswap hash list
+    swap_entry_t entry;             // the swap entry the page is stored at
+    size_t length;                  // length of the compressed data
+};
+
+#define le2zhdr(le, member)                         \
+    to_struct((le), struct zbud_header, member)
+#define le2zse(le, member)                          \
+    to_struct((le), struct zswap_entry, member)
+
+// the longest compressed data a pool page holds
+#define ZSWAP_MAX_LENGTH            ((ZSWAP_NR_CHUNKS - 1) * ZSWAP_CHUNK_SIZE - sizeof(struct zswap_entry))
+
+bool zswap_enabled = 0;
+
+static list_entry_t unbuddied[ZSWAP_NR_CHUNKS];
+static list_entry_t hash_list[ZSWAP_HASH_SIZE];
+// the compressed data before it is known to fit, callers do not sleep in zswap_store
+static char zswap_buf[ZSWAP_MAX_LENGTH];
+
+static size_t zswap_max_pool_pages, zswap_pool_pages, zswap_nr_stored, zswap_stored_length;
+static unsigned int zswap_store_num, zswap_reject_full, zswap_reject_poor, zswap_load_hit, zswap_load_miss;
+
+#define zse_hashfn(entry)           (hash32(swap_offset(entry), ZSWAP_HASH_SHIFT))
+
+// zbud_free_chunks - the chunks free in the pool page of zhdr
+static inline int
+zbud_free_chunks(struct zbud_header *zhdr) {
+    return ZSWAP_NR_CHUNKS - 1 - zhdr->first_chunks - zhdr->last_chunks;
+}
+
+// zbud_alloc - find room for chunks chunks in the pool, add a page if none has, return NULL if full
+static void *
+zbud_alloc(int chunks) {
+    struct zbud_header *zhdr;
+    int i;
+    for (i = chunks; i < ZSWAP_NR_CHUNKS; i ++) {
+        if (!list_empty(unbuddied + i)) {
+            zhdr = le2zhdr(list_next(unbuddied + i), buddy_link);
+            list_del(&(zhdr->buddy_link));
+            if (zhdr->first_chunks == 0) {
+                zhdr->first_chunks = chunks;
+                return (char *)zhdr + ZSWAP_CHUNK_SIZE;
+            }
+            zhdr->last_chunks = chunks;
+            return (char *)zhdr + PGSIZE - chunks * ZSWAP_CHUNK_SIZE;
+        }
+    }
+    // alloc_page can not reclaim pages while any is free
+    struct Page *page;
+    if (zswap_pool_pages >= zswap_max_pool_pages || nr_free_pages() == 0 || (page = alloc_page()) == NULL) {
+        return NULL;
+    }
+    zswap_pool_pages ++;
+    zhdr = page2kva(page);
+    zhdr->first_chunks = chunks, zhdr->last_chunks = 0;
+    list_add(unbuddied + zbud_free_chunks(zhdr), &(zhdr->buddy_link));
+    return (char *)zhdr + ZSWAP_CHUNK_SIZE;
+}
+
+// zbud_free - free the room of obj, and its pool page if it is empty now
+static void
+zbud_free(void *obj) {
+    struct zbud_header *zhdr = ROUNDDOWN(obj, PGSIZE);
+    if (zhdr->first_chunks == 0 || zhdr->last_chunks == 0) {
+        list_del(&(zhdr->buddy_link));
+    }
+    if (obj == (char *)zhdr + ZSWAP_CHUNK_SIZE) {
+        zhdr->first_chunks = 0;
+    }
+    else {
+        zhdr->last_chunks = 0;
+    }
+    if (zhdr->first_chunks == 0 && zhdr->last_chunks == 0) {
+        free_page(kva2page(zhdr));
+        zswap_pool_pages --;
+        return;
+    }
+    list_add(unbuddied + zbud_free_chunks(zhdr), &(zhdr->buddy_link));
+}
+
+// zswap_lookup - find the compressed page stored at entry
+static struct zswap_entry *
+zswap_lookup(swap_entry_t entry) {
+    list_entry_t *list = hash_list + zse_hashfn(entry), *le = list;
+    while ((le = list_next(le)) != list) {
+        struct zswap_entry *zse = le2zse(le, hash_link);
+        if (zse->entry == entry) {
+            return zse;
+        }
+    }
+    return NULL;
+}
+
+/* *
+ * zswap_store - compress page into the pool as the content of swap entry
+ * entry: return 0 if stored, -E_INVAL if it hardly compresses, -E_NO_MEM if
+ * the pool is full or disabled.
+ * */
+int
+zswap_store(swap_entry_t entry, struct Page *page) {
+    if (!zswap_enabled) {
+        return -E_NO_MEM;
+    }
+    assert(zswap_lookup(entry) == NULL);
+    size_t length = lz_compress(page2kva(page), PGSIZE, zswap_buf, ZSWAP_MAX_LENGTH);
+    if (length == 0) {
+        zswap_reject_poor ++;
+        return -E_INVAL;
+    }
+    struct zswap_entry *zse;
+    int chunks = ROUNDUP(sizeof(struct zswap_entry) + length, ZSWAP_CHUNK_SIZE) >> ZSWAP_CHUNK_SHIFT;
+    if ((zse = zbud_alloc(chunks)) == NULL) {
+        zswap_reject_full ++;
+        return -E_NO_MEM;
+    }
+    zse->entry = entry, zse->length = length;
+    memcpy(zse + 1, zswap_buf, length);
+    list_add(hash_list + zse_hashfn(entry), &(zse->hash_link));
+    zswap_nr_stored ++, zswap_stored_length += length;
+    zswap_store_num ++;
+    return 0;
+}
+
+// zswap_load - decompress the page stored at entry into page, -E_NOENT if it is not in the pool
+int
+zswap_load(swap_entry_t entry, struct Page *page) {
+    struct zswap_entry *zse;
+    if ((zse = zswap_lookup(entry)) == NULL) {
+        zswap_load_miss ++;
+        return -E_NOENT;
+    }
+    int ret = lz_decompress(zse + 1, zse->length, page2kva(page), PGSIZE);
+    assert(ret == 0);
+    zswap_load_hit ++;
+    return 0;
+}
+
+// zswap_contains - whether the page at entry is in the pool, not on the swap device
+bool
+zswap_contains(swap_entry_t entry) {
+    return zswap_lookup(entry) != NULL;
+}
+
+// zswap_invalidate - drop the page stored at entry, the swap slot is free
+void
+zswap_invalidate(swap_entry_t entry) {
+    struct zswap_entry *zse;
+    if ((zse = zswap_lookup(entry)) != NULL) {
+        list_del(&(zse->hash_link));
+        zswap_nr_stored --, zswap_stored_length -= zse->length;
+        zbud_free(zse);
+    }
+}
+
+void
+zswap_print_stat(void) {
+    size_t ratio = (zswap_stored_length == 0) ? 0 : zswap_nr_stored * PGSIZE * 100 / zswap_stored_length;
+    cprintf("zswap: %s, %u pages in %u of %u pool pages, compression ratio %u.%02u\n",
+            zswap_enabled ? "on" : "off", zswap_nr_stored, zswap_pool_pages, zswap_max_pool_pages,
+            ratio / 100, ratio % 100);
+    cprintf("zswap: %u stored, %u rejected full, %u rejected poorly compressed; %u loads hit, %u missed\n",
+            zswap_store_num, zswap_reject_full, zswap_reject_poor, zswap_load_hit, zswap_load_miss);
+}
+
+/* *
+ * check_zswap - check that compressible pages are stored two to a pool page
+ * and read back intact, that a random page and a page beyond the size of the
+ * pool are rejected, and that the pool pages are freed with the last page.
+ * The entries are free slots of the swap device, nothing swaps yet.
+ * */
+static void
+check_zswap(void) {
+    size_t nr_free_pages_store = nr_free_pages(), max_pool_pages_store = zswap_max_pool_pages;
+    unsigned int hit_store = zswap_load_hit, miss_store = zswap_load_miss;
+    unsigned int full_store = zswap_reject_full, poor_store = zswap_reject_poor;
+    struct Page *pages[4], *page;
+    int i;
+    assert(zswap_pool_pages == 0 && zswap_nr_stored == 0);
+    for (i = 0; i < 4; i ++) {
+        assert((pages[i] = alloc_page()) != NULL);
+    }
+    assert((page = alloc_page()) != NULL);
+    // zero fill with a word, a repeating text, random bytes, and zero fill again
+    memset(page2kva(pages[0]), 0, PGSIZE);
+    *(int *)page2kva(pages[0]) = 0x5a5a;
+    for (i = 0; i < PGSIZE; i ++) {
+        ((char *)page2kva(pages[1]))[i] = "zswap check "[i % 12];
+        ((char *)page2kva(pages[2]))[i] = rand();
+    }
+    memset(page2kva(pages[3]), 0, PGSIZE);
+
+    assert(zswap_store(1 << 8, pages[0]) == 0 && zswap_store(2 << 8, pages[1]) == 0);
+    assert(zswap_pool_pages == 1 && zswap_nr_stored == 2);
+    assert(zswap_store(3 << 8, pages[2]) == -E_INVAL && zswap_reject_poor == poor_store + 1);
+    zswap_max_pool_pages = 1;
+    assert(zswap_store(4 << 8, pages[3]) == -E_NO_MEM && zswap_reject_full == full_store + 1);
+    zswap_max_pool_pages = max_pool_pages_store;
+
+    for (i = 0; i < 3; i ++) {
+        if (zswap_load((i + 1) << 8, page) == 0) {
+            assert(memcmp(page2kva(page), page2kva(pages[i]), PGSIZE) == 0);
+        }
+    }
+    assert(zswap_load_hit == hit_store + 2 && zswap_load_miss == miss_store + 1);
+    assert(zswap_contains(1 << 8) && !zswap_contains(3 << 8));
+
+    zswap_invalidate(1 << 8);
+    assert(zswap_pool_pages == 1);
+    zswap_invalidate(2 << 8);
+    zswap_invalidate(3 << 8);
+    assert(zswap_pool_pages == 0 && zswap_nr_stored == 0 && zswap_stored_length == 0);
+
+    for (i = 0; i < 4; i ++) {
+        free_page(pages[i]);
+    }
+    free_page(page);
+    assert(nr_free_pages_store == nr_free_pages());
+    cprintf("check_zswap() succeeded!\n");
+}
+
+void
+zswap_init(void) {
+    int i;
+    for (i = 0; i < ZSWAP_NR_CHUNKS; i ++) {
+        list_init(unbuddied + i);
+    }
+    for (i = 0; i < ZSWAP_HASH_SIZE; i ++) {
+        list_init(hash_list + i);
+    }
+    zswap_max_pool_pages = nr_free_pages() / ZSWAP_POOL_RATIO;
+    zswap_enabled = 1;
+    check_zswap();
+    cprintf("zswap: pool of at most %u pages\n", zswap_max_pool_pages);
+}
+
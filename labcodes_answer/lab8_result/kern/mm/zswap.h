@@ -0,0 +1,21 @@
+#ifndef __KERN_MM_ZSWAP_H__
+#define __KERN_MM_ZSWAP_H__
+
+#include <defs.h>
+#include <memlayout.h>
+
+#define ZSWAP_POOL_RATIO            8               // the pool takes at most 1/8 of the pages free at boot
+#define ZSWAP_HASH_SHIFT            10
+#define ZSWAP_HASH_SIZE             (1 << ZSWAP_HASH_SHIFT)
+
+extern bool zswap_enabled;
+
+void zswap_init(void);
+int zswap_store(swap_entry_t entry, struct Page *page);
+int zswap_load(swap_entry_t entry, struct Page *page);
+bool zswap_contains(swap_entry_t entry);
+void zswap_invalidate(swap_entry_t entry);
+void zswap_print_stat(void);
+
+#endif /* !__KERN_MM_ZSWAP_H__ */
+
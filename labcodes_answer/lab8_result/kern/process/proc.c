@@ -1,5 +1,6 @@
 #include <proc.h>
 #include <kmalloc.h>
+#include <slab.h>
 #include <string.h>
 #include <sync.h>
 #include <pmm.h>
@@ -7,6 +8,7 @@
 #include <sched.h>
 #include <elf.h>
 #include <vmm.h>
+#include <swap.h>
 #include <trap.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,6 +17,7 @@
 #include <fs.h>
 #include <vfs.h>
 #include <sysfile.h>
+#include <file.h>
 
 /* ------------- process/thread mechanism design&implementation -------------
 (an simplified Linux process/thread mechanism )
@@ -80,15 +83,19 @@ struct proc_struct *initproc = NULL;
 struct proc_struct *current = NULL;
 
 static int nr_process = 0;
+// the number of kernel daemons (children of idleproc besides initproc)
+static int nr_daemon = 0;
 
 void kernel_thread_entry(void);
 void forkrets(struct trapframe *tf);
 void switch_to(struct context *from, struct context *to);
 
+static kmem_cache_t *proc_cachep;
+
 // alloc_proc - alloc a proc_struct and init all fields of proc_struct
 static struct proc_struct *
 alloc_proc(void) {
-    struct proc_struct *proc = kmalloc(sizeof(struct proc_struct));
+    struct proc_struct *proc = kmem_cache_alloc(proc_cachep);
     if (proc != NULL) {
     //LAB4:EXERCISE1 YOUR CODE
     /*
@@ -133,6 +140,9 @@ alloc_proc(void) {
         proc->lab6_run_pool.left = proc->lab6_run_pool.right = proc->lab6_run_pool.parent = NULL;
         proc->lab6_stride = 0;
         proc->lab6_priority = 0;
+        proc->mlfq_level = proc->mlfq_used = 0;
+        proc->mlfq_boost = 0;
+        proc->cfs_vruntime = proc->cfs_exec_start = 0;
         proc->filesp = NULL;
     }
     return proc;
@@ -284,6 +294,19 @@ kernel_thread(int (*fn)(void *), void *arg, uint32_t clone_flags) {
     return do_fork(clone_flags | CLONE_VM, 0, &tf);
 }
 
+// kernel_daemon - create a kernel thread living as long as the kernel (e.g. bflushd),
+//               - must be called by idleproc during kern_init, so the daemon is a child of idleproc
+int
+kernel_daemon(int (*fn)(void *), void *arg, const char *name) {
+    assert(current == idleproc);
+    int pid;
+    if ((pid = kernel_thread(fn, arg, 0)) > 0) {
+        set_proc_name(find_proc(pid), name);
+        nr_daemon ++;
+    }
+    return pid;
+}
+
 // setup_kstack - alloc pages with size KSTACKPAGE as process kernel stack
 static int
 setup_kstack(struct proc_struct *proc) {
@@ -327,8 +350,8 @@ static int
 copy_mm(uint32_t clone_flags, struct proc_struct *proc) {
     struct mm_struct *mm, *oldmm = current->mm;
 
-    /* current is a kernel thread */
-    if (oldmm == NULL) {
+    /* current is a kernel thread, or the child will load a new program itself */
+    if (oldmm == NULL || (clone_flags & CLONE_SPAWN)) {
         return 0;
     }
     if (clone_flags & CLONE_VM) {
@@ -509,7 +532,7 @@ bad_fork_cleanup_fs:  //for LAB8
 bad_fork_cleanup_kstack:
     put_kstack(proc);
 bad_fork_cleanup_proc:
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     goto fork_out;
 }
 
@@ -627,7 +650,10 @@ load_icode(int fd, int argc, char **kargv) {
         goto bad_pgdir_cleanup_mm;
     }
 
-    struct Page *page;
+    struct inode *node;
+    if ((ret = file_node(fd, &node)) != 0) {
+        goto bad_elf_cleanup_pgdir;
+    }
 
     struct elfhdr __elf, *elf = &__elf;
     if ((ret = load_icode_read(fd, elf, sizeof(struct elfhdr), 0)) != 0) {
@@ -639,8 +665,12 @@ load_icode(int fd, int argc, char **kargv) {
         goto bad_elf_cleanup_pgdir;
     }
 
+    /* the segments are not read here: each one becomes a vma backed by the
+     * program file, and do_pgfault reads a page in (or zero-fills the .bss
+     * part) when it is touched for the first time */
     struct proghdr __ph, *ph = &__ph;
-    uint32_t vm_flags, perm, phnum;
+    struct vma_struct *vma;
+    uint32_t vm_flags, phnum;
     for (phnum = 0; phnum < elf->e_phnum; phnum ++) {
         off_t phoff = elf->e_phoff + sizeof(struct proghdr) * phnum;
         if ((ret = load_icode_read(fd, ph, sizeof(struct proghdr), phoff)) != 0) {
@@ -656,62 +686,15 @@ load_icode(int fd, int argc, char **kargv) {
         if (ph->p_filesz == 0) {
             continue ;
         }
-        vm_flags = 0, perm = PTE_U;
+        vm_flags = 0;
         if (ph->p_flags & ELF_PF_X) vm_flags |= VM_EXEC;
         if (ph->p_flags & ELF_PF_W) vm_flags |= VM_WRITE;
         if (ph->p_flags & ELF_PF_R) vm_flags |= VM_READ;
-        if (vm_flags & VM_WRITE) perm |= PTE_W;
-        if ((ret = mm_map(mm, ph->p_va, ph->p_memsz, vm_flags, NULL)) != 0) {
+        if ((ret = mm_map(mm, ph->p_va, ph->p_memsz, vm_flags, &vma)) != 0) {
             goto bad_cleanup_mmap;
         }
-        off_t offset = ph->p_offset;
-        size_t off, size;
-        uintptr_t start = ph->p_va, end, la = ROUNDDOWN(start, PGSIZE);
-
-        ret = -E_NO_MEM;
-
-        end = ph->p_va + ph->p_filesz;
-        while (start < end) {
-            if ((page = pgdir_alloc_page(mm->pgdir, la, perm)) == NULL) {
-                ret = -E_NO_MEM;
-                goto bad_cleanup_mmap;
-            }
-            off = start - la, size = PGSIZE - off, la += PGSIZE;
-            if (end < la) {
-                size -= la - end;
-            }
-            if ((ret = load_icode_read(fd, page2kva(page) + off, size, offset)) != 0) {
-                goto bad_cleanup_mmap;
-            }
-            start += size, offset += size;
-        }
-        end = ph->p_va + ph->p_memsz;
-
-        if (start < la) {
-            /* ph->p_memsz == ph->p_filesz */
-            if (start == end) {
-                continue ;
-            }
-            off = start + PGSIZE - la, size = PGSIZE - off;
-            if (end < la) {
-                size -= la - end;
-            }
-            memset(page2kva(page) + off, 0, size);
-            start += size;
-            assert((end < la && start == end) || (end >= la && start == la));
-        }
-        while (start < end) {
-            if ((page = pgdir_alloc_page(mm->pgdir, la, perm)) == NULL) {
-                ret = -E_NO_MEM;
-                goto bad_cleanup_mmap;
-            }
-            off = start - la, size = PGSIZE - off, la += PGSIZE;
-            if (end < la) {
-                size -= la - end;
-            }
-            memset(page2kva(page) + off, 0, size);
-            start += size;
-        }
+        vma_set_file(vma, node, ph->p_offset, ph->p_va, ph->p_filesz);
+        vma_map_cached(mm, vma);
     }
     sysfile_close(fd);
 
@@ -723,6 +706,12 @@ load_icode(int fd, int argc, char **kargv) {
     assert(pgdir_alloc_page(mm->pgdir, USTACKTOP-2*PGSIZE , PTE_USER) != NULL);
     assert(pgdir_alloc_page(mm->pgdir, USTACKTOP-3*PGSIZE , PTE_USER) != NULL);
     assert(pgdir_alloc_page(mm->pgdir, USTACKTOP-4*PGSIZE , PTE_USER) != NULL);
+    if (swap_init_ok) {
+        uintptr_t la;
+        for (la = USTACKTOP - 4 * PGSIZE; la < USTACKTOP; la += PGSIZE) {
+            swap_map_swappable(mm, la, pte2page(*get_pte(mm->pgdir, la, 0)), 0);
+        }
+    }
     
     mm_count_inc(mm);
     current->mm = mm;
@@ -801,6 +790,29 @@ failed_cleanup:
     return ret;
 }
 
+// copy_exec_args - copy the program name and argv of exec/spawn from user space
+//                  to local_name and kargv, release kargv by put_kargv
+static int
+copy_exec_args(const char *name, int argc, const char **argv, char *local_name, char **kargv) {
+    struct mm_struct *mm = current->mm;
+    int ret = -E_INVAL;
+
+    memset(local_name, 0, PROC_NAME_LEN + 1);
+    lock_mm(mm);
+    if (name == NULL) {
+        snprintf(local_name, PROC_NAME_LEN + 1, "<null> %d", current->pid);
+    }
+    else {
+        if (!copy_string(mm, local_name, name, PROC_NAME_LEN + 1)) {
+            goto out;
+        }
+    }
+    ret = copy_kargv(mm, argc, kargv, argv);
+out:
+    unlock_mm(mm);
+    return ret;
+}
+
 // do_execve - call exit_mmap(mm)&put_pgdir(mm) to reclaim memory space of current process
 //           - call load_icode to setup new memory space accroding binary prog.
 int
@@ -812,29 +824,15 @@ do_execve(const char *name, int argc, const char **argv) {
     }
 
     char local_name[PROC_NAME_LEN + 1];
-    memset(local_name, 0, sizeof(local_name));
-    
     char *kargv[EXEC_MAX_ARG_NUM];
     const char *path;
     
-    int ret = -E_INVAL;
-    
-    lock_mm(mm);
-    if (name == NULL) {
-        snprintf(local_name, sizeof(local_name), "<null> %d", current->pid);
-    }
-    else {
-        if (!copy_string(mm, local_name, name, sizeof(local_name))) {
-            unlock_mm(mm);
-            return ret;
-        }
-    }
-    if ((ret = copy_kargv(mm, argc, kargv, argv)) != 0) {
-        unlock_mm(mm);
+    int ret;
+    if ((ret = copy_exec_args(name, argc, argv, local_name, kargv)) != 0) {
         return ret;
     }
+    /* argv[0] has been checked by copy_exec_args */
     path = argv[0];
-    unlock_mm(mm);
     files_closeall(current->filesp);
 
     /* sysfile_open will check the first argument path, thus we have to use a user-space pointer, and argv[0] may be incorrect */    
@@ -865,6 +863,99 @@ execve_exit:
     panic("already exit: %e.\n", ret);
 }
 
+/* *
+ * spawn_args - what the child of do_spawn needs to load its program, the
+ *              child frees it after load_icode
+ * */
+struct spawn_args {
+    int fd;                                     // the program file, opened in the child's files
+    int argc;
+    char *kargv[EXEC_MAX_ARG_NUM];
+    char name[PROC_NAME_LEN + 1];
+};
+
+// spawn_entry - the child of do_spawn starts here as a kernel thread without mm,
+//             - loads its program like do_execve and returns to user mode
+static int
+spawn_entry(void *arg) {
+    struct spawn_args *sa = (struct spawn_args *)arg;
+    struct trapframe tf;
+    int ret;
+
+    assert(current->mm == NULL);
+    /* this stack started inside the trapframe current->tf points to (there was
+     * no trap to come here), so load_icode must build the user context elsewhere */
+    current->tf = &tf;
+    files_closeall_except(current->filesp, sa->fd);
+    if ((ret = load_icode(sa->fd, sa->argc, sa->kargv)) != 0) {
+        /* fd is closed by do_exit */
+        put_kargv(sa->argc, sa->kargv);
+        kfree(sa);
+        return ret;
+    }
+    set_proc_name(current, sa->name);
+    put_kargv(sa->argc, sa->kargv);
+    kfree(sa);
+
+    /* load_icode has set up tf for user mode */
+    forkrets(&tf);
+    panic("spawn_entry: forkrets returned.\n");
+}
+
+/* do_spawn - create a child process running the program argv[0] directly,
+ *            as fork + exec would do, but without duplicating the mm of
+ *            current: the child starts without mm and builds a new one by
+ *            load_icode. the child inherits the files of current except
+ *            those exec would close.
+ * return the pid of the child, or an error if the program can not be opened.
+ */
+int
+do_spawn(const char *name, int argc, const char **argv) {
+    if (!(argc >= 1 && argc <= EXEC_MAX_ARG_NUM)) {
+        return -E_INVAL;
+    }
+
+    struct spawn_args *sa;
+    if ((sa = kmalloc(sizeof(struct spawn_args))) == NULL) {
+        return -E_NO_MEM;
+    }
+
+    int ret;
+    if ((ret = copy_exec_args(name, argc, argv, sa->name, sa->kargv)) != 0) {
+        goto failed_cleanup_sa;
+    }
+    sa->argc = argc;
+
+    /* open the program here so that a bad path is reported to the caller,
+     * the child gets its own copy of fd by copy_fs */
+    if ((ret = sa->fd = sysfile_open(argv[0], O_RDONLY)) < 0) {
+        goto failed_cleanup_kargv;
+    }
+
+    struct trapframe tf;
+    memset(&tf, 0, sizeof(struct trapframe));
+    tf.tf_cs = KERNEL_CS;
+    tf.tf_ds = tf.tf_es = tf.tf_ss = KERNEL_DS;
+    tf.tf_regs.reg_ebx = (uint32_t)spawn_entry;
+    tf.tf_regs.reg_edx = (uint32_t)sa;
+    tf.tf_eip = (uint32_t)kernel_thread_entry;
+
+    int fd = sa->fd;
+    if ((ret = do_fork(CLONE_SPAWN, 0, &tf)) < 0) {
+        sysfile_close(fd);
+        goto failed_cleanup_kargv;
+    }
+    /* sa belongs to the child now */
+    sysfile_close(fd);
+    return ret;
+
+failed_cleanup_kargv:
+    put_kargv(argc, sa->kargv);
+failed_cleanup_sa:
+    kfree(sa);
+    return ret;
+}
+
 // do_yield - ask the scheduler to reschedule
 int
 do_yield(void) {
@@ -931,7 +1022,7 @@ found:
     }
     local_intr_restore(intr_flag);
     put_kstack(proc);
-    kfree(proc);
+    kmem_cache_free(proc_cachep, proc);
     return 0;
 }
 
@@ -1023,9 +1114,12 @@ init_main(void *arg) {
         
     cprintf("all user-mode processes have quit.\n");
     assert(initproc->cptr == NULL && initproc->yptr == NULL && initproc->optr == NULL);
-    assert(nr_process == 2);
-    assert(list_next(&proc_list) == &(initproc->list_link));
-    assert(list_prev(&proc_list) == &(initproc->list_link));
+    assert(nr_process == 2 + nr_daemon);
+    list_entry_t *le = &proc_list;
+    while ((le = list_next(le)) != &proc_list) {
+        // only initproc and kernel daemons are left
+        assert(le2proc(le, list_link)->parent == idleproc);
+    }
     assert(nr_free_pages_store == nr_free_pages());
     assert(kernel_allocated_store == kallocated());
     cprintf("init check memory pass.\n");
@@ -1043,6 +1137,11 @@ proc_init(void) {
         list_init(hash_list + i);
     }
 
+    if ((proc_cachep = kmem_cache_create("proc_struct", sizeof(struct proc_struct), NULL)) == NULL) {
+        panic("cannot create proc_struct cache.\n");
+    }
+    files_init();
+
     if ((idleproc = alloc_proc()) == NULL) {
         panic("cannot alloc idleproc.\n");
     }
@@ -1081,6 +1180,7 @@ cpu_idle(void) {
         if (current->need_resched) {
             schedule();
         }
+        sched_idle();
     }
 }
 
@@ -1113,3 +1213,23 @@ do_sleep(unsigned int time) {
     del_timer(timer);
     return 0;
 }
+
+// do_usleep - like do_sleep, for us microseconds measured by a high resolution timer
+int
+do_usleep(unsigned int us) {
+    if (us == 0) {
+        return 0;
+    }
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    hrtimer_t __timer, *timer = hrtimer_init(&__timer, current, us);
+    current->state = PROC_SLEEPING;
+    current->wait_state = WT_TIMER;
+    add_hrtimer(timer);
+    local_intr_restore(intr_flag);
+
+    schedule();
+
+    del_hrtimer(timer);
+    return 0;
+}
@@ -66,6 +66,11 @@ struct proc_struct {
     skew_heap_entry_t lab6_run_pool;            // FOR LAB6 ONLY: the entry in the run pool
     uint32_t lab6_stride;                       // FOR LAB6 ONLY: the current stride of the process
     uint32_t lab6_priority;                     // FOR LAB6 ONLY: the priority of process, set by lab6_set_priority(uint32_t)
+    int mlfq_level;                             // mlfq: the queue of the process, 0 the highest
+    int mlfq_used;                              // mlfq: ticks used at that level
+    unsigned int mlfq_boost;                    // mlfq: the priority boost of the run queue seen last
+    uint64_t cfs_vruntime;                      // cfs: TSC cycles run, divided by the weight
+    uint64_t cfs_exec_start;                    // cfs: TSC when last charged while running, 0 if not running
     struct files_struct *filesp;                // the file related info(pwd, files_count, files_array, fs_semaphore) of process
 };
 
@@ -76,6 +81,9 @@ struct proc_struct {
 #define WT_KSEM                      0x00000100                    // wait kernel semaphore
 #define WT_TIMER                    (0x00000002 | WT_INTERRUPTED)  // wait timer
 #define WT_KBD                      (0x00000004 | WT_INTERRUPTED)  // wait the input of keyboard
+#define WT_IDE                       0x00000200                    // wait the completion of ide request
+#define WT_KSWAPD                    0x00000400                    // kswapd waits for free pages to run low
+#define WT_PCACHE                    0x00000800                    // wait for a page of the page cache being read in
 
 #define le2proc(le, member)         \
     to_struct((le), struct proc_struct, member)
@@ -85,6 +93,7 @@ extern struct proc_struct *idleproc, *initproc, *current;
 void proc_init(void);
 void proc_run(struct proc_struct *proc);
 int kernel_thread(int (*fn)(void *), void *arg, uint32_t clone_flags);
+int kernel_daemon(int (*fn)(void *), void *arg, const char *name);
 
 char *set_proc_name(struct proc_struct *proc, const char *name);
 char *get_proc_name(struct proc_struct *proc);
@@ -95,10 +104,12 @@ int do_fork(uint32_t clone_flags, uintptr_t stack, struct trapframe *tf);
 int do_exit(int error_code);
 int do_yield(void);
 int do_execve(const char *name, int argc, const char **argv);
+int do_spawn(const char *name, int argc, const char **argv);
 int do_wait(int pid, int *code_store);
 int do_kill(int pid);
 //FOR LAB6, set the process's priority (bigger value will get more CPU time)
 void lab6_set_priority(uint32_t priority);
 int do_sleep(unsigned int time);
+int do_usleep(unsigned int us);
 #endif /* !__KERN_PROCESS_PROC_H__ */
 
@@ -0,0 +1,239 @@
+#include <defs.h>
+#include <x86.h>
+#include <list.h>
+#include <proc.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <clock.h>
+#include <cfs_sched.h>
+
+/* *
+ * Completely fair scheduler
+ *
+ * Every process has a virtual runtime: the TSC cycles it has run, scaled by
+ * CFS_WEIGHT_UNIT / its weight, so a process of twice the weight ages half as
+ * fast. The run queue is the skew heap of the stride scheduler, ordered by
+ * vruntime instead of stride, and the process which has had the least of its
+ * share runs next. Unlike the stride, which is charged a whole pass when the
+ * process is picked whether it runs a tick or yields at once, vruntime is
+ * charged for the cycles actually run: on every tick, and when the process
+ * leaves the CPU (see cfs_enqueue and cfs_pick_next).
+ *
+ * The weight is lab6_priority times CFS_WEIGHT_UNIT, 0 counting as 1, so the
+ * shares user/priority.c expects from the stride scheduler hold here too.
+ *
+ * rq->cfs_min_vruntime follows the smallest vruntime of the runnable
+ * processes and never goes back. A process woken up, or a new one, starts no
+ * earlier than CFS_SLEEPER_US before it: it gets to run soon, but cannot
+ * claim the CPU for the whole time it slept. If it is then more than
+ * CFS_WAKEUP_GRAN_US behind the running process, it preempts it.
+ * */
+
+#define CFS_WEIGHT_UNIT         1024        // weight of lab6_priority 0 or 1
+#define CFS_WAKEUP_GRAN_US      (TICK_US / 2)   // lag which makes a woken process preempt
+#define CFS_SLEEPER_US          TICK_US     // credit of a woken process
+#define CFS_TICK_GRAN_US        TICK_US     // lag which makes the tick switch processes
+
+// vruntime comparisons, right across the wrap of uint64_t
+#define cfs_before(a, b)        ((int64_t)((a) - (b)) < 0)
+
+static inline uint32_t
+cfs_weight(struct proc_struct *proc) {
+    return (proc->lab6_priority == 0 ? 1 : proc->lab6_priority) * CFS_WEIGHT_UNIT;
+}
+
+// cfs_cycles - us in TSC cycles, 0 before the TSC is calibrated
+static inline uint64_t
+cfs_cycles(uint32_t us) {
+    uint64_t cycles = (uint64_t)us * tsc_khz;
+    do_div(cycles, 1000);
+    return cycles;
+}
+
+static int
+proc_vruntime_comp_f(void *a, void *b) {
+    struct proc_struct *p = le2proc(a, lab6_run_pool);
+    struct proc_struct *q = le2proc(b, lab6_run_pool);
+    if (cfs_before(q->cfs_vruntime, p->cfs_vruntime)) return 1;
+    else if (p->cfs_vruntime == q->cfs_vruntime) return 0;
+    else return -1;
+}
+
+static inline struct proc_struct *
+cfs_leftmost(struct run_queue *rq) {
+    return (rq->lab6_run_pool == NULL) ? NULL : le2proc(rq->lab6_run_pool, lab6_run_pool);
+}
+
+// cfs_update_min - move rq->cfs_min_vruntime up to the least vruntime of curr and the queued
+static void
+cfs_update_min(struct run_queue *rq, struct proc_struct *curr) {
+    struct proc_struct *left = cfs_leftmost(rq);
+    if (curr == NULL || (left != NULL && cfs_before(left->cfs_vruntime, curr->cfs_vruntime))) {
+        curr = left;
+    }
+    if (curr != NULL && cfs_before(rq->cfs_min_vruntime, curr->cfs_vruntime)) {
+        rq->cfs_min_vruntime = curr->cfs_vruntime;
+    }
+}
+
+// cfs_account - charge proc, which is not queued, for delta cycles run
+static void
+cfs_account(struct run_queue *rq, struct proc_struct *proc, uint64_t delta) {
+    delta *= CFS_WEIGHT_UNIT;
+    do_div(delta, cfs_weight(proc));
+    proc->cfs_vruntime += delta;
+    cfs_update_min(rq, proc);
+}
+
+// cfs_update - charge the running proc for the cycles since it was charged last
+static void
+cfs_update(struct run_queue *rq, struct proc_struct *proc, uint64_t now) {
+    if (proc->cfs_exec_start != 0) {
+        cfs_account(rq, proc, now - proc->cfs_exec_start);
+        proc->cfs_exec_start = now;
+    }
+}
+
+static void
+cfs_init(struct run_queue *rq) {
+    list_init(&(rq->run_list));
+    rq->lab6_run_pool = NULL;
+    rq->proc_num = 0;
+    rq->cfs_min_vruntime = 0;
+}
+
+static void
+cfs_enqueue(struct run_queue *rq, struct proc_struct *proc) {
+    if (proc->cfs_exec_start != 0) {
+        // preempted: it keeps its place
+        cfs_update(rq, proc, read_tsc());
+        proc->cfs_exec_start = 0;
+    }
+    else {
+        uint64_t vmin = rq->cfs_min_vruntime - cfs_cycles(CFS_SLEEPER_US);
+        if (cfs_before(proc->cfs_vruntime, vmin)) {
+            proc->cfs_vruntime = vmin;
+        }
+    }
+    rq->lab6_run_pool =
+        skew_heap_insert(rq->lab6_run_pool, &(proc->lab6_run_pool), proc_vruntime_comp_f);
+    if (proc->time_slice == 0 || proc->time_slice > rq->max_time_slice) {
+        proc->time_slice = rq->max_time_slice;
+    }
+    proc->rq = rq;
+    rq->proc_num ++;
+    if (proc != current && current != NULL && current->cfs_exec_start != 0) {
+        cfs_update(rq, current, read_tsc());
+        if (cfs_before(proc->cfs_vruntime + cfs_cycles(CFS_WAKEUP_GRAN_US), current->cfs_vruntime)) {
+            current->need_resched = 1;
+        }
+    }
+}
+
+static void
+cfs_dequeue(struct run_queue *rq, struct proc_struct *proc) {
+    rq->lab6_run_pool =
+        skew_heap_remove(rq->lab6_run_pool, &(proc->lab6_run_pool), proc_vruntime_comp_f);
+    rq->proc_num --;
+}
+
+static struct proc_struct *
+cfs_pick_next(struct run_queue *rq) {
+    uint64_t now = read_tsc();
+    struct proc_struct *next;
+    // current is going to sleep or exit, else cfs_enqueue has charged it already
+    if (current != NULL && current->cfs_exec_start != 0) {
+        cfs_update(rq, current, now);
+        current->cfs_exec_start = 0;
+    }
+    if ((next = cfs_leftmost(rq)) != NULL) {
+        next->cfs_exec_start = now;
+    }
+    return next;
+}
+
+static void
+cfs_proc_tick(struct run_queue *rq, struct proc_struct *proc) {
+    struct proc_struct *left;
+    cfs_update(rq, proc, read_tsc());
+    if (proc->time_slice > 0) {
+        proc->time_slice --;
+    }
+    if (proc->time_slice == 0) {
+        proc->need_resched = 1;
+    }
+    else if ((left = cfs_leftmost(rq)) != NULL
+             && cfs_before(left->cfs_vruntime + cfs_cycles(CFS_TICK_GRAN_US), proc->cfs_vruntime)) {
+        proc->need_resched = 1;
+    }
+}
+
+struct sched_class cfs_sched_class = {
+    .name = "cfs_scheduler",
+    .init = cfs_init,
+    .enqueue = cfs_enqueue,
+    .dequeue = cfs_dequeue,
+    .pick_next = cfs_pick_next,
+    .proc_tick = cfs_proc_tick,
+};
+
+#define CHECK_CFS_NPROC         3
+#define CHECK_CFS_ROUNDS        600
+#define CHECK_CFS_CYCLES        1000        // cycles charged for a turn
+
+/* *
+ * check_cfs - on a run queue of its own, let processes of priority 1, 2 and 3
+ * take turns, each run charged CHECK_CFS_CYCLES, and check they get shares
+ * of 1:2:3; then check where a process which slept a long time starts.
+ * */
+void
+check_cfs(void) {
+    static struct proc_struct procs[CHECK_CFS_NPROC];
+    uint64_t run[CHECK_CFS_NPROC], total = 0, share;
+    struct run_queue __rq, *rq = &__rq;
+    struct proc_struct *p;
+    int i;
+    memset(procs, 0, sizeof(procs));
+    cfs_init(rq);
+    rq->max_time_slice = 5;
+    for (i = 0; i < CHECK_CFS_NPROC; i ++) {
+        procs[i].lab6_priority = i + 1;
+        run[i] = 0;
+        cfs_enqueue(rq, procs + i);
+    }
+    for (i = 0; i < CHECK_CFS_ROUNDS; i ++) {
+        p = cfs_leftmost(rq);
+        cfs_dequeue(rq, p);
+        cfs_account(rq, p, CHECK_CFS_CYCLES);
+        run[p - procs] += CHECK_CFS_CYCLES;
+        total += CHECK_CFS_CYCLES;
+        cfs_enqueue(rq, p);
+    }
+    // priority 1 gets 1/6 of the time, give or take a turn
+    for (i = 0; i < CHECK_CFS_NPROC; i ++) {
+        share = total * (i + 1);
+        do_div(share, 6);
+        assert(run[i] + CHECK_CFS_CYCLES >= share && run[i] <= share + CHECK_CFS_CYCLES);
+    }
+    assert(rq->proc_num == CHECK_CFS_NPROC);
+
+    // procs[0] sleeps while the others run, and is not owed all that time
+    p = procs;
+    cfs_dequeue(rq, p);
+    while (!cfs_before(p->cfs_vruntime, rq->cfs_min_vruntime - cfs_cycles(CFS_SLEEPER_US))) {
+        struct proc_struct *q = cfs_leftmost(rq);
+        cfs_dequeue(rq, q);
+        cfs_account(rq, q, CHECK_CFS_CYCLES);
+        cfs_enqueue(rq, q);
+    }
+    cfs_enqueue(rq, p);
+    assert(p->cfs_vruntime == rq->cfs_min_vruntime - cfs_cycles(CFS_SLEEPER_US));
+    assert(!cfs_before(cfs_leftmost(rq)->cfs_vruntime, p->cfs_vruntime));
+    for (i = 0; i < CHECK_CFS_NPROC; i ++) {
+        cfs_dequeue(rq, procs + i);
+    }
+    assert(rq->proc_num == 0 && rq->lab6_run_pool == NULL);
+    cprintf("check_cfs() succeeded!\n");
+}
+
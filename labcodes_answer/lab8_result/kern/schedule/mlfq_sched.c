@@ -0,0 +1,216 @@
+#include <defs.h>
+#include <list.h>
+#include <proc.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <clock.h>
+#include <mlfq_sched.h>
+
+/* *
+ * Multi-level feedback queue scheduler, after the rules of OSTEP chapter 8
+ * (see related_info/ostep/ostep9-mlfq.py):
+ *   1. a process of a higher level runs before one of a lower level, a
+ *      process woken up preempts the running one if its level is higher;
+ *   2. processes of the same level take turns, mlfq_quantum[level] ticks each;
+ *   3. a new process starts at the highest level, 0;
+ *   4. once a process has used mlfq_allotment[level] ticks at its level, no
+ *      matter how often it gave up the CPU in between, it moves one level down;
+ *   5. every MLFQ_BOOST_TICKS all processes move back to the highest level.
+ * A process which sleeps most of the time, like the shell, so stays at the
+ * top and runs as soon as it wakes up, while the processes burning CPU sink
+ * and share what is left, and rule 5 keeps them from starving.
+ *
+ * A boost moves the queued processes at once; the others, sleeping or
+ * running, see that rq->mlfq_boost has changed when they are queued or tick.
+ * */
+
+#define MLFQ_BOOST_TICKS        100         // ticks between two priority boosts
+
+// ticks a process runs before the others of its level get their turn
+static const int mlfq_quantum[MLFQ_NR_LEVELS] = {2, 4, 8};
+// ticks a process may use at a level before it moves down, 0 for the lowest level
+static const int mlfq_allotment[MLFQ_NR_LEVELS] = {4, 16, 0};
+
+static void
+mlfq_init(struct run_queue *rq) {
+    int level;
+    list_init(&(rq->run_list));
+    for (level = 0; level < MLFQ_NR_LEVELS; level ++) {
+        list_init(rq->mlfq_list + level);
+    }
+    rq->proc_num = 0;
+    rq->mlfq_boost = 0;
+    rq->mlfq_boost_tick = ticks;
+}
+
+// mlfq_check_boost - move every process back to the highest level, if it is time to
+static void
+mlfq_check_boost(struct run_queue *rq) {
+    int level;
+    if (ticks - rq->mlfq_boost_tick < MLFQ_BOOST_TICKS) {
+        return;
+    }
+    rq->mlfq_boost ++;
+    rq->mlfq_boost_tick = ticks;
+    for (level = 1; level < MLFQ_NR_LEVELS; level ++) {
+        list_entry_t *list = rq->mlfq_list + level, *le;
+        while ((le = list_next(list)) != list) {
+            struct proc_struct *proc = le2proc(le, run_link);
+            list_del(le);
+            list_add_before(rq->mlfq_list, le);
+            proc->mlfq_level = proc->mlfq_used = 0;
+            proc->mlfq_boost = rq->mlfq_boost;
+        }
+    }
+}
+
+// mlfq_update - bring the level of proc up to date with the boosts it has missed
+static void
+mlfq_update(struct run_queue *rq, struct proc_struct *proc) {
+    if (proc->mlfq_boost != rq->mlfq_boost) {
+        proc->mlfq_level = proc->mlfq_used = 0;
+        proc->mlfq_boost = rq->mlfq_boost;
+    }
+}
+
+static void
+mlfq_enqueue(struct run_queue *rq, struct proc_struct *proc) {
+    assert(list_empty(&(proc->run_link)));
+    mlfq_update(rq, proc);
+    list_add_before(rq->mlfq_list + proc->mlfq_level, &(proc->run_link));
+    // a process preempted, or going to sleep, keeps the rest of its quantum
+    if (proc->time_slice <= 0 || proc->time_slice > mlfq_quantum[proc->mlfq_level]) {
+        proc->time_slice = mlfq_quantum[proc->mlfq_level];
+    }
+    proc->rq = rq;
+    rq->proc_num ++;
+    if (proc != current && current != idleproc && current->rq == rq
+        && proc->mlfq_level < current->mlfq_level) {
+        current->need_resched = 1;
+    }
+}
+
+static void
+mlfq_dequeue(struct run_queue *rq, struct proc_struct *proc) {
+    assert(!list_empty(&(proc->run_link)) && proc->rq == rq);
+    list_del_init(&(proc->run_link));
+    rq->proc_num --;
+}
+
+static struct proc_struct *
+mlfq_pick_next(struct run_queue *rq) {
+    int level;
+    mlfq_check_boost(rq);
+    for (level = 0; level < MLFQ_NR_LEVELS; level ++) {
+        if (!list_empty(rq->mlfq_list + level)) {
+            return le2proc(list_next(rq->mlfq_list + level), run_link);
+        }
+    }
+    return NULL;
+}
+
+static void
+mlfq_proc_tick(struct run_queue *rq, struct proc_struct *proc) {
+    int level;
+    mlfq_update(rq, proc);
+    proc->mlfq_used ++;
+    if (proc->time_slice > 0) {
+        proc->time_slice --;
+    }
+    level = proc->mlfq_level;
+    if (mlfq_allotment[level] != 0 && proc->mlfq_used >= mlfq_allotment[level]) {
+        proc->mlfq_level ++, proc->mlfq_used = 0;
+        proc->time_slice = 0;
+    }
+    if (proc->time_slice == 0) {
+        proc->need_resched = 1;
+    }
+    // a boost, or a process of a higher level queued meanwhile
+    mlfq_check_boost(rq);
+    for (level = 0; level < proc->mlfq_level; level ++) {
+        if (!list_empty(rq->mlfq_list + level)) {
+            proc->need_resched = 1;
+            break;
+        }
+    }
+}
+
+struct sched_class mlfq_sched_class = {
+    .name = "mlfq_scheduler",
+    .init = mlfq_init,
+    .enqueue = mlfq_enqueue,
+    .dequeue = mlfq_dequeue,
+    .pick_next = mlfq_pick_next,
+    .proc_tick = mlfq_proc_tick,
+};
+
+#define CHECK_MLFQ_NPROC        3
+
+/* *
+ * check_mlfq - check the rules above on a run queue of its own, with three
+ * processes which are never run: proc 0 burns CPU, proc 1 sleeps after each
+ * tick, and proc 2 comes later.
+ * */
+void
+check_mlfq(void) {
+    static struct proc_struct procs[CHECK_MLFQ_NPROC];
+    struct run_queue __rq, *rq = &__rq;
+    struct proc_struct *p = procs, *io = procs + 1, *late = procs + 2;
+    int i, t;
+    memset(procs, 0, sizeof(procs));
+    for (i = 0; i < CHECK_MLFQ_NPROC; i ++) {
+        list_init(&(procs[i].run_link));
+    }
+    mlfq_init(rq);
+    mlfq_enqueue(rq, p);
+    mlfq_enqueue(rq, io);
+
+    // p uses its quantum, then io runs one tick and sleeps; p sinks, io stays
+    for (i = 0; i < mlfq_allotment[0] / mlfq_quantum[0]; i ++) {
+        assert(mlfq_pick_next(rq) == p);
+        mlfq_dequeue(rq, p);
+        for (t = 0; t < mlfq_quantum[0]; t ++) {
+            mlfq_proc_tick(rq, p);
+        }
+        assert(p->need_resched);
+        p->need_resched = 0;
+        mlfq_enqueue(rq, p);
+        assert(mlfq_pick_next(rq) == io);
+        mlfq_dequeue(rq, io);
+        mlfq_proc_tick(rq, io);
+        mlfq_enqueue(rq, io);
+    }
+    assert(p->mlfq_level == 1 && io->mlfq_level == 0);
+
+    // io has used its allotment too, however often it slept: it sinks next tick
+    for (i = io->mlfq_used; i < mlfq_allotment[0]; i ++) {
+        assert(mlfq_pick_next(rq) == io);
+        mlfq_dequeue(rq, io);
+        mlfq_proc_tick(rq, io);
+        mlfq_enqueue(rq, io);
+    }
+    assert(io->mlfq_level == 1 && mlfq_pick_next(rq) == p);
+
+    // a new process starts at the top and preempts p
+    mlfq_dequeue(rq, p);
+    mlfq_enqueue(rq, late);
+    mlfq_proc_tick(rq, p);
+    assert(p->need_resched && mlfq_pick_next(rq) == late);
+    p->need_resched = 0;
+    mlfq_enqueue(rq, p);
+
+    // the boost brings everybody back to the top, queued or not
+    mlfq_dequeue(rq, io);
+    rq->mlfq_boost_tick = ticks - MLFQ_BOOST_TICKS;
+    assert(mlfq_pick_next(rq) == late);
+    assert(p->mlfq_level == 0 && io->mlfq_level == 1);
+    mlfq_enqueue(rq, io);
+    assert(io->mlfq_level == 0 && rq->proc_num == CHECK_MLFQ_NPROC);
+    for (i = 0; i < CHECK_MLFQ_NPROC; i ++) {
+        mlfq_dequeue(rq, procs + i);
+    }
+    assert(rq->proc_num == 0);
+    cprintf("check_mlfq() succeeded!\n");
+}
+
@@ -0,0 +1,11 @@
+#ifndef __KERN_SCHEDULE_MLFQ_SCHED_H__
+#define __KERN_SCHEDULE_MLFQ_SCHED_H__
+
+#include <sched.h>
+
+extern struct sched_class mlfq_sched_class;
+
+void check_mlfq(void);
+
+#endif /* !__KERN_SCHEDULE_MLFQ_SCHED_H__ */
+
@@ -3,12 +3,55 @@
 #include <proc.h>
 #include <sched.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <x86.h>
 #include <assert.h>
+#include <clock.h>
+#include <unistd.h>
+#include <error.h>
 #include <default_sched.h>
+#include <mlfq_sched.h>
+#include <cfs_sched.h>
 
-static list_entry_t timer_list;
+/* *
+ * The timer wheel, a hierarchical one as in Linux: the timers expiring in
+ * the next TVR_SIZE ticks sit in tv1, one slot per tick; the later ones in
+ * the slots of tvn[0..3], each slot of tvn[n] covering the ticks one turn
+ * of the wheel below covers. Whenever tv1 has turned once, the timers of the
+ * next slot of tvn[0] are spread over tv1 (cascade), and so on up. Adding or
+ * deleting a timer takes O(1), a tick runs the timers of one slot of tv1, and
+ * a timer is moved at most once per wheel on its way down.
+ *
+ * High resolution timers sit on a skew heap ordered by expiry, the clock
+ * interrupt is set for the first one if it is due before the next tick.
+ * */
+#define TVN_BITS                6
+#define TVR_BITS                8
+#define TVN_SIZE                (1 << TVN_BITS)
+#define TVR_SIZE                (1 << TVR_BITS)
+#define TVN_MASK                (TVN_SIZE - 1)
+#define TVR_MASK                (TVR_SIZE - 1)
+#define TVN_INDEX(n, j)         (((j) >> (TVR_BITS + (n) * TVN_BITS)) & TVN_MASK)
+
+static list_entry_t tv1[TVR_SIZE];
+static list_entry_t tvn[4][TVN_SIZE];
+// the ticks run_timer_list has run the timers of
+static unsigned int timer_jiffies;
+
+static skew_heap_entry_t *hrtimer_heap;
+
+// the scheduling classes by SCHED_* policy, see sched_setpolicy
+static struct {
+    const char *name;
+    struct sched_class *class;
+} sched_policies[SCHED_NR_POLICY] = {
+    [SCHED_STRIDE]  {"stride",  &default_sched_class},
+    [SCHED_MLFQ]    {"mlfq",    &mlfq_sched_class},
+    [SCHED_CFS]     {"cfs",     &cfs_sched_class},
+};
 
 static struct sched_class *sched_class;
+static int sched_policy;
 
 static struct run_queue *rq;
 
@@ -41,11 +84,26 @@ sched_class_proc_tick(struct proc_struct *proc) {
 
 static struct run_queue __rq;
 
+static void timer_bench(void);
+
 void
 sched_init(void) {
-    list_init(&timer_list);
+    int i, n;
+    for (i = 0; i < TVR_SIZE; i ++) {
+        list_init(tv1 + i);
+    }
+    for (n = 0; n < 4; n ++) {
+        for (i = 0; i < TVN_SIZE; i ++) {
+            list_init(tvn[n] + i);
+        }
+    }
+    timer_bench();
+    check_mlfq();
+    check_cfs();
 
-    sched_class = &default_sched_class;
+    // the stride scheduler, sched_setpolicy switches to another one
+    sched_policy = SCHED_STRIDE;
+    sched_class = sched_policies[sched_policy].class;
 
     rq = &__rq;
     rq->max_time_slice = 5;
@@ -54,6 +112,85 @@ sched_init(void) {
     cprintf("sched class: %s\n", sched_class->name);
 }
 
+// sched_policy_name - the name of policy, NULL if there is no such policy
+const char *
+sched_policy_name(int policy) {
+    return (policy >= 0 && policy < SCHED_NR_POLICY) ? sched_policies[policy].name : NULL;
+}
+
+int
+sched_getpolicy(void) {
+    return sched_policy;
+}
+
+// sched_reset_proc - forget what the classes have recorded about proc
+static void
+sched_reset_proc(struct proc_struct *proc) {
+    proc->time_slice = 0;
+    proc->lab6_stride = 0;
+    proc->mlfq_level = proc->mlfq_used = 0;
+    proc->mlfq_boost = 0;
+    proc->cfs_vruntime = proc->cfs_exec_start = 0;
+}
+
+/* *
+ * sched_setpolicy - switch to the scheduling class of policy (SCHED_*): take
+ * every runnable process off the run queue of the current class, and put it
+ * on the run queue of the new one. Every process, sleeping or not, starts
+ * even in the new class. Return the policy before, or -E_INVAL.
+ * */
+int
+sched_setpolicy(int policy) {
+    if (policy < 0 || policy >= SCHED_NR_POLICY) {
+        return -E_INVAL;
+    }
+    int old_policy = sched_policy;
+    if (policy == old_policy) {
+        return old_policy;
+    }
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        list_entry_t *list = &proc_list, *le = list, *runnable = NULL;
+        // the runnable processes, but current, are queued; chain them through run_link.
+        // the sleeping ones start even as well when they wake up in the new class
+        while ((le = list_next(le)) != list) {
+            struct proc_struct *proc = le2proc(le, list_link);
+            if (proc == current || proc == idleproc || proc->state == PROC_ZOMBIE) {
+                continue;
+            }
+            if (proc->state == PROC_RUNNABLE) {
+                sched_class_dequeue(proc);
+                proc->run_link.next = runnable;
+                runnable = &(proc->run_link);
+            }
+            sched_reset_proc(proc);
+        }
+        assert(rq->proc_num == 0);
+        sched_class = sched_policies[policy].class;
+        sched_policy = policy;
+        sched_class->init(rq);
+        while ((le = runnable) != NULL) {
+            runnable = le->next;
+            list_init(le);
+            sched_class_enqueue(le2proc(le, run_link));
+        }
+        // current may be NULL if the monitor runs before proc_init
+        if (current != NULL && current != idleproc) {
+            sched_reset_proc(current);
+            if (sched_class == &cfs_sched_class) {
+                current->cfs_exec_start = read_tsc();
+            }
+        }
+        if (current != NULL) {
+            current->need_resched = 1;
+        }
+    }
+    local_intr_restore(intr_flag);
+    cprintf("sched class: %s\n", sched_class->name);
+    return old_policy;
+}
+
 void
 wakeup_proc(struct proc_struct *proc) {
     assert(proc->state != PROC_ZOMBIE);
@@ -66,6 +203,10 @@ wakeup_proc(struct proc_struct *proc) {
             if (proc != current) {
                 sched_class_enqueue(proc);
             }
+            // sched_idle must not halt now
+            if (current == idleproc) {
+                current->need_resched = 1;
+            }
         }
         else {
             warn("wakeup runnable process.\n");
@@ -98,24 +239,90 @@ schedule(void) {
     local_intr_restore(intr_flag);
 }
 
+// internal_add_timer - link timer into the slot of the wheel its expiry (a tick) falls in
+static void
+internal_add_timer(timer_t *timer) {
+    unsigned int expires = timer->expires, idx = expires - timer_jiffies;
+    list_entry_t *vec;
+    if (idx < TVR_SIZE) {
+        vec = tv1 + (expires & TVR_MASK);
+    }
+    else if ((int)idx < 0) {
+        // already due: the next tick runs it
+        vec = tv1 + ((timer_jiffies + 1) & TVR_MASK);
+    }
+    else {
+        int n;
+        for (n = 0; n < 3 && idx >= (1U << (TVR_BITS + (n + 1) * TVN_BITS)); n ++)
+            /* nothing */ ;
+        vec = tvn[n] + TVN_INDEX(n, expires);
+    }
+    list_add_before(vec, &(timer->timer_link));
+}
+
+// cascade - spread the timers of slot index of tvn[n] over the wheels below, return index
+static int
+cascade(int n, int index) {
+    list_entry_t list, *le;
+    list_init(&list);
+    if (!list_empty(tvn[n] + index)) {
+        list_add(tvn[n] + index, &list);
+        list_del_init(tvn[n] + index);
+    }
+    while ((le = list_next(&list)) != &list) {
+        list_del(le);
+        internal_add_timer(le2timer(le, timer_link));
+    }
+    return index;
+}
+
+// timer_expire - wake the process of a process timer up, or call the function of a callback timer
+static void
+timer_expire(struct proc_struct *proc, void (*func)(void *arg), void *arg) {
+    if (func != NULL) {
+        func(arg);
+        return;
+    }
+    if (proc->wait_state != 0) {
+        assert(proc->wait_state & WT_INTERRUPTED);
+    }
+    else {
+        warn("process %d's wait_state == 0.\n", proc->pid);
+    }
+    wakeup_proc(proc);
+}
+
+// run_timers - run the timers of the next tick, cascading the wheels first if tv1 has turned
+static void
+run_timers(void) {
+    int index = (++ timer_jiffies) & TVR_MASK;
+    if (index == 0 && cascade(0, TVN_INDEX(0, timer_jiffies)) == 0
+        && cascade(1, TVN_INDEX(1, timer_jiffies)) == 0 && cascade(2, TVN_INDEX(2, timer_jiffies)) == 0) {
+        cascade(3, TVN_INDEX(3, timer_jiffies));
+    }
+    list_entry_t list, *le;
+    list_init(&list);
+    if (!list_empty(tv1 + index)) {
+        list_add(tv1 + index, &list);
+        list_del_init(tv1 + index);
+    }
+    // a timer function may add or delete timers, this one as well
+    while ((le = list_next(&list)) != &list) {
+        timer_t *timer = le2timer(le, timer_link);
+        list_del_init(le);
+        timer_expire(timer->proc, timer->func, timer->arg);
+    }
+}
+
 void
 add_timer(timer_t *timer) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        assert(timer->expires > 0 && timer->proc != NULL);
+        assert(timer->expires > 0 && (timer->proc != NULL || timer->func != NULL));
         assert(list_empty(&(timer->timer_link)));
-        list_entry_t *le = list_next(&timer_list);
-        while (le != &timer_list) {
-            timer_t *next = le2timer(le, timer_link);
-            if (timer->expires < next->expires) {
-                next->expires -= timer->expires;
-                break;
-            }
-            timer->expires -= next->expires;
-            le = list_next(le);
-        }
-        list_add_before(le, &(timer->timer_link));
+        timer->expires += timer_jiffies;
+        internal_add_timer(timer);
     }
     local_intr_restore(intr_flag);
 }
@@ -125,16 +332,7 @@ del_timer(timer_t *timer) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        if (!list_empty(&(timer->timer_link))) {
-            if (timer->expires != 0) {
-                list_entry_t *le = list_next(&(timer->timer_link));
-                if (le != &timer_list) {
-                    timer_t *next = le2timer(le, timer_link);
-                    next->expires += timer->expires;
-                }
-            }
-            list_del_init(&(timer->timer_link));
-        }
+        list_del_init(&(timer->timer_link));
     }
     local_intr_restore(intr_flag);
 }
@@ -144,29 +342,171 @@ run_timer_list(void) {
     bool intr_flag;
     local_intr_save(intr_flag);
     {
-        list_entry_t *le = list_next(&timer_list);
-        if (le != &timer_list) {
-            timer_t *timer = le2timer(le, timer_link);
-            assert(timer->expires != 0);
-            timer->expires --;
-            while (timer->expires == 0) {
-                le = list_next(le);
-                struct proc_struct *proc = timer->proc;
-                if (proc->wait_state != 0) {
-                    assert(proc->wait_state & WT_INTERRUPTED);
-                }
-                else {
-                    warn("process %d's wait_state == 0.\n", proc->pid);
-                }
-                wakeup_proc(proc);
-                del_timer(timer);
-                if (le == &timer_list) {
-                    break;
-                }
-                timer = le2timer(le, timer_link);
+        run_timers();
+        sched_class_proc_tick(current);
+    }
+    local_intr_restore(intr_flag);
+}
+
+// timer_next_tick - the ticks until the next one with timers to run or cascade, at most max
+static unsigned int
+timer_next_tick(unsigned int max) {
+    unsigned int n;
+    for (n = 1; n < max; n ++) {
+        unsigned int index = (timer_jiffies + n) & TVR_MASK;
+        if (index == 0 || !list_empty(tv1 + index)) {
+            break;
+        }
+    }
+    return n;
+}
+
+static int
+hrtimer_comp_f(void *a, void *b) {
+    uint64_t ea = le2hrtimer(a, hrtimer_link)->expires, eb = le2hrtimer(b, hrtimer_link)->expires;
+    return (ea < eb) ? -1 : ((ea == eb) ? 0 : 1);
+}
+
+// hrtimer_set_event - make the clock interrupt come at the next tick, or the first hrtimer if sooner
+static void
+hrtimer_set_event(void) {
+    uint64_t next = (uint64_t)(ticks + 1) * TICK_US;
+    if (hrtimer_heap != NULL && le2hrtimer(hrtimer_heap, hrtimer_link)->expires < next) {
+        next = le2hrtimer(hrtimer_heap, hrtimer_link)->expires;
+    }
+    clock_set_event(next);
+}
+
+void
+add_hrtimer(hrtimer_t *timer) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        assert(timer->proc != NULL || timer->func != NULL);
+        assert(!timer->pending);
+        timer->expires += clock_read_us();
+        timer->pending = 1;
+        hrtimer_heap = skew_heap_insert(hrtimer_heap, &(timer->hrtimer_link), hrtimer_comp_f);
+        if (timer->expires < clock_event_us) {
+            clock_set_event(timer->expires);
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+void
+del_hrtimer(hrtimer_t *timer) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        if (timer->pending) {
+            hrtimer_heap = skew_heap_remove(hrtimer_heap, &(timer->hrtimer_link), hrtimer_comp_f);
+            timer->pending = 0;
+        }
+    }
+    local_intr_restore(intr_flag);
+}
+
+// run_hrtimer_list - run the hrtimers due by now, then set the next clock interrupt; called by it
+void
+run_hrtimer_list(void) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    {
+        uint64_t now = clock_read_us();
+        while (hrtimer_heap != NULL) {
+            hrtimer_t *timer = le2hrtimer(hrtimer_heap, hrtimer_link);
+            if (timer->expires > now) {
+                break;
             }
+            hrtimer_heap = skew_heap_remove(hrtimer_heap, &(timer->hrtimer_link), hrtimer_comp_f);
+            timer->pending = 0;
+            timer_expire(timer->proc, timer->func, timer->arg);
         }
-        sched_class_proc_tick(current);
+        hrtimer_set_event();
+    }
+    local_intr_restore(intr_flag);
+}
+
+/* *
+ * sched_idle - called by idleproc with nothing to run: stop the ticks, halt
+ * the CPU until the next timer is due or an interrupt wakes a process up,
+ * and start the ticks again.
+ * */
+void
+sched_idle(void) {
+    bool intr_flag;
+    local_intr_save(intr_flag);
+    if (!current->need_resched) {
+        uint64_t next = (uint64_t)(ticks + timer_next_tick(CLOCK_MAX_US / TICK_US + 1)) * TICK_US;
+        if (hrtimer_heap != NULL && le2hrtimer(hrtimer_heap, hrtimer_link)->expires < next) {
+            next = le2hrtimer(hrtimer_heap, hrtimer_link)->expires;
+        }
+        clock_set_event(next);
+        // sti takes effect after hlt has begun, no interrupt comes in between
+        asm volatile ("sti; hlt" ::: "memory");
+        cli();
+        hrtimer_set_event();
+        current->need_resched = 1;
     }
     local_intr_restore(intr_flag);
 }
+
+#define TIMER_BENCH_NR          4096            // timers pending at the same time
+#define TIMER_BENCH_SPAN        (TVR_SIZE * TVN_SIZE * 2)   // they expire within this many ticks
+
+static timer_t bench_timer[TIMER_BENCH_NR];
+static unsigned int bench_fired;
+
+static void
+bench_timer_func(void *arg) {
+    timer_t *timer = arg;
+    assert(timer->expires == timer_jiffies);
+    bench_fired ++;
+}
+
+/* *
+ * timer_bench - time add_timer, del_timer and the ticks with TIMER_BENCH_NR
+ * timers pending, as many sleepers would have, expiring up to 2 turns of
+ * tvn[1] away so they are cascaded; check that each one runs at its tick.
+ * The wheel is empty before and after, the ticks have not started.
+ * */
+static void
+timer_bench(void) {
+    uint64_t add_cycles, del_cycles, tick_cycles, max_tick = 0, start;
+    unsigned int i, nr_del = 0;
+    srand(1);
+    start = read_tsc();
+    for (i = 0; i < TIMER_BENCH_NR; i ++) {
+        add_timer(timer_init_func(bench_timer + i, bench_timer_func, bench_timer + i,
+                                  rand() % TIMER_BENCH_SPAN + 1));
+    }
+    add_cycles = read_tsc() - start;
+    start = read_tsc();
+    for (i = 0; i < TIMER_BENCH_NR; i += 4) {
+        del_timer(bench_timer + i), nr_del ++;
+    }
+    del_cycles = read_tsc() - start;
+    bench_fired = 0;
+    tick_cycles = 0;
+    for (i = 0; i <= TIMER_BENCH_SPAN; i ++) {
+        start = read_tsc();
+        run_timers();
+        uint64_t cycles = read_tsc() - start;
+        tick_cycles += cycles;
+        if (cycles > max_tick) {
+            max_tick = cycles;
+        }
+    }
+    assert(bench_fired == TIMER_BENCH_NR - nr_del);
+    for (i = 0; i < TIMER_BENCH_NR; i ++) {
+        assert(!timer_pending(bench_timer + i));
+    }
+    timer_jiffies = 0;
+    do_div(add_cycles, TIMER_BENCH_NR);
+    do_div(del_cycles, nr_del);
+    do_div(tick_cycles, TIMER_BENCH_SPAN + 1);
+    cprintf("timer_bench: %d timers: add %llu cycles, del %llu cycles, tick %llu cycles (max %llu).\n",
+            TIMER_BENCH_NR, add_cycles, del_cycles, tick_cycles, max_tick);
+}
+
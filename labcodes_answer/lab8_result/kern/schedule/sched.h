@@ -7,9 +7,18 @@
 
 struct proc_struct;
 
-typedef struct {
+/* *
+ * timer_t - a timer on the timer wheel (see sched.c). When it expires, func is
+ * called with arg from the timer interrupt, interrupts disabled; a process
+ * timer (func == NULL) wakes proc up instead. expires is the number of ticks
+ * from add_timer until then, add_timer turns it into the tick it expires at,
+ * so a timer is initialized again before it is added again.
+ * */
+typedef struct timer {
     unsigned int expires;
     struct proc_struct *proc;
+    void (*func)(void *arg);
+    void *arg;
     list_entry_t timer_link;
 } timer_t;
 
@@ -20,10 +29,52 @@ static inline timer_t *
 timer_init(timer_t *timer, struct proc_struct *proc, int expires) {
     timer->expires = expires;
     timer->proc = proc;
+    timer->func = NULL, timer->arg = NULL;
     list_init(&(timer->timer_link));
     return timer;
 }
 
+// timer_init_func - initialize a timer calling func(arg) after expires ticks
+static inline timer_t *
+timer_init_func(timer_t *timer, void (*func)(void *arg), void *arg, int expires) {
+    timer->expires = expires;
+    timer->proc = NULL;
+    timer->func = func, timer->arg = arg;
+    list_init(&(timer->timer_link));
+    return timer;
+}
+
+static inline bool
+timer_pending(timer_t *timer) {
+    return !list_empty(&(timer->timer_link));
+}
+
+/* *
+ * hrtimer_t - a high resolution timer, expiring at a microsecond instead of a
+ * tick; func and proc work as for timer_t. expires is the number of
+ * microseconds from add_hrtimer until then.
+ * */
+typedef struct hrtimer {
+    uint64_t expires;
+    struct proc_struct *proc;
+    void (*func)(void *arg);
+    void *arg;
+    skew_heap_entry_t hrtimer_link;
+    bool pending;
+} hrtimer_t;
+
+#define le2hrtimer(le, member)          \
+to_struct((le), hrtimer_t, member)
+
+static inline hrtimer_t *
+hrtimer_init(hrtimer_t *timer, struct proc_struct *proc, uint64_t expires) {
+    timer->expires = expires;
+    timer->proc = proc;
+    timer->func = NULL, timer->arg = NULL;
+    timer->pending = 0;
+    return timer;
+}
+
 struct run_queue;
 
 // The introduction of scheduling classes is borrrowed from Linux, and makes the 
@@ -51,12 +102,20 @@ struct sched_class {
      */
 };
 
+#define MLFQ_NR_LEVELS          3           // queues of mlfq_sched_class, see mlfq_sched.c
+
 struct run_queue {
     list_entry_t run_list;
     unsigned int proc_num;
     int max_time_slice;
     // For LAB6 ONLY
     skew_heap_entry_t *lab6_run_pool;
+    // for mlfq_sched_class: a queue per level, and the priority boosts so far
+    list_entry_t mlfq_list[MLFQ_NR_LEVELS];
+    unsigned int mlfq_boost;
+    size_t mlfq_boost_tick;
+    // for cfs_sched_class, which keeps lab6_run_pool ordered by vruntime
+    uint64_t cfs_min_vruntime;
 };
 
 void sched_init(void);
@@ -65,6 +124,13 @@ void schedule(void);
 void add_timer(timer_t *timer);
 void del_timer(timer_t *timer);
 void run_timer_list(void);
+void add_hrtimer(hrtimer_t *timer);
+void del_hrtimer(hrtimer_t *timer);
+void run_hrtimer_list(void);
+void sched_idle(void);
+const char *sched_policy_name(int policy);
+int sched_getpolicy(void);
+int sched_setpolicy(int policy);
 
 #endif /* !__KERN_SCHEDULE_SCHED_H__ */
 
@@ -5,8 +5,10 @@
 #include <trap.h>
 #include <stdio.h>
 #include <pmm.h>
+#include <vmm.h>
 #include <assert.h>
 #include <clock.h>
+#include <sched.h>
 #include <stat.h>
 #include <dirent.h>
 #include <sysfile.h>
@@ -39,6 +41,14 @@ sys_exec(uint32_t arg[]) {
     return do_execve(name, argc, argv);
 }
 
+static int
+sys_spawn(uint32_t arg[]) {
+    const char *name = (const char *)arg[0];
+    int argc = (int)arg[1];
+    const char **argv = (const char **)arg[2];
+    return do_spawn(name, argc, argv);
+}
+
 static int
 sys_yield(uint32_t arg[]) {
     return do_yield();
@@ -86,6 +96,24 @@ sys_sleep(uint32_t arg[]) {
     return do_sleep(time);
 }
 
+static int
+sys_usleep(uint32_t arg[]) {
+    unsigned int us = (unsigned int)arg[0];
+    return do_usleep(us);
+}
+
+// sys_gettime_us - the microseconds since boot, the low 32 bits
+static int
+sys_gettime_us(uint32_t arg[]) {
+    return (int)clock_read_us();
+}
+
+static int
+sys_sched_setpolicy(uint32_t arg[]) {
+    int policy = (int)arg[0];
+    return sched_setpolicy(policy);
+}
+
 static int
 sys_open(uint32_t arg[]) {
     const char *path = (const char *)arg[0];
@@ -157,19 +185,50 @@ sys_dup(uint32_t arg[]) {
     return sysfile_dup(fd1, fd2);
 }
 
+static int
+sys_pgfstat(uint32_t arg[]) {
+    struct pgfault_stat *store = (struct pgfault_stat *)arg[0];
+    int n = (int)arg[1];
+    return do_pgfstat(store, n);
+}
+
+static int
+sys_mmap(uint32_t arg[]) {
+    uintptr_t *addr_store = (uintptr_t *)arg[0];
+    size_t len = (size_t)arg[1];
+    uint32_t mmap_flags = (uint32_t)arg[2];
+    int fd = (int)arg[3];
+    off_t offset = (off_t)arg[4];
+    return do_mmap(addr_store, len, mmap_flags, fd, offset);
+}
+
+static int
+sys_munmap(uint32_t arg[]) {
+    uintptr_t addr = (uintptr_t)arg[0];
+    size_t len = (size_t)arg[1];
+    return do_munmap(addr, len);
+}
+
 static int (*syscalls[])(uint32_t arg[]) = {
     [SYS_exit]              sys_exit,
     [SYS_fork]              sys_fork,
     [SYS_wait]              sys_wait,
     [SYS_exec]              sys_exec,
+    [SYS_spawn]             sys_spawn,
     [SYS_yield]             sys_yield,
     [SYS_kill]              sys_kill,
     [SYS_getpid]            sys_getpid,
+    [SYS_mmap]              sys_mmap,
+    [SYS_munmap]            sys_munmap,
     [SYS_putc]              sys_putc,
     [SYS_pgdir]             sys_pgdir,
+    [SYS_pgfstat]           sys_pgfstat,
     [SYS_gettime]           sys_gettime,
     [SYS_lab6_set_priority] sys_lab6_set_priority,
     [SYS_sleep]             sys_sleep,
+    [SYS_usleep]            sys_usleep,
+    [SYS_gettime_us]        sys_gettime_us,
+    [SYS_sched_setpolicy]   sys_sched_setpolicy,
     [SYS_open]              sys_open,
     [SYS_close]             sys_close,
     [SYS_read]              sys_read,
@@ -5,6 +5,7 @@
 #include <trap.h>
 #include <x86.h>
 #include <stdio.h>
+#include <ide.h>
 #include <assert.h>
 #include <console.h>
 #include <vmm.h>
@@ -193,6 +194,7 @@ extern struct mm_struct *check_mm_struct;
 static void
 trap_dispatch(struct trapframe *tf) {
     char c;
+    size_t nr_ticks;
 
     int ret=0;
 
@@ -239,9 +241,17 @@ trap_dispatch(struct trapframe *tf) {
          *    Every tick, you should update the system time, iterate the timers, and trigger the timers which are end to call scheduler.
          *    You can use one funcitons to finish all these things.
          */
-        ticks ++;
         assert(current != NULL);
-        run_timer_list();
+        // the interrupt is one-shot: it stands for every tick since the last one,
+        // several after the CPU was idle, none if it came for a high resolution timer
+        for (nr_ticks = clock_update(); nr_ticks > 0; nr_ticks --) {
+            // the virtual time of an mm goes on while its process runs (see wsclock)
+            if (swap_init_ok && current->mm != NULL) {
+                swap_tick_event(current->mm);
+            }
+            run_timer_list();
+        }
+        run_hrtimer_list();
         break;
     case IRQ_OFFSET + IRQ_COM1:
         //c = cons_getc();
@@ -262,7 +272,7 @@ trap_dispatch(struct trapframe *tf) {
         break;
     case IRQ_OFFSET + IRQ_IDE1:
     case IRQ_OFFSET + IRQ_IDE2:
-        /* do nothing */
+        ide_intr(tf->tf_trapno - IRQ_OFFSET);
         break;
     default:
         print_trapframe(tf);
@@ -0,0 +1,49 @@
+#ifndef __LIBS_PGFAULT_H__
+#define __LIBS_PGFAULT_H__
+
+#include <defs.h>
+
+/* how a page fault was resolved, see do_pgfault */
+#define PGFAULT_ANON            0       // zero-filled anonymous page
+#define PGFAULT_FILE            1       // page of a file-backed vma, from the page cache or the file
+#define PGFAULT_SWAPIN          2       // page read back from the swap device
+#define PGFAULT_COW_COPY        3       // write to a copy-on-write page, copied
+#define PGFAULT_COW_REUSE       4       // write to a copy-on-write page, the last sharer took it over
+#define PGFAULT_SHARED          5       // write to a readonly mapped page of a shared vma
+#define PGFAULT_SPURIOUS        6       // the page was mapped by someone sharing mm meanwhile
+#define PGFAULT_INVALID         7       // bad address or access, or out of memory
+#define PGFAULT_NR_KIND         8
+
+// pgfault_kind_name - the name of a kind of page fault, for the kernel and user programs alike
+static inline const char *
+pgfault_kind_name(int kind) {
+    static const char *name[PGFAULT_NR_KIND] = {
+        [PGFAULT_ANON]          "anon",
+        [PGFAULT_FILE]          "file",
+        [PGFAULT_SWAPIN]        "swapin",
+        [PGFAULT_COW_COPY]      "cow-copy",
+        [PGFAULT_COW_REUSE]     "cow-reuse",
+        [PGFAULT_SHARED]        "shared",
+        [PGFAULT_SPURIOUS]      "spurious",
+        [PGFAULT_INVALID]       "invalid",
+    };
+    return (kind >= 0 && kind < PGFAULT_NR_KIND) ? name[kind] : "unknown";
+}
+
+/* *
+ * latency histogram in TSC cycles: bucket i counts faults which took
+ * [2^(i + PGFAULT_HIST_SHIFT), 2^(i + 1 + PGFAULT_HIST_SHIFT)) cycles,
+ * the first and last buckets also count everything below and above.
+ * */
+#define PGFAULT_HIST_SHIFT      8
+#define PGFAULT_NR_BUCKET       16
+
+struct pgfault_stat {
+    uint32_t count;                     // number of faults of this kind
+    uint32_t hist[PGFAULT_NR_BUCKET];   // latency histogram
+    uint64_t cycles;                    // total cycles spent
+    uint64_t max_cycles;                // the slowest one
+};
+
+#endif /* !__LIBS_PGFAULT_H__ */
+
@@ -9,9 +9,13 @@
 #define SYS_wait            3
 #define SYS_exec            4
 #define SYS_clone           5
+#define SYS_spawn           6
 #define SYS_yield           10
 #define SYS_sleep           11
 #define SYS_kill            12
+#define SYS_usleep          13
+#define SYS_gettime_us      14
+#define SYS_sched_setpolicy 15
 #define SYS_gettime         17
 #define SYS_getpid          18
 #define SYS_mmap            20
@@ -19,6 +23,7 @@
 #define SYS_shmem           22
 #define SYS_putc            30
 #define SYS_pgdir           31
+#define SYS_pgfstat         32
 #define SYS_open            100
 #define SYS_close           101
 #define SYS_read            102
@@ -36,6 +41,21 @@
 #define CLONE_VM            0x00000100  // set if VM shared between processes
 #define CLONE_THREAD        0x00000200  // thread group
 #define CLONE_FS            0x00000800  // set if shared between processes
+#define CLONE_SPAWN         0x00001000  // child starts without mm, used by spawn
+
+/* SYS_mmap flags */
+#define PROT_READ           0x00000001  // pages may be read
+#define PROT_WRITE          0x00000002  // pages may be written
+#define PROT_EXEC           0x00000004  // pages may be executed
+#define MAP_SHARED          0x00000100  // writes go to the file, seen by all its mappings
+#define MAP_PRIVATE         0x00000200  // writes are private to the process (copy-on-write)
+#define MAP_ANONYMOUS       0x00000400  // zero-filled memory, not backed by a file
+
+/* SYS_sched_setpolicy policies */
+#define SCHED_STRIDE        0           // stride scheduling by lab6_priority
+#define SCHED_MLFQ          1           // multi-level feedback queue
+#define SCHED_CFS           2           // completely fair, by virtual runtime
+#define SCHED_NR_POLICY     3
 
 /* VFS flags */
 // flags for open: choose one of these
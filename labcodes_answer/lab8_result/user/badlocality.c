@@ -0,0 +1,37 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <pgfault.h>
+
+/* the locality programs of related_info/lab3, reporting their page faults */
+
+#define NUM                 512
+#define COUNT               4
+
+static int A[NUM][NUM];
+static struct pgfault_stat before[PGFAULT_NR_KIND], after[PGFAULT_NR_KIND];
+
+// write A column by column: each write goes to another page
+int
+main(void) {
+    int i, j, k, kind;
+    assert(pgfstat(before, PGFAULT_NR_KIND) == PGFAULT_NR_KIND);
+    unsigned int time = gettime_usec();
+    for (k = 0; k < COUNT; k ++) {
+        for (j = 0; j < NUM; j ++) {
+            for (i = 0; i < NUM; i ++) {
+                A[i][j] = 0;
+            }
+        }
+    }
+    time = (gettime_usec() - time) / 1000;
+    assert(pgfstat(after, PGFAULT_NR_KIND) == PGFAULT_NR_KIND);
+
+    unsigned int faults = 0;
+    for (kind = 0; kind < PGFAULT_NR_KIND; kind ++) {
+        faults += after[kind].count - before[kind].count;
+    }
+    cprintf("badlocality: %d writes, %u page faults, %u swapped in, %u ms.\n",
+            i * j * k, faults, after[PGFAULT_SWAPIN].count - before[PGFAULT_SWAPIN].count, time);
+    cprintf("badlocality pass.\n");
+    return 0;
+}
@@ -89,11 +89,31 @@ sys_gettime(void) {
     return syscall(SYS_gettime);
 }
 
+int
+sys_usleep(unsigned int us) {
+    return syscall(SYS_usleep, us);
+}
+
+size_t
+sys_gettime_us(void) {
+    return syscall(SYS_gettime_us);
+}
+
+int
+sys_sched_setpolicy(int policy) {
+    return syscall(SYS_sched_setpolicy, policy);
+}
+
 int
 sys_exec(const char *name, int argc, const char **argv) {
     return syscall(SYS_exec, name, argc, argv);
 }
 
+int
+sys_spawn(const char *name, int argc, const char **argv) {
+    return syscall(SYS_spawn, name, argc, argv);
+}
+
 int
 sys_open(const char *path, uint32_t open_flags) {
     return syscall(SYS_open, path, open_flags);
@@ -143,3 +163,18 @@ int
 sys_dup(int fd1, int fd2) {
     return syscall(SYS_dup, fd1, fd2);
 }
+
+int
+sys_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset) {
+    return syscall(SYS_mmap, addr_store, len, mmap_flags, fd, offset);
+}
+
+int
+sys_munmap(uintptr_t addr, size_t len) {
+    return syscall(SYS_munmap, addr, len);
+}
+
+int
+sys_pgfstat(struct pgfault_stat *stat, int n) {
+    return syscall(SYS_pgfstat, stat, n);
+}
@@ -5,6 +5,7 @@ int sys_exit(int error_code);
 int sys_fork(void);
 int sys_wait(int pid, int *store);
 int sys_exec(const char *name, int argc, const char **argv);
+int sys_spawn(const char *name, int argc, const char **argv);
 int sys_yield(void);
 int sys_kill(int pid);
 int sys_getpid(void);
@@ -12,9 +13,13 @@ int sys_putc(int c);
 int sys_pgdir(void);
 int sys_sleep(unsigned int time);
 size_t sys_gettime(void);
+int sys_usleep(unsigned int us);
+size_t sys_gettime_us(void);
+int sys_sched_setpolicy(int policy);
 
 struct stat;
 struct dirent;
+struct pgfault_stat;
 
 int sys_open(const char *path, uint32_t open_flags);
 int sys_close(int fd);
@@ -26,6 +31,9 @@ int sys_fsync(int fd);
 int sys_getcwd(char *buffer, size_t len);
 int sys_getdirentry(int fd, struct dirent *dirent);
 int sys_dup(int fd1, int fd2);
+int sys_mmap(uintptr_t *addr_store, size_t len, uint32_t mmap_flags, int fd, off_t offset);
+int sys_munmap(uintptr_t addr, size_t len);
+int sys_pgfstat(struct pgfault_stat *stat, int n);
 void sys_lab6_set_priority(uint32_t priority); //only for lab6
 
 
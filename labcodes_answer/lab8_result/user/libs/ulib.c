@@ -77,6 +77,51 @@ gettime_msec(void) {
     return (unsigned int)sys_gettime();
 }
 
+int
+usleep(unsigned int us) {
+    return sys_usleep(us);
+}
+
+unsigned int
+gettime_usec(void) {
+    return (unsigned int)sys_gettime_us();
+}
+
+// sched_setpolicy - switch the scheduler to policy (SCHED_*), return the one before
+int
+sched_setpolicy(int policy) {
+    return sys_sched_setpolicy(policy);
+}
+
+/* *
+ * mmap - map len bytes of the file fd from offset (or anonymous memory with
+ * MAP_ANONYMOUS, fd is ignored) at addr, or anywhere if addr is NULL.
+ * prot is PROT_*, flags is MAP_SHARED or MAP_PRIVATE, maybe | MAP_ANONYMOUS.
+ * return the address mapped, or NULL on failure.
+ * */
+void *
+mmap(void *addr, size_t len, uint32_t prot, uint32_t flags, int fd, off_t offset) {
+    uintptr_t addr_store = (uintptr_t)addr;
+    if (sys_mmap(&addr_store, len, prot | flags, fd, offset) != 0) {
+        return NULL;
+    }
+    return (void *)addr_store;
+}
+
+int
+munmap(void *addr, size_t len) {
+    return sys_munmap((uintptr_t)addr, len);
+}
+
+/* *
+ * pgfstat - get the counters of the first n kinds of page faults (PGFAULT_*),
+ * return the number of kinds filled in.
+ * */
+int
+pgfstat(struct pgfault_stat *stat, int n) {
+    return sys_pgfstat(stat, n);
+}
+
 int
 __exec(const char *name, const char **argv) {
     int argc = 0;
@@ -85,3 +130,12 @@ __exec(const char *name, const char **argv) {
     }
     return sys_exec(name, argc, argv);
 }
+
+int
+__spawn(const char *name, const char **argv) {
+    int argc = 0;
+    while (argv[argc] != NULL) {
+        argc ++;
+    }
+    return sys_spawn(name, argc, argv);
+}
@@ -3,6 +3,8 @@
 
 #include <defs.h>
 
+struct pgfault_stat;
+
 void __warn(const char *file, int line, const char *fmt, ...);
 void __noreturn __panic(const char *file, int line, const char *fmt, ...);
 
@@ -35,7 +37,13 @@ int getpid(void);
 void print_pgdir(void);
 int sleep(unsigned int time);
 unsigned int gettime_msec(void);
+int usleep(unsigned int us);
+unsigned int gettime_usec(void);
+int sched_setpolicy(int policy);
 int __exec(const char *name, const char **argv);
+void *mmap(void *addr, size_t len, uint32_t prot, uint32_t flags, int fd, off_t offset);
+int munmap(void *addr, size_t len);
+int pgfstat(struct pgfault_stat *stat, int n);
 
 #define __exec0(name, path, ...)                \
 ({ const char *argv[] = {path, ##__VA_ARGS__, NULL}; __exec(name, argv); })
@@ -43,6 +51,13 @@ int __exec(const char *name, const char **argv);
 #define exec(path, ...)                         __exec0(NULL, path, ##__VA_ARGS__)
 #define nexec(name, path, ...)                  __exec0(name, path, ##__VA_ARGS__)
 
+int __spawn(const char *name, const char **argv);
+
+#define __spawn0(name, path, ...)               \
+({ const char *argv[] = {path, ##__VA_ARGS__, NULL}; __spawn(name, argv); })
+
+#define spawn(path, ...)                        __spawn0(NULL, path, ##__VA_ARGS__)
+
 void lab6_set_priority(uint32_t priority); //only for lab6
 
 #endif /* !__USER_LIBS_ULIB_H__ */
@@ -0,0 +1,27 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <file.h>
+#include <unistd.h>
+
+#define printf(...)                     fprintf(1, __VA_ARGS__)
+#define BUFSIZE                         128
+
+static char buf[BUFSIZE + 1];
+
+// print the free page blocks by order and the fragmentation of physical memory
+int
+main(void) {
+    int fd, ret;
+    if ((fd = open("meminfo:", O_RDONLY)) < 0) {
+        printf("meminfo: open failed: %e.\n", fd);
+        return fd;
+    }
+    /* read in small pieces to go through offsets as well */
+    while ((ret = read(fd, buf, BUFSIZE)) > 0) {
+        buf[ret] = '\0';
+        printf("%s", buf);
+    }
+    close(fd);
+    return ret;
+}
+
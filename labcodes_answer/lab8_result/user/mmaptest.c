@@ -0,0 +1,101 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <string.h>
+#include <file.h>
+#include <stat.h>
+#include <unistd.h>
+
+#define PAGE                4096
+#define NPAGES              4
+#define FILE_NAME           "hello"
+
+static char buf[PAGE];
+
+// anonymous private memory: zero-filled, private after fork
+static void
+test_anon(void) {
+    char *p = mmap(NULL, NPAGES * PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(p != NULL);
+    int i, pid, code;
+    for (i = 0; i < NPAGES * PAGE; i ++) {
+        assert(p[i] == 0);
+        p[i] = (char)i;
+    }
+    if ((pid = fork()) == 0) {
+        for (i = 0; i < NPAGES * PAGE; i ++) {
+            assert(p[i] == (char)i);
+            p[i] = 0;
+        }
+        exit(0);
+    }
+    assert(pid > 0 && waitpid(pid, &code) == 0 && code == 0);
+    for (i = 0; i < NPAGES * PAGE; i ++) {
+        assert(p[i] == (char)i);
+    }
+    /* unmap the middle, then the rest */
+    assert(munmap(p + PAGE, PAGE) == 0);
+    assert(p[0] == 0 && p[2 * PAGE] == 0);
+    assert(munmap(p, NPAGES * PAGE) == 0);
+    cprintf("mmaptest: anonymous ok.\n");
+}
+
+// private file mapping: same content as read, writes are not seen by the file
+static void
+test_private(void) {
+    int fd;
+    struct stat __stat, *stat = &__stat;
+    assert((fd = open(FILE_NAME, O_RDONLY)) >= 0);
+    assert(fstat(fd, stat) == 0 && stat->st_size > PAGE);
+
+    char *p = mmap(NULL, stat->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    assert(p != NULL);
+    assert(read(fd, buf, PAGE) == PAGE && memcmp(p, buf, PAGE) == 0);
+    assert(munmap(p, stat->st_size) == 0);
+
+    p = mmap(NULL, PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, PAGE);
+    assert(p != NULL);
+    assert(read(fd, buf, PAGE) > 0 && memcmp(p, buf, 16) == 0);
+    p[0] = ~buf[0];
+    assert(munmap(p, PAGE) == 0);
+
+    assert(seek(fd, PAGE, LSEEK_SET) == 0 && read(fd, buf + 1, 1) == 1 && buf[1] == buf[0]);
+    close(fd);
+    cprintf("mmaptest: private file ok.\n");
+}
+
+// shared file mapping: seen across fork, written back to the file on munmap/exit
+static void
+test_shared(void) {
+    int fd, pid, code;
+    char old[2], now[2];
+    assert((fd = open(FILE_NAME, O_RDWR)) >= 0);
+
+    char *p = mmap(NULL, PAGE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, PAGE);
+    assert(p != NULL);
+    old[0] = p[0], old[1] = p[1];
+    p[0] = ~old[0];
+    if ((pid = fork()) == 0) {
+        assert(p[0] == (char)~old[0]);
+        p[1] = ~old[1];
+        exit(0);
+    }
+    assert(pid > 0 && waitpid(pid, &code) == 0 && code == 0);
+    assert(p[1] == (char)~old[1]);
+    assert(munmap(p, PAGE) == 0);
+
+    assert(seek(fd, PAGE, LSEEK_SET) == 0 && read(fd, now, 2) == 2);
+    assert(now[0] == (char)~old[0] && now[1] == (char)~old[1]);
+    assert(seek(fd, PAGE, LSEEK_SET) == 0 && write(fd, old, 2) == 2);
+    close(fd);
+    cprintf("mmaptest: shared file ok.\n");
+}
+
+int
+main(void) {
+    test_anon();
+    test_private();
+    test_shared();
+    cprintf("mmaptest pass.\n");
+    return 0;
+}
+
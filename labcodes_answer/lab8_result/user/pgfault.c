@@ -0,0 +1,65 @@
+#include <ulib.h>
+#include <stdio.h>
+#include <x86.h>
+#include <unistd.h>
+#include <pgfault.h>
+
+#define PAGE                4096
+#define NPAGES              16
+
+static struct pgfault_stat before[PGFAULT_NR_KIND], after[PGFAULT_NR_KIND];
+
+// take zero-fill faults on fresh anonymous pages, then copy-on-write faults after fork
+static void
+workload(void) {
+    char *p = mmap(NULL, NPAGES * PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(p != NULL);
+    int i, pid, code;
+    for (i = 0; i < NPAGES; i ++) {
+        p[i * PAGE] = (char)i;
+    }
+    if ((pid = fork()) == 0) {
+        for (i = 0; i < NPAGES; i ++) {
+            p[i * PAGE] = 0;
+        }
+        exit(0);
+    }
+    assert(pid > 0 && waitpid(pid, &code) == 0 && code == 0);
+    for (i = 0; i < NPAGES; i ++) {
+        assert(p[i * PAGE] == (char)i);
+        p[i * PAGE] = 0;
+    }
+    assert(munmap(p, NPAGES * PAGE) == 0);
+}
+
+// print the page faults of every kind taken during the workload
+int
+main(void) {
+    int kind, i;
+    assert(pgfstat(before, PGFAULT_NR_KIND) == PGFAULT_NR_KIND);
+    workload();
+    assert(pgfstat(after, PGFAULT_NR_KIND) == PGFAULT_NR_KIND);
+
+    assert(after[PGFAULT_ANON].count - before[PGFAULT_ANON].count >= NPAGES);
+    assert(after[PGFAULT_COW_COPY].count - before[PGFAULT_COW_COPY].count >= NPAGES);
+
+    for (kind = 0; kind < PGFAULT_NR_KIND; kind ++) {
+        uint32_t count = after[kind].count - before[kind].count;
+        if (count == 0) {
+            continue;
+        }
+        uint64_t avg = after[kind].cycles - before[kind].cycles;
+        do_div(avg, count);
+        cprintf("%-10s %6u faults, avg %llu cycles\n", pgfault_kind_name(kind), count, avg);
+        for (i = 0; i < PGFAULT_NR_BUCKET; i ++) {
+            uint32_t n = after[kind].hist[i] - before[kind].hist[i];
+            if (n != 0) {
+                cprintf("    %s2^%-2d %6u\n", (i == 0) ? "< " : ">=",
+                        i + PGFAULT_HIST_SHIFT + (i == 0), n);
+            }
+        }
+    }
+    cprintf("pgfault pass.\n");
+    return 0;
+}
+
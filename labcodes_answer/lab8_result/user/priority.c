@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <x86.h>
+#include <unistd.h>
 
 #define TOTAL 5
 /* to get enough accuracy, MAX_TIME (the running time of each process) should >1000 mseconds. */
@@ -11,6 +13,12 @@ unsigned int acc[TOTAL];
 int status[TOTAL];
 int pids[TOTAL];
 
+static const char *policy_name[SCHED_NR_POLICY] = {
+     [SCHED_STRIDE]     "stride",
+     [SCHED_MLFQ]       "mlfq",
+     [SCHED_CFS]        "cfs",
+};
+
 static void
 spin_delay(void)
 {
@@ -22,9 +30,50 @@ spin_delay(void)
      }
 }
 
+/* *
+ * share_error - how far the shares are from 1:2:...:TOTAL, in permille: the
+ * largest difference of acc/priority of a child from their mean
+ * */
+static void
+share_error(void)
+{
+     uint64_t rate[TOTAL], mean = 0, err, max_err = 0;
+     int i;
+     for (i = 0; i < TOTAL; i ++) {
+          rate[i] = (unsigned int)status[i];
+          do_div(rate[i], i + 1);
+          mean += rate[i];
+     }
+     do_div(mean, TOTAL);
+     for (i = 0; mean != 0 && i < TOTAL; i ++) {
+          err = (rate[i] > mean) ? rate[i] - mean : mean - rate[i];
+          err *= 1000;
+          do_div(err, (uint32_t)mean);
+          if (err > max_err) {
+               max_err = err;
+          }
+     }
+     cprintf("share error: %llu permille\n", max_err);
+}
+
+/* *
+ * "priority [stride|mlfq|cfs]" runs the children under that scheduling class
+ * and switches back afterwards, to compare the share error of the classes.
+ * */
 int
-main(void) {
-     int i,time;
+main(int argc, char **argv) {
+     int i,time,policy,old_policy = -1;
+     if (argc > 1) {
+          for (policy = 0; policy < SCHED_NR_POLICY; policy ++) {
+               if (strcmp(argv[1], policy_name[policy]) == 0) {
+                    break;
+               }
+          }
+          if (policy == SCHED_NR_POLICY || (old_policy = sched_setpolicy(policy)) < 0) {
+               cprintf("usage: priority [stride|mlfq|cfs]\n");
+               return -1;
+          }
+     }
      cprintf("priority process will sleep %d ticks\n",SLEEP_TIME);
      sleep(SLEEP_TIME);
      memset(pids, 0, sizeof(pids));
@@ -66,6 +115,10 @@ main(void) {
          cprintf(" %d", (status[i] * 2 / status[0] + 1) / 2);
      }
      cprintf("\n");
+     share_error();
+     if (old_policy >= 0) {
+          sched_setpolicy(old_policy);
+     }
 
      return 0;
 
@@ -113,9 +113,23 @@ testfile(const char *name) {
     return 0;
 }
 
+// findcmd - look argv[0] up in the current directory, then in the root directory
 int
-runcmd(char *cmd) {
+findcmd(const char **argv) {
     static char argv0[BUFSIZE];
+    int ret;
+    if ((ret = testfile(argv[0])) != 0) {
+        if (ret != -E_NOENT) {
+            return ret;
+        }
+        snprintf(argv0, sizeof(argv0), "/%s", argv[0]);
+        argv[0] = argv0;
+    }
+    return 0;
+}
+
+int
+runcmd(char *cmd) {
     const char *argv[EXEC_MAX_ARG_NUM + 1];
     char *t;
     int argc, token, ret, p[2];
@@ -203,17 +217,61 @@ runit:
         strcpy(shcwd, argv[1]);
         return 0;
     }
-    if ((ret = testfile(argv[0])) != 0) {
-        if (ret != -E_NOENT) {
-            return ret;
-        }
-        snprintf(argv0, sizeof(argv0), "/%s", argv[0]);
-        argv[0] = argv0;
+    if ((ret = findcmd(argv)) != 0) {
+        return ret;
     }
     argv[argc] = NULL;
     return __exec(NULL, argv);
 }
 
+// simplecmd - a command without redirection, pipe or list can be spawned directly
+bool
+simplecmd(const char *cmd) {
+    for (; *cmd != '\0'; cmd ++) {
+        if (strchr(SYMBOLS, *cmd) != NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// spawncmd - run a simple command by spawn, so the shell itself is never forked
+int
+spawncmd(char *cmd, int *store) {
+    const char *argv[EXEC_MAX_ARG_NUM + 1];
+    char *t;
+    int argc = 0, pid, ret;
+    while (gettoken(&cmd, &t) == 'w') {
+        if (argc == EXEC_MAX_ARG_NUM) {
+            printf("sh error: too many arguments\n");
+            return -1;
+        }
+        argv[argc ++] = t;
+    }
+    *store = 0;
+    if (argc == 0) {
+        return 0;
+    }
+    else if (strcmp(argv[0], "cd") == 0) {
+        if (argc != 2) {
+            *store = -1;
+            return 0;
+        }
+        strcpy(shcwd, argv[1]);
+        return 0;
+    }
+    if ((ret = findcmd(argv)) != 0) {
+        *store = ret;
+        return 0;
+    }
+    argv[argc] = NULL;
+    if ((pid = __spawn(NULL, argv)) < 0) {
+        *store = pid;
+        return 0;
+    }
+    return waitpid(pid, store);
+}
+
 int
 main(int argc, char **argv) {
     printf("user sh is running!!!");
@@ -234,13 +292,19 @@ main(int argc, char **argv) {
     char *buffer;
     while ((buffer = readline((interactive) ? "$ " : NULL)) != NULL) {
         shcwd[0] = '\0';
-        int pid;
-        if ((pid = fork()) == 0) {
-            ret = runcmd(buffer);
-            exit(ret);
+        int pid, waited;
+        if (simplecmd(buffer)) {
+            waited = spawncmd(buffer, &ret);
+        }
+        else {
+            if ((pid = fork()) == 0) {
+                ret = runcmd(buffer);
+                exit(ret);
+            }
+            assert(pid >= 0);
+            waited = waitpid(pid, &ret);
         }
-        assert(pid >= 0);
-        if (waitpid(pid, &ret) == 0) {
+        if (waited == 0) {
             if (ret == 0 && shcwd[0] != '\0') {
                 ret = 0;
             }
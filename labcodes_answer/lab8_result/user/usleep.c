@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <ulib.h>
+
+#define NROUNDS             5
+
+static const unsigned int sleeps[] = {50, 200, 1000, 3000, 25000};
+
+// sleep for times shorter and longer than a tick, and print how late each one woke up
+int
+main(void) {
+    int i, k;
+    for (i = 0; i < sizeof(sleeps) / sizeof(sleeps[0]); i ++) {
+        unsigned int us = sleeps[i], late = 0, max_late = 0;
+        for (k = 0; k < NROUNDS; k ++) {
+            unsigned int start = gettime_usec();
+            assert(usleep(us) == 0);
+            unsigned int took = gettime_usec() - start;
+            assert(took >= us);
+            late += took - us;
+            if (took - us > max_late) {
+                max_late = took - us;
+            }
+        }
+        cprintf("usleep %6u us: late %u us on average, %u at most\n", us, late / NROUNDS, max_late);
+    }
+    cprintf("usleep pass.\n");
+    return 0;
+}
+